@@ -0,0 +1,249 @@
+/*****************************************************************************
+  Title          : bufsize_sweep.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Runs the copy loop of spl_cp2 for many buffer sizes
+  Purpose        : To measure the effect of buffer size on performance
+  Usage          : bufsize_sweep [-c] [-d] [-l maxcalls] [-m maxsize]
+                                 [-o csvfile] sourcefile targetfile
+  Build with     : gcc -Wall -g -I../include -L ../lib -o bufsize_sweep \
+                   bufsize_sweep.c -lspl -lm
+
+  Notes:
+  spl_cp2 copies a file with a buffer of a given size, so that the effect
+  of the size can be seen by running it many times. This program does
+  those runs itself, copying sourcefile to targetfile with the same read()
+  and write() loop for every power of two from 1 byte up to maxsize
+  (default 16 MB), and prints a table of the elapsed time, the rate in
+  MB/s (2^20 bytes per second), and the user and system CPU time of each
+  run. With -o it also writes the table to csvfile in CSV form.
+
+  Whether the source is in the page cache matters more than anything
+  else, so it is controlled:
+
+  -c   Before each run, the source's pages are dropped from the page cache
+       with posix_fadvise(POSIX_FADV_DONTNEED), so that every run reads
+       from the device. Without -c, the source is read once before the
+       first run, so that every run reads from the cache.
+  -d   Each size that is a multiple of 4096 is also run with both files
+       opened with O_DIRECT, which bypasses the page cache altogether, and
+       with a buffer aligned to 4096 bytes, as O_DIRECT requires. If the
+       file system does not support O_DIRECT (tmpfs, for example), these
+       runs are skipped.
+
+  A one-byte buffer takes two system calls per byte, so each run stops
+  after maxcalls reads (default 1000000) and the rate is computed from
+  the bytes it copied. Use -l 0 to copy the whole file every time.
+
+  The target is truncated when it is opened for each run, which also
+  removes its pages from the cache.
+
+  The sweep is a program of its own, not an option of spl_cp2, because
+  spl_cp2's options (-B, -r, -i, -j, -d) change how a single copy is
+  paced, cached and flushed, and any of them would distort a comparison
+  of buffer sizes. Each run here uses only the plain read() and write()
+  loop that spl_cp2 uses without options.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.gplv3 for details.                *
+*****************************************************************************/
+
+#define _GNU_SOURCE
+#include "common_hdrs.h"
+#include <sys/resource.h>
+#include "time_utils.h"
+
+#define MESSAGE_SIZE    512
+#define MB              1048576.0
+#define DIRECT_ALIGN    4096
+#define DEFAULT_MAXSIZE (16*1024*1024)
+#define DEFAULT_CALLS   1000000
+
+#define USAGE "bufsize_sweep [-c] [-d] [-l maxcalls] [-m maxsize] " \
+              "[-o csvfile] source target"
+
+/* The measurements of one run. */
+typedef struct
+{
+    off_t   bytes;
+    double  secs;
+    double  user;
+    double  sys;
+} run_result;
+
+/* Returns the time in tv as a number of seconds. */
+double tv_secs( struct timeval tv )
+{
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Reads the whole of fd so that it is in the page cache. */
+void warm_cache( int fd )
+{
+    char    buf[65536];
+
+    while ( read(fd, buf, sizeof(buf)) > 0 )
+        ;
+}
+
+/* Copies source to target with a buffer of bufsize bytes, reading at most
+   maxcalls times (no limit if maxcalls is 0), with O_DIRECT if direct is
+   TRUE. Returns FALSE if the files cannot be opened with O_DIRECT.      */
+BOOL run_copy( const char *source, const char *target, long bufsize,
+               long maxcalls, BOOL direct, BOOL cold, run_result *r )
+{
+    int     source_fd, target_fd;
+    int     flags = direct ? O_DIRECT : 0;
+    char   *buf;
+    ssize_t n = 0;
+    long    calls = 0;
+    char    message[MESSAGE_SIZE];
+    struct rusage   ru_start, ru_end;
+    struct timespec start, finish, diff;
+
+    if ( -1 == (source_fd = open(source, O_RDONLY | flags)) ) {
+        if ( direct && errno == EINVAL )
+            return FALSE;
+        sprintf(message, "unable to open %s for reading", source);
+        fatal_error(errno, message);
+    }
+    if ( -1 == (target_fd = open(target, O_WRONLY|O_CREAT|O_TRUNC|flags,
+                                 0644)) ) {
+        if ( direct && errno == EINVAL ) {
+            close(source_fd);
+            return FALSE;
+        }
+        sprintf(message, "unable to open %s for writing", target);
+        fatal_error(errno, message);
+    }
+    if ( cold && 0 != (errno = posix_fadvise(source_fd, 0, 0,
+                                             POSIX_FADV_DONTNEED)) )
+        fatal_error(errno, "posix_fadvise");
+    if ( 0 != (errno = posix_memalign((void**) &buf, DIRECT_ALIGN, bufsize)) )
+        fatal_error(errno, "posix_memalign");
+
+    getrusage(RUSAGE_SELF, &ru_start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    r->bytes = 0;
+    while ( (maxcalls == 0 || calls++ < maxcalls) &&
+            (n = read(source_fd, buf, bufsize)) > 0 ) {
+        if ( n != write(target_fd, buf, n) ) {
+            /* O_DIRECT needs whole blocks; write the tail normally. */
+            if ( !direct || errno != EINVAL || n == bufsize ||
+                 -1 == fcntl(target_fd, F_SETFL, 0) ||
+                 n != write(target_fd, buf, n) )
+                fatal_error(errno, "write");
+        }
+        r->bytes += n;
+    }
+    if ( n == -1 )
+        fatal_error(errno, "read");
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    getrusage(RUSAGE_SELF, &ru_end);
+
+    timespec_diff(finish, start, &diff);
+    timespec_to_dbl(diff, &r->secs);
+    r->user = tv_secs(ru_end.ru_utime) - tv_secs(ru_start.ru_utime);
+    r->sys  = tv_secs(ru_end.ru_stime) - tv_secs(ru_start.ru_stime);
+    free(buf);
+    close(source_fd);
+    close(target_fd);
+    return TRUE;
+}
+
+/* Prints the result of a run as a row of the table and of the CSV file. */
+void print_result( long bufsize, const char *mode, run_result *r, FILE *csv )
+{
+    double rate = ( r->secs > 0 ) ? r->bytes / MB / r->secs : 0;
+
+    printf("%9ld  %-8s %12lld %9.4f %10.1f %8.3f %8.3f\n", bufsize, mode,
+           (long long) r->bytes, r->secs, rate, r->user, r->sys);
+    if ( csv != NULL )
+        fprintf(csv, "%ld,%s,%lld,%.6f,%.3f,%.6f,%.6f\n", bufsize, mode,
+                (long long) r->bytes, r->secs, rate, r->user, r->sys);
+}
+
+int main(int argc, char *argv[])
+{
+    int        ch;
+    char       options[] = ":cdl:m:o:";
+    BOOL       cold = FALSE, direct = FALSE, direct_ok = TRUE;
+    long       maxcalls = DEFAULT_CALLS;
+    long       maxsize  = DEFAULT_MAXSIZE;
+    char      *csvname = NULL;
+    FILE      *csv = NULL;
+    int        fd;
+    run_result r;
+
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt(argc, argv, options);
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'c':
+            cold = TRUE;
+            break;
+        case 'd':
+            direct = TRUE;
+            break;
+        case 'l':
+            if ( VALID_NUMBER != get_long(optarg, NON_NEG_ONLY, &maxcalls,
+                                          NULL) )
+                usage_error("Invalid argument to -l");
+            break;
+        case 'm':
+            if ( VALID_NUMBER != get_long(optarg, POS_ONLY, &maxsize, NULL) )
+                usage_error("Invalid argument to -m");
+            break;
+        case 'o':
+            csvname = optarg;
+            break;
+        default:
+            usage_error(USAGE);
+        }
+    }
+    if ( argc - optind != 2 )
+        usage_error(USAGE);
+
+    if ( csvname != NULL ) {
+        if ( NULL == (csv = fopen(csvname, "w")) )
+            fatal_error(errno, csvname);
+        fprintf(csv, "bufsize,mode,bytes,seconds,mb_per_sec,user_secs,"
+                "sys_secs\n");
+    }
+    if ( !cold ) {
+        if ( -1 == (fd = open(argv[optind], O_RDONLY)) )
+            fatal_error(errno, argv[optind]);
+        warm_cache(fd);
+        close(fd);
+    }
+
+    printf("Source %s, %s cache\n", argv[optind], cold ? "cold" : "warm");
+    printf("%9s  %-8s %12s %9s %10s %8s %8s\n", "bufsize", "mode", "bytes",
+           "secs", "MB/s", "user", "sys");
+    for ( long bufsize = 1; bufsize <= maxsize; bufsize *= 2 ) {
+        run_copy(argv[optind], argv[optind+1], bufsize, maxcalls, FALSE,
+                 cold, &r);
+        print_result(bufsize, "buffered", &r, csv);
+        if ( direct && direct_ok && bufsize % DIRECT_ALIGN == 0 ) {
+            if ( run_copy(argv[optind], argv[optind+1], bufsize, maxcalls,
+                          TRUE, cold, &r) )
+                print_result(bufsize, "direct", &r, csv);
+            else {
+                printf("O_DIRECT is not supported for these files.\n");
+                direct_ok = FALSE;
+            }
+        }
+    }
+    if ( csv != NULL )
+        fclose(csv);
+    return 0;
+}
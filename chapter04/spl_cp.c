@@ -0,0 +1,1057 @@
+/*****************************************************************************
+  Title          : spl_cp.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : A cp command that can copy without a user-space buffer
+  Purpose        : To compare the ways that Linux can copy a file
+  Usage          : spl_cp [-v] [-e engine] [-b bufsize] [-s when] [-P] \
+                          [-d] [--verify[=sum]] [--readback] source target
+                   spl_cp -C [-b bufsize] source target
+                   spl_cp -r [-v] [-j threads] [-e engine] [-b bufsize] \
+                          [-s when] [-d] [--verify[=sum]] [--readback] \
+                          sourcedir targetdir
+  Build with     : gcc -Wall -g -I../include -L ../lib -o spl_cp spl_cp.c \
+                   -lspl -lm -pthread
+
+  Notes:
+  spl_cp1 and spl_cp2 read every byte into a buffer and write it out
+  again, so the data crosses the user/kernel boundary twice. spl_cp copies
+  with copy_fd() from libspl, which can instead ask the kernel to do the
+  copy. The -e option selects the engine:
+
+     auto             try each of the following in turn (the default)
+     copy_file_range  copy within the kernel, sharing blocks if the file
+                      system supports reflinks
+     sendfile         move the pages of the source to the target
+     splice           move the pages through a pipe
+     rw               read() and write() through a buffer, like spl_cp2
+     mmap             map the source and write() from the mapping
+     mmap_both        map the source and the target and memcpy() between
+                      them
+
+  auto never chooses the mmap engines. With -P, their mappings are made
+  with MAP_POPULATE, so the kernel reads each 64 MB window of the source
+  in when it is mapped, instead of one page fault at a time.
+
+  -b sets the size of the buffer for rw and of the pipe for splice
+  (default 128 KB). With -v, spl_cp prints the engine that did the copy
+  and the rate it achieved, in MB/s (2^20 bytes per second).
+
+  -C copies the source to the target once with each engine, and with the
+  mmap engines both with and without MAP_POPULATE, and prints a table of
+  the time, rate, CPU time, and page faults of each, so that the engines
+  can be compared on files of different sizes. The source is copied once
+  first, so that it is in the page cache for all of them.
+
+  -s says when to make holes in the target, as in GNU cp:
+
+     never   write every byte of the source
+     auto    make a hole wherever the source has one (the default); only
+             the data regions, found with lseek(SEEK_DATA/SEEK_HOLE), are
+             copied, so a file that is mostly hole is copied quickly
+     always  also make a hole of every block of the source that contains
+             only zeros; the data is read through the buffer to find them
+
+  With -r, spl_cp copies the directory tree sourcedir to targetdir, or
+  into it if targetdir exists. The main thread walks the tree with fts,
+  creating the directories and symbolic links, and puts the files to copy
+  into a queue from which a pool of worker threads (-j, by default twice
+  the number of processors) takes them. Having many copies in progress at
+  once keeps all of the processors and the device's queue busy:
+
+  - Small files are put into the queue in batches, so that the cost of
+    passing work to a thread is shared by many files.
+  - Files of at least two chunks (64 MB) are divided into chunks, which
+    are queued separately, so that one large file does not keep one
+    thread busy while the others are idle. Each chunk is copied with
+    copy_sparse_range(), so the holes in it are kept as -s says.
+  - Directories are created writable by their owner, and their modes and
+    times are set after all of the files have been copied, in the order
+    in which fts visits them in postorder, so that creating the files does
+    not change their times and a read-only directory is not made so before
+    its files are in it.
+
+  Other kinds of files, such as FIFOs and devices, are skipped.
+
+  --verify computes a checksum of the data as it is copied, which saves
+  reading the file again to check it afterward, and prints it, followed by
+  the name of the source, as sha256sum and similar programs do. sum is
+  crc32c (the default) or xxh64; see checksum.h in libspl. The data must
+  pass through a buffer to be summed, so it is copied with read() and
+  write() whatever -e says, and the target has no holes. The checksum is
+  computed by a second thread while the first reads and writes the next
+  blocks, so that on a machine with a processor to spare, a verified copy
+  takes little longer than one that is not.
+
+  --readback (which implies --verify) also reads the target back after it
+  has been flushed to the device with fdatasync(), with O_DIRECT so that
+  the data comes from the device and not from the page cache, and fails if
+  its checksum differs. If the file system does not support O_DIRECT, the
+  target's pages are dropped from the cache with posix_fadvise() instead.
+
+  -d updates an existing target in place instead of truncating it and
+  writing all of it again. The source and the target are read side by
+  side, a buffer of bufsize bytes at a time, and only the runs of pages
+  (4 KB) that differ are written, so that updating a large disk image or
+  database snapshot of which little has changed writes little more than
+  what has changed. Tools such as rsync find blocks of the target in the
+  source with a rolling checksum, which is needed when the target is on
+  another machine, but here both files can be read, and a block of the
+  target that is written in place can only be kept if it is at the same
+  offset in the source, so the pages are compared directly. The target is
+  then truncated to the size of the source. -e and -s have no effect; the
+  target keeps its holes only where the source's pages are still zeros.
+
+  With -r, --verify and -d print a line for each file, and large files are
+  not divided into chunks, because each file is processed in order.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.gplv3 for details.                *
+*****************************************************************************/
+
+#define _GNU_SOURCE
+#include "common_hdrs.h"
+#include <fts.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "checksum.h"
+#include "copy_utils.h"
+#include "time_utils.h"
+
+#define MESSAGE_SIZE   (PATH_MAX + 64)
+#define MB             1048576.0
+#define BATCH_FILES    64               /* Most files in a batch            */
+#define BATCH_BYTES    (1024*1024)      /* Most bytes of files in a batch   */
+#define CHUNK_SIZE     (64*1024*1024)   /* Size of a piece of a large file  */
+#define BUFFER_SIZE    64               /* Jobs that can wait in the queue  */
+#define WHOLE_FILE     -1               /* Length of an item that is a file */
+#define SKIPPED        1                /* fts_number of a skipped directory */
+#define SUM_SLOTS      4                /* Blocks waiting to be checksummed */
+#define DIRECT_ALIGN   4096             /* Alignment of O_DIRECT buffers    */
+#define DELTA_PAGE     4096             /* Unit compared by -d              */
+
+#define USAGE "spl_cp [-v] [-e engine] [-b bufsize] [-s when] [-P] [-d] " \
+    "[--verify[=sum]] [--readback] source target\n" \
+    "       spl_cp -r [-v] [-j threads] [-e engine] [-b bufsize] [-s when] " \
+    "[-d] [--verify[=sum]] [--readback] sourcedir targetdir\n" \
+    "       spl_cp -C [-b bufsize] source target\n" \
+    "engines: auto, copy_file_range, sendfile, splice, rw, mmap, mmap_both\n" \
+    "when:    never, auto, always\n" \
+    "sums:    crc32c, xxh64"
+
+/* The settings given by the command-line options. */
+typedef struct
+{
+    copy_engine  engine;    /* How to copy the data                */
+    long         bufsize;   /* Buffer or pipe size, 0 for default  */
+    sparse_mode  sparse;    /* When to make holes in the target    */
+    BOOL         verbose;   /* Whether to report engine and rate   */
+    BOOL         recursive; /* Whether to copy a directory tree    */
+    BOOL         compare;   /* Whether to compare the engines      */
+    int          threads;   /* Worker threads for a tree           */
+    BOOL         verify;    /* Whether to checksum the data        */
+    BOOL         readback;  /* Whether to read the target back     */
+    checksum_type sum_type; /* Which checksum to compute           */
+    BOOL         delta;     /* Whether to update the target in place */
+} copy_options;
+
+/* A whole file to copy, or a chunk of one. */
+typedef struct
+{
+    char   *source;
+    char   *target;
+    off_t   offset;         /* Where the chunk starts               */
+    off_t   len;            /* Length of the chunk, or WHOLE_FILE   */
+} copy_item;
+
+/* The unit of work taken from the queue by a worker. */
+typedef struct
+{
+    int        count;
+    off_t      bytes;
+    copy_item  items[BATCH_FILES];
+} job;
+
+/* What a worker is given, and what it reports when it finishes. */
+typedef struct
+{
+    copy_options *opts;
+    long          files;    /* Files completed                      */
+    off_t         bytes;    /* Bytes of data written                */
+    BOOL          failed;   /* Whether any copy failed              */
+} worker_data;
+
+/* The mode and times to give a directory when the copy is done. */
+typedef struct
+{
+    char            *path;
+    mode_t           mode;
+    struct timespec  times[2];
+} dir_meta;
+
+/*----------------------------------------------------------------------------
+                                Job Queue
+----------------------------------------------------------------------------*/
+
+job    *buffer[BUFFER_SIZE];
+int     buf_count = 0;          /* number of full elements */
+int     front     = 0;
+int     rear      = 0;
+BOOL    walk_done = FALSE;      /* Whether the last job has been queued */
+
+pthread_mutex_t  buf_mutex        = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t   space_available  = PTHREAD_COND_INITIALIZER;
+pthread_cond_t   data_available   = PTHREAD_COND_INITIALIZER;
+
+void add_buffer( job *j )
+{
+    buffer[rear] = j;
+    rear = (rear + 1) % BUFFER_SIZE;
+    buf_count++;
+}
+
+job* get_buffer()
+{
+    job *j = buffer[front];
+    front = (front + 1) % BUFFER_SIZE;
+    buf_count--;
+    return j;
+}
+
+/* Puts j into the queue, waiting until there is room for it. */
+void queue_job( job *j )
+{
+    pthread_mutex_lock(&buf_mutex);
+    while ( BUFFER_SIZE == buf_count )
+        pthread_cond_wait(&space_available, &buf_mutex);
+    add_buffer(j);
+    pthread_cond_signal(&data_available);
+    pthread_mutex_unlock(&buf_mutex);
+}
+
+/*----------------------------------------------------------------------------
+                                Checksums
+----------------------------------------------------------------------------*/
+
+/* The blocks passed from the thread that copies a file to the thread that
+   computes its checksum. A block stays in the queue until it has been
+   summed, so the copying thread does not read into it before then.     */
+typedef struct
+{
+    char           *buf[SUM_SLOTS];
+    size_t          len[SUM_SLOTS];
+    int             count;          /* Blocks waiting to be summed    */
+    int             front;
+    int             rear;
+    BOOL            done;           /* Whether the last block is in   */
+    checksum_state  sum;
+    pthread_mutex_t mutex;
+    pthread_cond_t  space_available;
+    pthread_cond_t  data_available;
+} sum_queue;
+
+/* Checksum thread start function. Adds each block in the queue to the
+   checksum until the last one has been summed.                      */
+void *summer( void *data )
+{
+    sum_queue *q = (sum_queue*) data;
+    int        i;
+
+    while ( TRUE ) {
+        pthread_mutex_lock(&q->mutex);
+        while ( 0 == q->count && !q->done )
+            pthread_cond_wait(&q->data_available, &q->mutex);
+        if ( 0 == q->count ) {
+            pthread_mutex_unlock(&q->mutex);
+            break;
+        }
+        i = q->front;
+        pthread_mutex_unlock(&q->mutex);
+
+        checksum_update(&q->sum, q->buf[i], q->len[i]);
+
+        pthread_mutex_lock(&q->mutex);
+        q->front = (q->front + 1) % SUM_SLOTS;
+        q->count--;
+        pthread_cond_signal(&q->space_available);
+        pthread_mutex_unlock(&q->mutex);
+    }
+    pthread_exit(NULL);
+}
+
+/* Reads in_fd to the end in blocks of bufsize bytes and writes them to
+   out_fd, unless out_fd is -1, while another thread computes a checksum
+   of the given type of the data, which is stored in *sum. The buffers are
+   aligned for O_DIRECT. Returns the number of bytes read, or -1.      */
+off_t summed_copy( int in_fd, int out_fd, size_t bufsize, checksum_type type,
+                   uint64_t *sum )
+{
+    sum_queue  q;
+    pthread_t  thread;
+    ssize_t    n;
+    off_t      total = 0;
+    int        retval;
+
+    memset(&q, 0, sizeof(q));
+    pthread_mutex_init(&q.mutex, NULL);
+    pthread_cond_init(&q.space_available, NULL);
+    pthread_cond_init(&q.data_available, NULL);
+    checksum_init(&q.sum, type);
+    for ( int i = 0; i < SUM_SLOTS; i++ )
+        if ( 0 != (errno = posix_memalign((void**) &q.buf[i], DIRECT_ALIGN,
+                                          bufsize)) )
+            fatal_error(errno, "posix_memalign");
+    if ( 0 != (retval = pthread_create(&thread, NULL, summer, &q)) )
+        fatal_error(retval, "pthread_create");
+
+    while ( TRUE ) {
+        pthread_mutex_lock(&q.mutex);
+        while ( SUM_SLOTS == q.count )
+            pthread_cond_wait(&q.space_available, &q.mutex);
+        pthread_mutex_unlock(&q.mutex);
+
+        /* Only this thread uses the slot at rear until it is queued. */
+        if ( 0 >= (n = read(in_fd, q.buf[q.rear], bufsize)) )
+            break;
+        if ( out_fd != -1 && -1 == write_all(out_fd, q.buf[q.rear], n) ) {
+            n = -1;
+            break;
+        }
+        total += n;
+
+        pthread_mutex_lock(&q.mutex);
+        q.len[q.rear] = n;
+        q.rear = (q.rear + 1) % SUM_SLOTS;
+        q.count++;
+        pthread_cond_signal(&q.data_available);
+        pthread_mutex_unlock(&q.mutex);
+    }
+    retval = errno;
+
+    pthread_mutex_lock(&q.mutex);
+    q.done = TRUE;
+    pthread_cond_signal(&q.data_available);
+    pthread_mutex_unlock(&q.mutex);
+    pthread_join(thread, NULL);
+
+    *sum = checksum_final(&q.sum);
+    for ( int i = 0; i < SUM_SLOTS; i++ )
+        free(q.buf[i]);
+    pthread_mutex_destroy(&q.mutex);
+    pthread_cond_destroy(&q.space_available);
+    pthread_cond_destroy(&q.data_available);
+    errno = retval;
+    return ( n == -1 ) ? -1 : total;
+}
+
+/* Flushes the target, whose descriptor is target_fd, to the device and
+   reads it back, and returns TRUE if its checksum is expected. Prints a
+   message and returns FALSE otherwise.                                */
+BOOL read_back( const char *target, int target_fd, copy_options *opts,
+                size_t bufsize, uint64_t expected )
+{
+    int       fd;
+    uint64_t  sum;
+    off_t     n;
+    char      message[MESSAGE_SIZE];
+
+    if ( -1 == fdatasync(target_fd) && errno != EINVAL ) {
+        snprintf(message, MESSAGE_SIZE, "unable to flush %s", target);
+        error_mssge(errno, message);
+        return FALSE;
+    }
+    if ( -1 == (fd = open(target, O_RDONLY | O_DIRECT)) && errno == EINVAL ) {
+        /* Clean pages can be dropped, so the reads below go to the device. */
+        posix_fadvise(target_fd, 0, 0, POSIX_FADV_DONTNEED);
+        fd = open(target, O_RDONLY);
+    }
+    if ( fd == -1 ) {
+        snprintf(message, MESSAGE_SIZE, "unable to open %s for reading",
+                 target);
+        error_mssge(errno, message);
+        return FALSE;
+    }
+    n = summed_copy(fd, -1, bufsize, opts->sum_type, &sum);
+    close(fd);
+    if ( n == -1 ) {
+        snprintf(message, MESSAGE_SIZE, "reading back %s", target);
+        error_mssge(errno, message);
+        return FALSE;
+    }
+    if ( sum != expected ) {
+        snprintf(message, MESSAGE_SIZE, "%s: %s of the copy is %0*llx, "
+                 "not %0*llx", target, checksum_name(opts->sum_type),
+                 checksum_digits(opts->sum_type), (unsigned long long) sum,
+                 checksum_digits(opts->sum_type),
+                 (unsigned long long) expected);
+        error_mssge(-1, message);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*----------------------------------------------------------------------------
+                                Delta Updates
+----------------------------------------------------------------------------*/
+
+/* Writes the len bytes at buf to fd at offset, continuing after a short
+   write. Returns len, or -1 on error.                                 */
+ssize_t pwrite_all( int fd, const char *buf, size_t len, off_t offset )
+{
+    ssize_t n;
+
+    for ( size_t done = 0; done < len; done += n )
+        if ( -1 == (n = pwrite(fd, buf + done, len - done, offset + done)) )
+            return -1;
+    return len;
+}
+
+/* Makes target_fd, which is open for reading and writing, a copy of
+   source_fd by writing only the runs of pages that differ, and adds the
+   data to *sum unless sum is NULL. Stores the size of the source in
+   *size. Returns the number of bytes written, or -1 on error.        */
+off_t delta_copy( int source_fd, int target_fd, size_t bufsize,
+                  checksum_state *sum, off_t *size )
+{
+    char    *src, *dst;
+    off_t    pos = 0, written = 0;
+    ssize_t  n, m;
+    size_t   off, start, len;
+    BOOL     failed = FALSE;
+
+    src = malloc(bufsize);
+    dst = malloc(bufsize);
+    if ( src == NULL || dst == NULL )
+        fatal_error(errno, "malloc");
+
+    while ( !failed && (n = read(source_fd, src, bufsize)) > 0 ) {
+        if ( sum != NULL )
+            checksum_update(sum, src, n);
+        if ( -1 == (m = pread(target_fd, dst, n, pos)) ) {
+            failed = TRUE;
+            break;
+        }
+        /* Bytes beyond m are past the end of the target, so they differ. */
+        for ( off = 0; off < (size_t) n; ) {
+            len = ( n - off < DELTA_PAGE ) ? n - off : DELTA_PAGE;
+            if ( off + len <= (size_t) m && 0 == memcmp(src + off, dst + off,
+                                                        len) ) {
+                off += len;
+                continue;
+            }
+            for ( start = off; off < (size_t) n; off += len ) {
+                len = ( n - off < DELTA_PAGE ) ? n - off : DELTA_PAGE;
+                if ( off + len <= (size_t) m &&
+                     0 == memcmp(src + off, dst + off, len) )
+                    break;
+            }
+            if ( -1 == pwrite_all(target_fd, src + start, off - start,
+                                  pos + start) ) {
+                failed = TRUE;
+                break;
+            }
+            written += off - start;
+        }
+        pos += n;
+    }
+    if ( n == -1 || (!failed && -1 == ftruncate(target_fd, pos)) )
+        failed = TRUE;
+    free(src);
+    free(dst);
+    *size = pos;
+    return failed ? -1 : written;
+}
+
+/*----------------------------------------------------------------------------
+                                Copying Files
+----------------------------------------------------------------------------*/
+
+/* Prints how many bytes engine copied in secs seconds, and the rate, and
+   if the file has holes, how many of its bytes were data.               */
+void report( const char *engine, off_t bytes, off_t data, double secs )
+{
+    printf("%s: %lld bytes in %.3f s", engine, (long long) bytes, secs);
+    if ( secs > 0 )
+        printf(" (%.1f MB/s)", bytes / MB / secs);
+    if ( data != bytes )
+        printf(", %lld bytes of data", (long long) data);
+    printf("\n");
+}
+
+/* Returns the access mode with which the target must be opened. */
+int target_mode( copy_options *opts )
+{
+    /* A mapping that can be written requires a descriptor that can read,
+       and so does comparing the target with the source.                 */
+    return ( opts->engine == COPY_MMAP_BOTH || opts->delta ) ? O_RDWR :
+                                                               O_WRONLY;
+}
+
+/* Copies the file source to target as opts says, and if report_rate is
+   TRUE, reports the engine used and the rate. Returns the number of bytes
+   of data written, or -1 after printing a message if the copy failed.  */
+off_t copy_file( const char *source, const char *target, copy_options *opts,
+                 BOOL report_rate )
+{
+    int          source_fd, target_fd;
+    struct stat  sb;
+    char         message[MESSAGE_SIZE];
+    off_t        copied = -1;
+    copy_engine  used;
+    size_t       bufsize;
+    uint64_t     sum;
+    checksum_state  state;
+    off_t        size;
+    struct timespec start;
+
+    if ( -1 == (source_fd = open(source, O_RDONLY)) ) {
+        snprintf(message, MESSAGE_SIZE, "unable to open %s for reading",
+                 source);
+        error_mssge(errno, message);
+        return -1;
+    }
+    if ( -1 == fstat(source_fd, &sb) ) {
+        error_mssge(errno, "fstat");
+        close(source_fd);
+        return -1;
+    }
+    if ( S_ISDIR(sb.st_mode) ) {
+        snprintf(message, MESSAGE_SIZE, "%s is a directory (use -r)", source);
+        error_mssge(-1, message);
+        close(source_fd);
+        return -1;
+    }
+    if ( -1 == (target_fd = open(target, target_mode(opts) | O_CREAT |
+                                 (opts->delta ? 0 : O_TRUNC),
+                                 sb.st_mode & 0777)) ) {
+        snprintf(message, MESSAGE_SIZE, "unable to open %s for writing",
+                 target);
+        error_mssge(errno, message);
+        close(source_fd);
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    /* O_DIRECT reads need a whole number of aligned blocks. */
+    bufsize = ( opts->bufsize > 0 ) ? opts->bufsize : DEFAULT_COPY_BUFSIZE;
+    bufsize = (bufsize + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    if ( opts->delta ) {
+        used = COPY_BUFFERED;
+        checksum_init(&state, opts->sum_type);
+        copied = delta_copy(source_fd, target_fd, bufsize,
+                            opts->verify ? &state : NULL, &size);
+        sum = checksum_final(&state);
+    }
+    else if ( opts->verify ) {
+        used    = COPY_BUFFERED;
+        copied  = summed_copy(source_fd, target_fd, bufsize, opts->sum_type,
+                              &sum);
+    }
+    else
+        copied = copy_sparse(source_fd, target_fd, opts->sparse, opts->engine,
+                             opts->bufsize, &used);
+    if ( copied == -1 ) {
+        snprintf(message, MESSAGE_SIZE, "copying %s with %s", source,
+                 copy_engine_name(opts->verify || opts->delta ?
+                                  COPY_BUFFERED : opts->engine));
+        error_mssge(errno, message);
+    }
+    else if ( opts->readback && !read_back(target, target_fd, opts, bufsize,
+                                           sum) )
+        copied = -1;
+    if ( -1 == close(target_fd) && copied != -1 ) {
+        snprintf(message, MESSAGE_SIZE, "error closing target file %s",
+                 target);
+        error_mssge(errno, message);
+        copied = -1;
+    }
+    close(source_fd);
+    if ( opts->verify && copied != -1 )
+        printf("%0*llx  %s\n", checksum_digits(opts->sum_type),
+               (unsigned long long) sum, source);
+    if ( opts->delta && copied != -1 && (report_rate || opts->recursive) )
+        printf("%s: %lld bytes compared, %lld bytes written\n", source,
+               (long long) size, (long long) copied);
+    else if ( report_rate && copied != -1 )
+        report(copy_engine_name(used), sb.st_size > copied ? sb.st_size :
+               copied, copied, elapsed(start));
+    return copied;
+}
+
+/* Returns the time in tv as a number of seconds. */
+double tv_secs( struct timeval tv )
+{
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Copies source to target with each engine, and prints a table of the
+   time, rate, CPU time, and page faults of each copy.                  */
+void compare_engines( const char *source, const char *target,
+                      copy_options *opts )
+{
+    copy_options  o = *opts;
+    struct rusage before, after;
+    struct timespec start;
+    off_t         n;
+    double        secs;
+    char          name[32];
+
+    o.sparse = SPARSE_NEVER;    /* Every engine copies every byte. */
+    o.verify = o.readback = o.delta = FALSE;
+    if ( -1 == copy_file(source, target, &o, FALSE) )
+        exit(EXIT_FAILURE);
+
+    printf("%-20s %12s %9s %10s %8s %8s %9s %7s\n", "engine", "bytes",
+           "secs", "MB/s", "user", "sys", "minflt", "majflt");
+    for ( copy_engine e = COPY_RANGE; e < NUM_COPY_ENGINES; e++ ) {
+        BOOL is_mmap = ( e == COPY_MMAP || e == COPY_MMAP_BOTH );
+        for ( int populate = 0; populate <= is_mmap; populate++ ) {
+            set_mmap_populate(populate);
+            o.engine = e;
+            snprintf(name, sizeof(name), "%s%s", copy_engine_name(e),
+                     populate ? "+populate" : "");
+            getrusage(RUSAGE_SELF, &before);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            n = copy_file(source, target, &o, FALSE);
+            secs = elapsed(start);
+            getrusage(RUSAGE_SELF, &after);
+            if ( n == -1 ) {
+                printf("%-20s failed\n", name);
+                continue;
+            }
+            printf("%-20s %12lld %9.4f %10.1f %8.3f %8.3f %9ld %7ld\n",
+                   name, (long long) n, secs,
+                   secs > 0 ? n / MB / secs : 0,
+                   tv_secs(after.ru_utime) - tv_secs(before.ru_utime),
+                   tv_secs(after.ru_stime) - tv_secs(before.ru_stime),
+                   after.ru_minflt - before.ru_minflt,
+                   after.ru_majflt - before.ru_majflt);
+        }
+    }
+    set_mmap_populate(FALSE);
+}
+
+/* Copies the chunk of a file described by item into the same place in the
+   target, which already exists. Returns the number of bytes copied, or
+   -1 after printing a message if the copy failed.                        */
+off_t copy_chunk( copy_item *item, copy_options *opts )
+{
+    int    source_fd, target_fd = -1;
+    off_t  copied = -1;
+    char   message[MESSAGE_SIZE];
+
+    if ( -1 != (source_fd = open(item->source, O_RDONLY)) &&
+         -1 != (target_fd = open(item->target, target_mode(opts))) )
+        copied = copy_sparse_range(source_fd, target_fd, item->offset,
+                                   item->len, opts->sparse, opts->engine,
+                                   opts->bufsize, NULL);
+    if ( copied == -1 ) {
+        snprintf(message, MESSAGE_SIZE, "copying %s to %s", item->source,
+                 item->target);
+        error_mssge(errno, message);
+    }
+    if ( source_fd != -1 )
+        close(source_fd);
+    if ( target_fd != -1 )
+        close(target_fd);
+    return copied;
+}
+
+/* Worker thread start function. Takes jobs from the queue and copies the
+   files and chunks in them until the queue is empty and the walk is done. */
+void *worker( void *data )
+{
+    worker_data *w = (worker_data*) data;
+    job         *j;
+    copy_item   *item;
+    off_t        n;
+
+    while ( TRUE ) {
+        pthread_mutex_lock(&buf_mutex);
+        while ( 0 == buf_count && !walk_done )
+            pthread_cond_wait(&data_available, &buf_mutex);
+        if ( 0 == buf_count ) {
+            pthread_mutex_unlock(&buf_mutex);
+            break;
+        }
+        j = get_buffer();
+        pthread_cond_signal(&space_available);
+        pthread_mutex_unlock(&buf_mutex);
+
+        for ( int k = 0; k < j->count; k++ ) {
+            item = &j->items[k];
+            if ( item->len == WHOLE_FILE )
+                n = copy_file(item->source, item->target, w->opts, FALSE);
+            else
+                n = copy_chunk(item, w->opts);
+            if ( n == -1 )
+                w->failed = TRUE;
+            else {
+                w->bytes += n;
+                if ( item->offset == 0 )
+                    w->files++;
+            }
+            free(item->source);
+            free(item->target);
+        }
+        free(j);
+    }
+    pthread_exit(NULL);
+}
+
+/*----------------------------------------------------------------------------
+                                Copying Trees
+----------------------------------------------------------------------------*/
+
+/* Adds an item for the given file or chunk of it to *batch, creating the
+   batch if *batch is NULL, and queues the batch once it is full.        */
+void add_item( job **batch, const char *source, const char *target,
+               off_t offset, off_t len, off_t size )
+{
+    job       *j;
+    copy_item *item;
+
+    if ( *batch == NULL && NULL == (*batch = calloc(1, sizeof(job))) )
+        fatal_error(errno, "calloc");
+    j    = *batch;
+    item = &j->items[j->count++];
+    if ( NULL == (item->source = strdup(source)) ||
+         NULL == (item->target = strdup(target)) )
+        fatal_error(errno, "strdup");
+    item->offset = offset;
+    item->len    = len;
+    j->bytes    += size;
+    if ( j->count == BATCH_FILES || j->bytes >= BATCH_BYTES ) {
+        queue_job(j);
+        *batch = NULL;
+    }
+}
+
+/* Queues the copy of the regular file source, of the given size and mode,
+   to target. If split is TRUE, a file of two chunks or more is created
+   here, at its full size, and each chunk is queued as a job of its own. */
+BOOL queue_file( job **batch, const char *source, const char *target,
+                 off_t size, mode_t mode, BOOL split )
+{
+    int    fd;
+    char   message[MESSAGE_SIZE];
+
+    if ( !split || size < 2 * CHUNK_SIZE ) {
+        add_item(batch, source, target, 0, WHOLE_FILE, size);
+        return TRUE;
+    }
+    if ( -1 == (fd = open(target, O_WRONLY|O_CREAT|O_TRUNC, mode & 0777)) ||
+         -1 == ftruncate(fd, size) ) {
+        snprintf(message, MESSAGE_SIZE, "unable to create %s", target);
+        error_mssge(errno, message);
+        if ( fd != -1 )
+            close(fd);
+        return FALSE;
+    }
+    close(fd);
+    for ( off_t offset = 0; offset < size; offset += CHUNK_SIZE ) {
+        job *chunk = NULL;
+        add_item(&chunk, source, target, offset,
+                 size - offset < CHUNK_SIZE ? size - offset : CHUNK_SIZE,
+                 BATCH_BYTES);
+    }
+    return TRUE;
+}
+
+/* Makes a symbolic link at target with the same contents as source. */
+BOOL copy_symlink( const char *source, const char *target )
+{
+    char     contents[PATH_MAX];
+    ssize_t  len;
+    char     message[MESSAGE_SIZE];
+
+    if ( -1 != (len = readlink(source, contents, PATH_MAX - 1)) ) {
+        contents[len] = '\0';
+        if ( 0 == symlink(contents, target) )
+            return TRUE;
+    }
+    snprintf(message, MESSAGE_SIZE, "unable to copy link %s", source);
+    error_mssge(errno, message);
+    return FALSE;
+}
+
+/* Copies the tree rooted at source to target as opts says. Returns TRUE
+   if everything was copied.                                           */
+BOOL copy_tree( char *source, const char *target, copy_options *opts )
+{
+    char        *roots[] = { source, NULL };
+    FTS         *tree;
+    FTSENT      *ent;
+    char         path[PATH_MAX];
+    char         message[MESSAGE_SIZE];
+    size_t       root_len = 0;
+    struct stat  target_sb = { 0 };
+    job         *batch = NULL;
+    dir_meta    *dirs = NULL;
+    int          num_dirs = 0, max_dirs = 0;
+    pthread_t   *threads;
+    worker_data *wdata;
+    long         files = 0;
+    off_t        bytes = 0;
+    BOOL         ok = TRUE;
+    int          retval;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    threads = calloc(opts->threads, sizeof(pthread_t));
+    wdata   = calloc(opts->threads, sizeof(worker_data));
+    if ( threads == NULL || wdata == NULL )
+        fatal_error(errno, "calloc");
+    for ( int t = 0; t < opts->threads; t++ ) {
+        wdata[t].opts = opts;
+        if ( 0 != (retval = pthread_create(&threads[t], NULL, worker,
+                                           &wdata[t])) )
+            fatal_error(retval, "pthread_create");
+    }
+
+    /* The workers open files by pathname, so fts must not change the
+       working directory.                                                */
+    if ( NULL == (tree = fts_open(roots, FTS_PHYSICAL | FTS_NOCHDIR, NULL)) )
+        fatal_error(errno, "fts_open");
+    errno = 0;
+    while ( NULL != (ent = fts_read(tree)) ) {
+        if ( ent->fts_level == FTS_ROOTLEVEL ) {
+            root_len = ent->fts_pathlen;
+            while ( root_len > 1 && ent->fts_path[root_len-1] == '/' )
+                root_len--;
+        }
+        /* The target path is target followed by the path below source. */
+        if ( snprintf(path, PATH_MAX, "%s%s", target,
+                      ent->fts_path + root_len) >= PATH_MAX ) {
+            snprintf(message, MESSAGE_SIZE, "%s: path too long",
+                     ent->fts_path);
+            error_mssge(-1, message);
+            ok = FALSE;
+            continue;
+        }
+
+        switch ( ent->fts_info ) {
+        case FTS_D:
+            if ( ent->fts_level > FTS_ROOTLEVEL &&
+                 ent->fts_statp->st_dev == target_sb.st_dev &&
+                 ent->fts_statp->st_ino == target_sb.st_ino ) {
+                fts_set(tree, ent, FTS_SKIP);   /* Don't copy the copy. */
+                ent->fts_number = SKIPPED;
+                break;
+            }
+            if ( -1 == mkdir(path, S_IRWXU) && errno != EEXIST ) {
+                snprintf(message, MESSAGE_SIZE, "unable to create %s", path);
+                error_mssge(errno, message);
+                fts_set(tree, ent, FTS_SKIP);
+                ent->fts_number = SKIPPED;
+                ok = FALSE;
+                break;
+            }
+            if ( ent->fts_level == FTS_ROOTLEVEL &&
+                 -1 == stat(path, &target_sb) )
+                fatal_error(errno, "stat");
+            break;
+        case FTS_DP:
+            if ( ent->fts_number == SKIPPED )
+                break;
+            if ( num_dirs == max_dirs ) {
+                max_dirs = ( max_dirs == 0 ) ? 64 : 2 * max_dirs;
+                if ( NULL == (dirs = realloc(dirs, max_dirs *
+                                             sizeof(dir_meta))) )
+                    fatal_error(errno, "realloc");
+            }
+            if ( NULL == (dirs[num_dirs].path = strdup(path)) )
+                fatal_error(errno, "strdup");
+            dirs[num_dirs].mode     = ent->fts_statp->st_mode & 07777;
+            dirs[num_dirs].times[0] = ent->fts_statp->st_atim;
+            dirs[num_dirs].times[1] = ent->fts_statp->st_mtim;
+            num_dirs++;
+            break;
+        case FTS_F:
+            if ( !queue_file(&batch, ent->fts_path, path,
+                             ent->fts_statp->st_size,
+                             ent->fts_statp->st_mode,
+                             !opts->verify && !opts->delta) )
+                ok = FALSE;
+            break;
+        case FTS_SL:
+        case FTS_SLNONE:
+            if ( !copy_symlink(ent->fts_path, path) )
+                ok = FALSE;
+            break;
+        case FTS_DNR:
+        case FTS_ERR:
+        case FTS_NS:
+            error_mssge(ent->fts_errno, ent->fts_path);
+            ok = FALSE;
+            break;
+        default:
+            snprintf(message, MESSAGE_SIZE, "skipping %s", ent->fts_path);
+            error_mssge(-1, message);
+            break;
+        }
+        errno = 0;
+    }
+    if ( errno != 0 )
+        fatal_error(errno, "fts_read");
+    fts_close(tree);
+
+    /* Queue the last batch and let the workers finish. */
+    if ( batch != NULL )
+        queue_job(batch);
+    pthread_mutex_lock(&buf_mutex);
+    walk_done = TRUE;
+    pthread_cond_broadcast(&data_available);
+    pthread_mutex_unlock(&buf_mutex);
+    for ( int t = 0; t < opts->threads; t++ ) {
+        pthread_join(threads[t], NULL);
+        files += wdata[t].files;
+        bytes += wdata[t].bytes;
+        if ( wdata[t].failed )
+            ok = FALSE;
+    }
+
+    /* Now that the directories are complete, give them their metadata. */
+    for ( int i = 0; i < num_dirs; i++ ) {
+        if ( -1 == chmod(dirs[i].path, dirs[i].mode) ||
+             -1 == utimensat(AT_FDCWD, dirs[i].path, dirs[i].times, 0) ) {
+            snprintf(message, MESSAGE_SIZE, "unable to set attributes of %s",
+                     dirs[i].path);
+            error_mssge(errno, message);
+            ok = FALSE;
+        }
+        free(dirs[i].path);
+    }
+
+    if ( opts->verbose ) {
+        double secs = elapsed(start);
+        printf("%ld files, %d directories, %lld bytes of data in %.3f s",
+               files, num_dirs, (long long) bytes, secs);
+        if ( secs > 0 )
+            printf(" (%.1f MB/s)", bytes / MB / secs);
+        printf(" with %d threads\n", opts->threads);
+    }
+    free(dirs);
+    free(threads);
+    free(wdata);
+    return ok;
+}
+
+/* Stores in buf, of size PATH_MAX, a copy of path without the slashes at
+   its end, unless path is "/", and returns the last component of that. */
+char *last_component( const char *path, char *buf )
+{
+    size_t  len;
+
+    snprintf(buf, PATH_MAX, "%s", path);
+    len = strlen(buf);
+    while ( len > 1 && buf[len-1] == '/' )
+        buf[--len] = '\0';
+    return basename(buf);
+}
+
+int main(int argc, char *argv[])
+{
+    int           ch;
+    char          options[] = ":b:Cde:j:Prs:v";
+    struct option longopts[] = {
+        {"verify",   optional_argument, NULL, 'V'},
+        {"readback", no_argument,       NULL, 'R'},
+        {0,          0,                 0,    0  }
+    };
+    int           engine, sparse, sum_type;
+    copy_options  opts = { COPY_AUTO, 0, SPARSE_AUTO, FALSE, FALSE, FALSE,
+                           0, FALSE, FALSE, SUM_CRC32C, FALSE };
+    struct stat   sb;
+    char         *target;
+    char          target_path[PATH_MAX];
+    char          source_path[PATH_MAX];
+
+    opts.threads = 2 * sysconf(_SC_NPROCESSORS_ONLN);
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt_long(argc, argv, options, longopts, NULL);
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'b':
+            if ( VALID_NUMBER != get_long(optarg, POS_ONLY, &opts.bufsize,
+                                          NULL) )
+                usage_error("Invalid argument to -b");
+            break;
+        case 'C':
+            opts.compare = TRUE;
+            break;
+        case 'd':
+            opts.delta = TRUE;
+            break;
+        case 'e':
+            if ( -1 == (engine = parse_copy_engine(optarg)) )
+                usage_error(USAGE);
+            opts.engine = engine;
+            break;
+        case 'j':
+            if ( VALID_NUMBER != get_int(optarg, POS_ONLY, &opts.threads,
+                                         NULL) )
+                usage_error("Invalid argument to -j");
+            break;
+        case 'P':
+            set_mmap_populate(TRUE);
+            break;
+        case 'R':
+            opts.readback = opts.verify = TRUE;
+            break;
+        case 'r':
+            opts.recursive = TRUE;
+            break;
+        case 's':
+            if ( -1 == (sparse = parse_sparse_mode(optarg)) )
+                usage_error(USAGE);
+            opts.sparse = sparse;
+            break;
+        case 'V':
+            opts.verify = TRUE;
+            if ( optarg != NULL ) {
+                if ( -1 == (sum_type = parse_checksum(optarg)) )
+                    usage_error(USAGE);
+                opts.sum_type = sum_type;
+            }
+            break;
+        case 'v':
+            opts.verbose = TRUE;
+            break;
+        default:
+            usage_error(USAGE);
+        }
+    }
+    if ( argc - optind != 2 )
+        usage_error(USAGE);
+
+    if ( opts.compare ) {
+        compare_engines(argv[optind], argv[optind+1], &opts);
+        return 0;
+    }
+    if ( !opts.recursive ) {
+        if ( -1 == copy_file(argv[optind], argv[optind+1], &opts,
+                             opts.verbose) )
+            exit(EXIT_FAILURE);
+        return 0;
+    }
+
+    /* Like cp, copy into the target if it is an existing directory. */
+    target = argv[optind+1];
+    if ( 0 == stat(target, &sb) && S_ISDIR(sb.st_mode) ) {
+        snprintf(target_path, PATH_MAX, "%s/%s", target,
+                 last_component(argv[optind], source_path));
+        target = target_path;
+    }
+    return copy_tree(argv[optind], target, &opts) ? 0 : EXIT_FAILURE;
+}
@@ -4,9 +4,59 @@
   Created on     : August 4, 2023
   Description    : Modified version of copy.c with buffersize argument
   Purpose        : To test the effect of buffer size on performance
-  Usage          : spl_cp2 sourcefile targetfile buffersize
+  Usage          : spl_cp2 [-B] [-r MB/s] [-i iops] [-j threads] \
+                           [-d durability] sourcefile targetfile buffersize
   Build with     : gcc -Wall -g -I../include -L ../lib -lspl \
-                   -o spl_cp2  spl_cp2.c
+                   -o spl_cp2  spl_cp2.c -lm -pthread
+
+  Notes:
+  Without options, spl_cp2 copies as fast as it can, and in doing so fills
+  the page cache with the pages of both files, evicting those of other
+  programs, and leaves the writing of the target to the kernel, which
+  writes it in large bursts that delay other programs' I/O. The options
+  make it a better neighbor for a copy that runs in the background:
+
+  -r  Limits the rate to the given number of MB (2^20 bytes) per second.
+  -i  Limits the number of read() and write() calls per second.
+  -B  Runs in the idle I/O scheduling class, so that the copy's I/O is
+      done only when no other program wants the device (this has an effect
+      only with the BFQ scheduler), and writes the target behind the copy:
+      every 8 MB, writeback of the newest 8 MB is started with
+      sync_file_range(), the writeback of the 8 MB before it is waited
+      for, and the pages of that range of both files are dropped from the
+      page cache with posix_fadvise(POSIX_FADV_DONTNEED). At most 16 MB of
+      the target is ever dirty, and the copy leaves the cache as it was.
+
+  The limits are token buckets, which are filled at the given rate and
+  from which each read() and write() takes one token and each block its
+  size in bytes. A copy waits when a bucket is empty. A bucket holds at
+  most a tenth of a second's tokens, so after an idle period, the copy can
+  exceed the rate only briefly.
+
+  -j  Copies with the given number of threads. A single thread that reads
+      and then writes keeps only one request at a time in the device's
+      queue, which leaves most of the bandwidth of striped storage and of
+      NVMe devices, which have many queues, unused. With -j, the target is
+      first given its full size with fallocate(), and the file is divided
+      into chunks of 8 MB, each of which is copied by one thread with
+      pread() and pwrite() in blocks of buffersize bytes. A thread claims
+      the next chunk by incrementing a shared counter atomically, so the
+      threads that finish their chunks sooner do more of them. The source
+      must be a regular file.
+
+      The number of bytes copied is also a shared counter, incremented
+      atomically by each thread after each block without a lock, and read
+      twice a second by the main thread to show the progress of the copy
+      if the standard error is a terminal. The rate limits are shared by
+      all of the threads, and with -B, each thread writes back and drops
+      each chunk when it has copied it.
+
+  -d  Says how to make the target durable, so that a crash after spl_cp2
+      has finished does not lose it, and so that the time it reports is
+      not only the time to fill the page cache. It is one of none (the
+      default), fsync, fdatasync[:MB], dsync, or sync_range[:MB], which
+      are described in durability.h in libspl; the MB is how often to
+      sync (default 8). chapter04/sync_bench measures what each costs.
 
 ******************************************************************************
 * Copyright (C) 2025 - Stewart Weiss                                         *
@@ -21,10 +71,222 @@
 
 #define _GNU_SOURCE
 #include "common_hdrs.h"
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "durability.h"
+#include "time_utils.h"
 
 
 #define MESSAGE_SIZE   512
 #define PERMISSIONS    S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH  /*rw-rw-r-- */
+#define MB             1048576.0
+#define WRITE_BEHIND   (8*1024*1024)  /* Bytes written back at a time     */
+#define BURST_SECS     0.1            /* Seconds of tokens a bucket holds */
+#define CHUNK_SIZE     (8*1024*1024)  /* Unit of work of a thread with -j */
+#define PROGRESS_NSECS 500000000      /* Time between progress reports    */
+
+/* glibc has neither a wrapper for ioprio_set() nor its constants. */
+#define IOPRIO_WHO_PROCESS   1
+#define IOPRIO_CLASS_IDLE    3
+#define IOPRIO_CLASS_SHIFT   13
+
+#define USAGE "spl_cp2 [-B] [-r MB/s] [-i iops] [-j threads] " \
+              "[-d durability] source destination buffer-size\n" \
+              "durability: none, fsync, fdatasync[:MB], dsync, sync_range[:MB]"
+
+/* A token bucket: tokens are added at rate per second, up to capacity. */
+typedef struct
+{
+    double          rate;       /* Tokens per second, or 0 for no limit */
+    double          capacity;
+    double          tokens;
+    struct timespec last;       /* When tokens were last added          */
+    pthread_mutex_t lock;       /* For the threads of -j                */
+} token_bucket;
+
+/* What the threads of a parallel copy share. The two counters are only
+   changed with atomic operations.                                     */
+typedef struct
+{
+    int            source_fd;
+    int            target_fd;
+    off_t          size;         /* Size of the source                  */
+    long           bufsize;
+    BOOL           background;
+    long           next_chunk;   /* Index of the next chunk to copy     */
+    long long      copied;       /* Bytes copied so far                 */
+    token_bucket  *byte_bucket;
+    token_bucket  *op_bucket;
+    durability    *dur;
+    pthread_mutex_t dur_lock;    /* For calls to durable_wrote()        */
+} parallel_copy;
+
+/* What has been done to the pages of the files in background mode:
+   the pages below done have been written back and dropped, and the
+   writeback of those below started has been started.               */
+typedef struct
+{
+    off_t  done;
+    off_t  started;
+} write_behind_state;
+
+void bucket_init( token_bucket *b, double rate )
+{
+    b->rate     = rate;
+    b->capacity = rate * BURST_SECS;
+    b->tokens   = b->capacity;
+    clock_gettime(CLOCK_MONOTONIC, &b->last);
+    pthread_mutex_init(&b->lock, NULL);
+}
+
+/* Takes n tokens from bucket b, sleeping if it has fewer than that until
+   the missing ones would have been added.                               */
+void bucket_take( token_bucket *b, double n )
+{
+    struct timespec now, diff, pause;
+    double secs, debt;
+
+    if ( b->rate == 0 )
+        return;
+    pthread_mutex_lock(&b->lock);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timespec_diff(now, b->last, &diff);
+    timespec_to_dbl(diff, &secs);
+    b->last   = now;
+    b->tokens += secs * b->rate;
+    if ( b->tokens > b->capacity )
+        b->tokens = b->capacity;
+    b->tokens -= n;
+    debt = -b->tokens;
+    pthread_mutex_unlock(&b->lock);
+    if ( debt > 0 ) {
+        /* The debt is paid by the time that passes while asleep. */
+        dbl_to_timespec(debt / b->rate, &pause);
+        while ( -1 == nanosleep(&pause, &pause) && errno == EINTR )
+            ;
+    }
+}
+
+/* Starts the writeback of the target below end, waits for the writeback
+   started by the previous call, and drops the pages of that range of
+   both files from the page cache.                                      */
+void write_behind( int source_fd, int target_fd, write_behind_state *w,
+                   off_t end )
+{
+    if ( end > w->started &&
+         -1 == sync_file_range(target_fd, w->started, end - w->started,
+                               SYNC_FILE_RANGE_WRITE) )
+        fatal_error(errno, "sync_file_range");
+    if ( w->started > w->done ) {
+        if ( -1 == sync_file_range(target_fd, w->done, w->started - w->done,
+                                   SYNC_FILE_RANGE_WAIT_BEFORE |
+                                   SYNC_FILE_RANGE_WRITE |
+                                   SYNC_FILE_RANGE_WAIT_AFTER) )
+            fatal_error(errno, "sync_file_range");
+        posix_fadvise(target_fd, w->done, w->started - w->done,
+                      POSIX_FADV_DONTNEED);
+        posix_fadvise(source_fd, w->done, w->started - w->done,
+                      POSIX_FADV_DONTNEED);
+    }
+    w->done    = w->started;
+    w->started = end;
+}
+
+/* Thread start function for -j. Copies chunks of the file with pread()
+   and pwrite() until there are none left.                            */
+void *copy_chunks( void *data )
+{
+    parallel_copy *pc = (parallel_copy*) data;
+    char    *buf;
+    off_t    start, end, pos;
+    ssize_t  n, written;
+
+    if ( NULL == (buf = malloc(pc->bufsize)) )
+        fatal_error(errno, "malloc");
+    while ( TRUE ) {
+        start = (off_t) __atomic_fetch_add(&pc->next_chunk, 1,
+                                           __ATOMIC_RELAXED) * CHUNK_SIZE;
+        if ( start >= pc->size )
+            break;
+        end = ( pc->size - start < CHUNK_SIZE ) ? pc->size :
+                                                  start + CHUNK_SIZE;
+        for ( pos = start; pos < end; pos += n ) {
+            bucket_take(pc->op_bucket, 1);
+            n = ( end - pos < pc->bufsize ) ? end - pos : pc->bufsize;
+            if ( -1 == (n = pread(pc->source_fd, buf, n, pos)) )
+                fatal_error(errno, "pread");
+            if ( n == 0 )
+                fatal_error(-1, "the source file became shorter");
+            bucket_take(pc->byte_bucket, n);
+            bucket_take(pc->op_bucket, 1);
+            for ( ssize_t done = 0; done < n; done += written )
+                if ( -1 == (written = pwrite(pc->target_fd, buf + done,
+                                             n - done, pos + done)) )
+                    fatal_error(errno, "pwrite");
+            pthread_mutex_lock(&pc->dur_lock);
+            if ( -1 == durable_wrote(pc->target_fd, pc->dur, pos, n) )
+                fatal_error(errno, "sync");
+            pthread_mutex_unlock(&pc->dur_lock);
+            __atomic_fetch_add(&pc->copied, n, __ATOMIC_RELAXED);
+        }
+        if ( pc->background ) {
+            if ( -1 == sync_file_range(pc->target_fd, start, end - start,
+                                       SYNC_FILE_RANGE_WAIT_BEFORE |
+                                       SYNC_FILE_RANGE_WRITE |
+                                       SYNC_FILE_RANGE_WAIT_AFTER) )
+                fatal_error(errno, "sync_file_range");
+            posix_fadvise(pc->target_fd, start, end - start,
+                          POSIX_FADV_DONTNEED);
+            posix_fadvise(pc->source_fd, start, end - start,
+                          POSIX_FADV_DONTNEED);
+        }
+    }
+    free(buf);
+    pthread_exit(NULL);
+}
+
+/* Copies the source to the target with nthreads threads, as described
+   by pc, showing the progress on the standard error if it is a
+   terminal.                                                          */
+void copy_parallel( parallel_copy *pc, int nthreads )
+{
+    pthread_t       *threads;
+    struct timespec  pause = { 0, PROGRESS_NSECS };
+    BOOL             show = isatty(STDERR_FILENO);
+    long long        copied;
+    int              retval;
+
+    /* Allocate all of the blocks now, so that the file is not fragmented
+       by the threads extending it in many places at once. Unlike
+       posix_fallocate(), fallocate() fails instead of writing zeros if the
+       file system cannot do this.                                       */
+    if ( pc->size > 0 && -1 == fallocate(pc->target_fd, 0, 0, pc->size) ) {
+        if ( errno != EOPNOTSUPP )
+            fatal_error(errno, "fallocate");
+        if ( -1 == ftruncate(pc->target_fd, pc->size) )
+            fatal_error(errno, "ftruncate");
+    }
+
+    if ( NULL == (threads = calloc(nthreads, sizeof(pthread_t))) )
+        fatal_error(errno, "calloc");
+    for ( int t = 0; t < nthreads; t++ )
+        if ( 0 != (retval = pthread_create(&threads[t], NULL, copy_chunks,
+                                           pc)) )
+            fatal_error(retval, "pthread_create");
+
+    while ( show && (copied = __atomic_load_n(&pc->copied, __ATOMIC_RELAXED))
+                    < pc->size ) {
+        fprintf(stderr, "\r%lld of %lld bytes (%.0f%%)", copied,
+                (long long) pc->size, 100.0 * copied / pc->size);
+        nanosleep(&pause, NULL);
+    }
+    for ( int t = 0; t < nthreads; t++ )
+        pthread_join(threads[t], NULL);
+    if ( show )
+        fprintf(stderr, "\r%lld of %lld bytes (100%%)\n",
+                (long long) pc->size, (long long) pc->size);
+    free(threads);
+}
 
 int main(int argc, char *argv[])
 {
@@ -37,13 +299,55 @@ int main(int argc, char *argv[])
     int     retval;
     long    bufsize;
     char    *buffer;
+    int     ch;
+    char    options[] = ":Bd:i:j:r:";
+    durability    dur;
+    int     nthreads = 1;               /* Threads of -j           */
+    struct stat   sb;
+    parallel_copy pc;
+    BOOL    background = FALSE;         /* Whether -B was given    */
+    double  mb_rate = 0;                /* Limit of -r, in MB/s    */
+    long    iops = 0;                   /* Limit of -i             */
+    token_bucket  byte_bucket, op_bucket;
+    write_behind_state  wb = { 0, 0 };
+    off_t   copied = 0;
 
-    /* Check for correct usage.                                             */
-    if ( argc != 4 ){
-        sprintf(message,"%s source destination buffer-size", basename(argv[0]));
-        usage_error(message);
+    durability_init(&dur, DURABLE_NONE, 0);
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt(argc, argv, options);
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'B':
+            background = TRUE;
+            break;
+        case 'd':
+            if ( -1 == parse_durability(optarg, &dur) )
+                usage_error(USAGE);
+            break;
+        case 'i':
+            if ( VALID_NUMBER != get_long(optarg, POS_ONLY, &iops, NULL) )
+                usage_error("Invalid argument to -i");
+            break;
+        case 'j':
+            if ( VALID_NUMBER != get_int(optarg, POS_ONLY, &nthreads, NULL) )
+                usage_error("Invalid argument to -j");
+            break;
+        case 'r':
+            if ( VALID_NUMBER != get_dbl(optarg, POS_ONLY, &mb_rate, NULL) )
+                usage_error("Invalid argument to -r");
+            break;
+        default:
+            usage_error(USAGE);
+        }
     }
 
+    /* Check for correct usage.                                             */
+    if ( argc - optind != 3 )
+        usage_error(USAGE);
+    argv += optind - 1;  /* So that argv[1] is the source, as before. */
+
     /* Open source file for reading.                                        */
     errno = 0;
     if ( (source_fd = open(argv[1], O_RDONLY)) == -1 ) {
@@ -53,8 +357,8 @@ int main(int argc, char *argv[])
 
     /* Open target file for writing.                                        */
     errno = 0;
-    if ( (target_fd = open( argv[2], O_WRONLY|O_CREAT|O_TRUNC,
-                            permissions) ) == -1 ) {
+    if ( (target_fd = open( argv[2], O_WRONLY|O_CREAT|O_TRUNC|
+                            durable_open_flags(&dur), permissions) ) == -1 ) {
         sprintf(message, "unable to open %s for writing", argv[2]);
         fatal_error(errno, message);
     }
@@ -63,6 +367,48 @@ int main(int argc, char *argv[])
     if ( (retval = get_long(argv[3], NON_NEG_ONLY, &bufsize, message )) < 0)
         fatal_error(retval, message);
 
+    /* A block must fit in the byte bucket, or the rate would be exceeded. */
+    bucket_init(&byte_bucket, mb_rate * MB);
+    if ( byte_bucket.capacity > 0 && byte_bucket.capacity < bufsize )
+        byte_bucket.capacity = bufsize;
+    bucket_init(&op_bucket, iops);
+    if ( op_bucket.capacity > 0 && op_bucket.capacity < 2 )
+        op_bucket.capacity = 2;
+
+    if ( background ) {
+        if ( -1 == syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+                           IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) )
+            fatal_error(errno, "ioprio_set");
+        posix_fadvise(source_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    if ( nthreads > 1 ) {
+        if ( -1 == fstat(source_fd, &sb) )
+            fatal_error(errno, "fstat");
+        if ( !S_ISREG(sb.st_mode) )
+            fatal_error(-1, "with -j, the source must be a regular file");
+        if ( bufsize == 0 )
+            usage_error("with -j, the buffer size must be positive");
+        pc.source_fd   = source_fd;
+        pc.target_fd   = target_fd;
+        pc.size        = sb.st_size;
+        pc.bufsize     = bufsize;
+        pc.background  = background;
+        pc.next_chunk  = 0;
+        pc.copied      = 0;
+        pc.byte_bucket = &byte_bucket;
+        pc.op_bucket   = &op_bucket;
+        pc.dur         = &dur;
+        pthread_mutex_init(&pc.dur_lock, NULL);
+        copy_parallel(&pc, nthreads);
+        if ( -1 == durable_finish(target_fd, &dur) )
+            fatal_error(errno, "sync");
+        close(source_fd);
+        if ( close(target_fd) == -1 )
+            fatal_error(errno, "error closing target file");
+        return 0;
+    }
+
     buffer = malloc((size_t) bufsize);
     if ( buffer == NULL )
         fatal_error(errno, "malloc");
@@ -70,7 +416,10 @@ int main(int argc, char *argv[])
     /* Start copying:
        Transfer BUFFER_SIZE bytes at a time from source_fd to target_fd.    */
       errno = 0;
+      bucket_take(&op_bucket, 1);
       while ( (num_bytes_read = read(source_fd , buffer, bufsize)) > 0 ){
+          bucket_take(&byte_bucket, num_bytes_read);
+          bucket_take(&op_bucket, 1);
           errno = 0;
           num_bytes_written = write( target_fd, buffer, num_bytes_read ) ;
           if ( errno != 0 )
@@ -80,10 +429,23 @@ int main(int argc, char *argv[])
                   sprintf(message,"write error to %s\n", argv[2]);
                   fatal_error(-1, message);
               }
+          if ( -1 == durable_wrote(target_fd, &dur, copied,
+                                   num_bytes_written) )
+              fatal_error(errno, "sync");
+          copied += num_bytes_written;
+          if ( background && copied - wb.started >= WRITE_BEHIND )
+              write_behind(source_fd, target_fd, &wb, copied);
+          bucket_take(&op_bucket, 1);
           errno = 0;
       }
       if (num_bytes_read == -1)
           fatal_error(errno, "error reading");
+      if ( background ) {                /* Write back and drop the rest. */
+          write_behind(source_fd, target_fd, &wb, copied);
+          write_behind(source_fd, target_fd, &wb, copied);
+      }
+      if ( -1 == durable_finish(target_fd, &dur) )
+          fatal_error(errno, "sync");
 
       /* Close files.                                                       */
       if ( close(source_fd) == -1 ) {
@@ -0,0 +1,202 @@
+/*****************************************************************************
+  Title          : sync_bench.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Measures the cost of each way of making writes durable
+  Purpose        : To choose the cheapest durability that is good enough
+  Usage          : sync_bench [-b blocksize] [-i MB] [-s MB] [-o csvfile] \
+                              file
+  Build with     : gcc -Wall -g -I../include -L ../lib -o sync_bench \
+                   sync_bench.c -lspl -lm
+
+  Notes:
+  sync_bench writes a file of the given size (-s, default 256 MB) in
+  blocks of blocksize bytes (-b, default 64 KB) once with each of the
+  durability modes of libspl (see durability.h): none, fsync, fdatasync
+  every MB megabytes (-i, default 8), dsync, and sync_range every MB
+  megabytes. It prints a table of the throughput of each mode, in MB/s
+  (2^20 bytes per second), and of the latency of the writes: the median,
+  the 99th and 99.9th percentiles, and the maximum, in microseconds.
+
+  The latency of a write includes any sync that it caused, and the final
+  sync is counted as one more write, so a mode that saves its syncs for
+  the end shows a large maximum. The throughput includes the final sync,
+  so that it is the rate at which data becomes durable, except for mode
+  none, whose rate is the rate of filling the page cache.
+
+  The file must be on the file system to be measured, and is removed when
+  the program ends. With -o, the table is also written to csvfile in CSV
+  form.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.gplv3 for details.                *
+*****************************************************************************/
+
+#define _GNU_SOURCE
+#include "common_hdrs.h"
+#include "durability.h"
+#include "time_utils.h"
+
+#define MESSAGE_SIZE   512
+#define MB             1048576.0
+#define DEFAULT_BLOCK  (64*1024)
+#define DEFAULT_SIZE   256          /* MB written with each mode */
+
+#define USAGE "sync_bench [-b blocksize] [-i MB] [-s MB] [-o csvfile] file"
+
+/* The measurements of one mode. */
+typedef struct
+{
+    double  rate;       /* MB/s                  */
+    double  p50;        /* Latencies, in seconds */
+    double  p99;
+    double  p999;
+    double  max;
+} bench_result;
+
+int dblcmp( const void *a, const void *b )
+{
+    double x = *(const double*) a, y = *(const double*) b;
+    return ( x > y ) - ( x < y );
+}
+
+/* Returns the p-th percentile of the n sorted values in v. */
+double percentile( double *v, long n, double p )
+{
+    long i = (long) (p / 100 * n);
+    return v[i < n ? i : n - 1];
+}
+
+/* Writes size bytes to file in blocks of blocksize bytes with the
+   durability d, and stores the measurements in r.                  */
+void run_mode( const char *file, durability *d, long blocksize,
+               long long size, bench_result *r )
+{
+    int     fd;
+    char   *buf;
+    long    nblocks = (size + blocksize - 1) / blocksize;
+    double *lat;
+    long    n = 0;
+    off_t   offset = 0;
+    size_t  len;
+    char    message[MESSAGE_SIZE];
+    struct timespec start, t;
+
+    if ( -1 == (fd = open(file, O_WRONLY|O_CREAT|O_TRUNC|
+                          durable_open_flags(d), 0644)) ) {
+        snprintf(message, MESSAGE_SIZE, "unable to open %s for writing",
+                 file);
+        fatal_error(errno, message);
+    }
+    buf = malloc(blocksize);
+    lat = calloc(nblocks + 1, sizeof(double));
+    if ( buf == NULL || lat == NULL )
+        fatal_error(errno, "malloc");
+    memset(buf, 'x', blocksize);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ( offset < size ) {
+        len = ( size - offset < blocksize ) ? size - offset : blocksize;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        if ( len != write(fd, buf, len) )
+            fatal_error(errno, "write");
+        if ( -1 == durable_wrote(fd, d, offset, len) )
+            fatal_error(errno, "sync");
+        lat[n++] = elapsed(t);
+        offset += len;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    if ( -1 == durable_finish(fd, d) )
+        fatal_error(errno, "sync");
+    lat[n++] = elapsed(t);
+    r->rate = size / MB / elapsed(start);
+
+    qsort(lat, n, sizeof(double), dblcmp);
+    r->p50  = percentile(lat, n, 50);
+    r->p99  = percentile(lat, n, 99);
+    r->p999 = percentile(lat, n, 99.9);
+    r->max  = lat[n-1];
+    close(fd);
+    free(buf);
+    free(lat);
+}
+
+int main(int argc, char *argv[])
+{
+    int          ch;
+    char         options[] = ":b:i:o:s:";
+    long         blocksize = DEFAULT_BLOCK;
+    long         interval = DEFAULT_SYNC_INTERVAL / (1024*1024);
+    long         size_mb = DEFAULT_SIZE;
+    char        *csvname = NULL;
+    FILE        *csv = NULL;
+    char         name[32];
+    durability   d;
+    bench_result r;
+
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt(argc, argv, options);
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'b':
+            if ( VALID_NUMBER != get_long(optarg, POS_ONLY, &blocksize, NULL) )
+                usage_error("Invalid argument to -b");
+            break;
+        case 'i':
+            if ( VALID_NUMBER != get_long(optarg, POS_ONLY, &interval, NULL) )
+                usage_error("Invalid argument to -i");
+            break;
+        case 'o':
+            csvname = optarg;
+            break;
+        case 's':
+            if ( VALID_NUMBER != get_long(optarg, POS_ONLY, &size_mb, NULL) )
+                usage_error("Invalid argument to -s");
+            break;
+        default:
+            usage_error(USAGE);
+        }
+    }
+    if ( argc - optind != 1 )
+        usage_error(USAGE);
+
+    if ( csvname != NULL ) {
+        if ( NULL == (csv = fopen(csvname, "w")) )
+            fatal_error(errno, csvname);
+        fprintf(csv, "mode,mb_per_sec,p50_usecs,p99_usecs,p999_usecs,"
+                "max_usecs\n");
+    }
+
+    printf("%ld MB in blocks of %ld bytes to %s\n", size_mb, blocksize,
+           argv[optind]);
+    printf("%-16s %10s %10s %10s %10s %12s\n", "mode", "MB/s", "p50 us",
+           "p99 us", "p99.9 us", "max us");
+    for ( int mode = DURABLE_NONE; mode < NUM_DURABLE_MODES; mode++ ) {
+        durability_init(&d, mode, interval * 1024 * 1024);
+        if ( mode == DURABLE_FDATASYNC || mode == DURABLE_SYNC_RANGE )
+            snprintf(name, sizeof(name), "%s:%ld", durability_name(mode),
+                     interval);
+        else
+            snprintf(name, sizeof(name), "%s", durability_name(mode));
+        run_mode(argv[optind], &d, blocksize, size_mb * 1024LL * 1024, &r);
+        printf("%-16s %10.1f %10.1f %10.1f %10.1f %12.1f\n", name, r.rate,
+               r.p50 * 1e6, r.p99 * 1e6, r.p999 * 1e6, r.max * 1e6);
+        if ( csv != NULL )
+            fprintf(csv, "%s,%.3f,%.3f,%.3f,%.3f,%.3f\n", name, r.rate,
+                    r.p50 * 1e6, r.p99 * 1e6, r.p999 * 1e6, r.max * 1e6);
+        fflush(stdout);
+    }
+    unlink(argv[optind]);
+    if ( csv != NULL )
+        fclose(csv);
+    return 0;
+}
@@ -5,14 +5,43 @@
   Description    : Makes a file with a large hole
   Purpose        : Shows how lseek() can seek past end of file and we
                    can write past the end also.
-  Usage          : makelargefile file size
+  Usage          : makelargefile [-a alloc] [-w seq|random] [-b blocksize]
+                                 [-d durability] file size
   Build with     : gcc -I../include -L../lib -o makelargefile \
-                      makelargefile.c  -lspl
+                      makelargefile.c  -lspl -lm
   Note:
   After creating the file check its size and block usage with
   ls -ls file_with_hole
   You will see that it is 131082 bytes but does not use more than a few blocks.
 
+  -d says how to make the file durable: none (the default), fsync,
+  fdatasync[:MB], dsync, or sync_range[:MB], as described in durability.h.
+
+  A file with a hole gets its blocks only when the hole is filled, a few
+  at a time, wherever the file system has free space then, so it may end
+  up in many pieces (extents). -a says how to give the file its size
+  before the strings are written:
+
+     hole             seek past the end, as above (the default)
+     fallocate        fallocate(), which allocates the blocks and sets the
+                      size; the blocks are marked unwritten, so they read
+                      as zeros without having been written
+     keep_size        fallocate(FALLOC_FL_KEEP_SIZE), which allocates the
+                      blocks but leaves the size as it is, as for a log
+                      file that is appended to
+     posix_fallocate  posix_fallocate(), which is fallocate() where the
+                      file system supports it and otherwise writes zeros
+     ftruncate        ftruncate(), which sets the size without allocating,
+                      making one hole of the whole file
+
+  With -w, the whole file is then written, in blocks of blocksize bytes
+  (-b, default 64 KB), in order (seq) or in a random order (random), and
+  the throughput is printed, in MB/s (2^20 bytes per second). It includes
+  a final fdatasync(), because the file system may not choose the blocks
+  until it writes them. The number of extents of the file, found with the
+  FIEMAP ioctl(), is printed after the allocation and after the writes,
+  with how many of them are still unwritten.
+
 
 ******************************************************************************
 * Copyright (C) 2025 - Stewart Weiss                                         *
@@ -26,9 +55,152 @@
 *****************************************************************************/
 #define _GNU_SOURCE
 #include "common_hdrs.h"
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#include "durability.h"
+#include "time_utils.h"
 
 #define MESSAGE_SIZE   512
 #define BUFFER_SIZE     10
+#define DEFAULT_BLOCK  (64*1024)
+#define MB             1048576.0
+#define FIEMAP_BATCH   256          /* Extents fetched per ioctl() */
+#define USAGE "makelargefile [-a alloc] [-w seq|random] [-b blocksize] " \
+              "[-d durability] file-to-create size\n" \
+              "alloc:      hole, fallocate, keep_size, posix_fallocate, " \
+              "ftruncate\n" \
+              "durability: none, fsync, fdatasync[:MB], dsync, sync_range[:MB]"
+
+/* The ways of giving the file its size */
+typedef enum
+{
+    ALLOC_HOLE, ALLOC_FALLOCATE, ALLOC_KEEP_SIZE, ALLOC_POSIX, ALLOC_TRUNCATE,
+    NUM_ALLOC_MODES
+} alloc_mode;
+
+const char *alloc_names[NUM_ALLOC_MODES] = {
+    "hole", "fallocate", "keep_size", "posix_fallocate", "ftruncate"
+};
+
+/* Prints the number of extents of fd, and how many are unwritten, after
+   writing back its dirty pages so that their blocks are allocated.     */
+void print_extents( int fd, const char *when )
+{
+    struct fiemap *fm;
+    long    extents = 0, unwritten = 0;
+    BOOL    last = FALSE;
+
+    fm = calloc(1, sizeof(struct fiemap) +
+                FIEMAP_BATCH * sizeof(struct fiemap_extent));
+    if ( fm == NULL )
+        fatal_error(errno, "calloc");
+    fm->fm_start = 0;
+    while ( !last ) {
+        fm->fm_length       = FIEMAP_MAX_OFFSET - fm->fm_start;
+        fm->fm_flags        = FIEMAP_FLAG_SYNC;
+        fm->fm_extent_count = FIEMAP_BATCH;
+        if ( -1 == ioctl(fd, FS_IOC_FIEMAP, fm) ) {
+            if ( errno == EOPNOTSUPP ) {
+                printf("%s: the file system does not support FIEMAP\n", when);
+                free(fm);
+                return;
+            }
+            fatal_error(errno, "ioctl(FS_IOC_FIEMAP)");
+        }
+        if ( fm->fm_mapped_extents == 0 )
+            break;
+        for ( unsigned i = 0; i < fm->fm_mapped_extents; i++ ) {
+            struct fiemap_extent *e = &fm->fm_extents[i];
+            extents++;
+            if ( e->fe_flags & FIEMAP_EXTENT_UNWRITTEN )
+                unwritten++;
+            if ( e->fe_flags & FIEMAP_EXTENT_LAST )
+                last = TRUE;
+            fm->fm_start = e->fe_logical + e->fe_length;
+        }
+    }
+    printf("%s: %ld extents, %ld unwritten\n", when, extents, unwritten);
+    free(fm);
+}
+
+/* Gives the file fd its size as mode says. */
+void allocate( int fd, alloc_mode mode, long size )
+{
+    int retval;
+
+    switch ( mode ) {
+    case ALLOC_FALLOCATE:
+        if ( -1 == fallocate(fd, 0, 0, size) )
+            fatal_error(errno, "fallocate");
+        break;
+    case ALLOC_KEEP_SIZE:
+        if ( -1 == fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size) )
+            fatal_error(errno, "fallocate");
+        break;
+    case ALLOC_POSIX:
+        if ( 0 != (retval = posix_fallocate(fd, 0, size)) )
+            fatal_error(retval, "posix_fallocate");
+        break;
+    case ALLOC_TRUNCATE:
+        if ( -1 == ftruncate(fd, size) )
+            fatal_error(errno, "ftruncate");
+        break;
+    default:
+        break;
+    }
+}
+
+/* Writes the whole file in blocks of blocksize bytes, in order or in a
+   random order, and prints the throughput.                            */
+void write_file( int fd, long size, long blocksize, BOOL random_order,
+                 durability *dur )
+{
+    long    nblocks = (size + blocksize - 1) / blocksize;
+    long   *order, tmp, j;
+    char   *buf;
+    off_t   offset;
+    size_t  len;
+    double  secs;
+    struct timespec start;
+
+    order = malloc(nblocks * sizeof(long));
+    buf   = malloc(blocksize);
+    if ( order == NULL || buf == NULL )
+        fatal_error(errno, "malloc");
+    memset(buf, 'x', blocksize);
+    for ( long i = 0; i < nblocks; i++ )
+        order[i] = i;
+    if ( random_order ) {          /* Fisher-Yates shuffle */
+        srandom(time(NULL));
+        for ( long i = nblocks - 1; i > 0; i-- ) {
+            j = random() % (i + 1);
+            tmp = order[i];
+            order[i] = order[j];
+            order[j] = tmp;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for ( long i = 0; i < nblocks; i++ ) {
+        offset = order[i] * blocksize;
+        len    = ( size - offset < blocksize ) ? size - offset : blocksize;
+        if ( len != pwrite(fd, buf, len, offset) )
+            fatal_error(errno, "pwrite");
+        if ( -1 == durable_wrote(fd, dur, offset, len) )
+            fatal_error(errno, "sync");
+    }
+    if ( -1 == fdatasync(fd) )
+        fatal_error(errno, "fdatasync");
+    secs = elapsed(start);
+    printf("%s writes: %ld bytes in %.3f s", random_order ? "random" :
+           "sequential", size, secs);
+    if ( secs > 0 )
+        printf(" (%.1f MB/s)", size / MB / secs);
+    printf("\n");
+    free(order);
+    free(buf);
+}
 
 
 int main(int argc, char *argv[])
@@ -38,26 +210,78 @@ int main(int argc, char *argv[])
     char    message[MESSAGE_SIZE];
     int     errcode;
     long    size;
+    int     ch;
+    durability  dur;
+    alloc_mode  alloc = ALLOC_HOLE;
+    BOOL    write_all = FALSE;          /* Whether -w was given     */
+    BOOL    random_order = FALSE;
+    long    blocksize = DEFAULT_BLOCK;
+    int     i;
+    double  secs;
+    struct timespec start;
 
-    if ( argc < 3 )
-        usage_error("usage: this  file-to-create  size\n");
+    durability_init(&dur, DURABLE_NONE, 0);
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt(argc, argv, ":a:b:d:w:");
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'a':
+            for ( i = 0; i < NUM_ALLOC_MODES; i++ )
+                if ( 0 == strcmp(optarg, alloc_names[i]) )
+                    break;
+            if ( i == NUM_ALLOC_MODES )
+                usage_error(USAGE);
+            alloc = i;
+            break;
+        case 'b':
+            if ( VALID_NUMBER != get_long(optarg, POS_ONLY, &blocksize, NULL) )
+                usage_error("Invalid argument to -b");
+            break;
+        case 'd':
+            if ( -1 == parse_durability(optarg, &dur) )
+                usage_error(USAGE);
+            break;
+        case 'w':
+            write_all = TRUE;
+            if ( 0 == strcmp(optarg, "random") )
+                random_order = TRUE;
+            else if ( 0 != strcmp(optarg, "seq") )
+                usage_error(USAGE);
+            break;
+        default:
+            usage_error(USAGE);
+        }
+    }
+    if ( argc - optind < 2 )
+        usage_error(USAGE);
+    argv += optind - 1;  /* So that argv[1] is the file, as before. */
 
     if ( VALID_NUMBER != ( errcode = get_long(argv[2],
                       NON_NEG_ONLY, &size, message ) ) )
         fatal_error( errcode, "get_long");
 
     /* Create a new file named file_with_hole in the pwd. */
-    if ((fd = open(argv[1], O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0) {
+    if ((fd = open(argv[1], O_WRONLY|O_CREAT|O_TRUNC|durable_open_flags(&dur),
+                   0644)) < 0) {
         sprintf(message, "Unable to open file %s for writing", argv[1]);
         fatal_error(errno, message);
     }
 
+    /* Give the file its size as -a says. */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    allocate(fd, alloc, size);
+    secs = elapsed(start);
+
     /* Fill buffer with a small string. */
     strncpy(buffer, "start", strlen("start")+1);
 
     /* Write the small string at the beginning of the file. */
     if (write(fd, buffer, strlen(buffer)) != strlen(buffer))
         fatal_error(errno, "write");
+    if (durable_wrote(fd, &dur, 0, strlen(buffer)) == -1)
+        fatal_error(errno, "sync");
 
     /* Seek size-5 bytes past the start of the file. */
     if (lseek(fd, size - strlen("start") , SEEK_SET) == -1)
@@ -66,6 +290,21 @@ int main(int argc, char *argv[])
     /* Write the small string at the new file offset. */
     if (write(fd, buffer, strlen(buffer)) != strlen(buffer))
         fatal_error(errno, "write");
+    if (durable_wrote(fd, &dur, size - strlen("start"), strlen(buffer)) == -1)
+        fatal_error(errno, "sync");
+
+    if ( alloc != ALLOC_HOLE || write_all ) {
+        printf("%s: %ld bytes in %.6f s\n", alloc_names[alloc], size, secs);
+        print_extents(fd, "after allocation");
+    }
+    if ( write_all ) {
+        write_file(fd, size, blocksize, random_order, &dur);
+        print_extents(fd, "after writing");
+    }
+
+    /* Make the file durable as -d says. */
+    if (durable_finish(fd, &dur) == -1)
+        fatal_error(errno, "sync");
 
     /* Close the file. */
     if ( close(fd) == -1 ) {
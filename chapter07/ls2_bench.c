@@ -0,0 +1,231 @@
+/*****************************************************************************
+  Title          : ls2_bench.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Compares two ways of listing directories before files
+  Purpose        : To show the cost of seekdir() on a large directory
+  Usage          : ls2_bench [-n count] dir
+  Build with     : gcc -Wall -g -I../include -L ../lib -o ls2_bench \
+                   ls2_bench.c -lspl
+
+  Notes:
+  ls2_bench lists dir with its subdirectories first, as spl_ls2 does, in
+  each of two ways, and prints the time each took and the memory each
+  used to hold the entries it saved for later. The names are not printed,
+  but a hash of the listing is, to show that both produce the same one.
+
+  replay is the way spl_ls2 used to work: it reads the directory once,
+  printing the subdirectories and saving a telldir() position for every
+  other entry in a list of nodes allocated one at a time with malloc(),
+  and then returns to each saved position with seekdir() to read the
+  entry again. single is the way it works now: it reads the directory
+  once, saving the names of the other entries in a name_list (see
+  dir_stream.h), which packs them into one buffer.
+
+  On most file systems a seekdir() discards what readdir() had buffered,
+  so every entry revisited costs a getdents() call that refills the
+  buffer. With -n, replay stops after revisiting count entries, and the
+  time to revisit all of them is estimated from the time for those; its
+  hash is then not comparable.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.gplv3 for details.                *
+*****************************************************************************/
+
+#define _GNU_SOURCE
+#include "common_hdrs.h"
+#include <dirent.h>
+#include <malloc.h>
+#include <stdint.h>
+#include "dir_stream.h"
+
+#define USAGE  "ls2_bench [-n count] dir"
+
+/* A saved position, as spl_ls2 used to keep them */
+typedef struct posnode
+{
+    long             pos;
+    struct posnode  *next;
+} posnode;
+
+/* The result of one way of listing */
+typedef struct
+{
+    double    secs;
+    double    pass_secs;   /* Of the first pass alone      */
+    size_t    saved;       /* Entries saved for later      */
+    size_t    revisited;   /* Of those, entries read again */
+    size_t    bytes;       /* Memory holding the saved ones */
+    uint64_t  hash;        /* Of the listing               */
+} result;
+
+/* Returns the time in seconds on the monotonic clock. */
+double now( void )
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Adds the line for name, with a '/' if is_dir is TRUE, to the FNV-1a
+   hash h, in place of printing it.                                   */
+uint64_t add_line( uint64_t h, const char *name, BOOL is_dir )
+{
+    while ( *name != '\0' )
+        h = (h ^ (unsigned char) *name++) * 0x100000001b3ULL;
+    if ( is_dir )
+        h = (h ^ '/') * 0x100000001b3ULL;
+    return (h ^ '\n') * 0x100000001b3ULL;
+}
+
+DIR *open_dir( const char *path )
+{
+    DIR *dirp;
+
+    errno = 0;
+    if ( NULL == (dirp = opendir(path)) )
+        fatal_error(errno, path);
+    return dirp;
+}
+
+/* Lists path by saving telldir() positions and going back to them,
+   stopping after revisiting limit entries if limit is not 0.          */
+void replay( const char *path, size_t limit, result *r )
+{
+    DIR            *dirp = open_dir(path);
+    struct dirent  *entry;
+    posnode        *head = NULL, *last = NULL, *node, *next;
+    long            pos;
+    double          start = now();
+
+    memset(r, 0, sizeof(result));
+    r->hash = 0xcbf29ce484222325ULL;
+    while ( TRUE ) {
+        pos = telldir(dirp);
+        errno = 0;
+        if ( NULL == (entry = readdir(dirp)) ) {
+            if ( errno != 0 )
+                fatal_error(errno, "readdir");
+            break;
+        }
+        if ( entry->d_type == DT_DIR ) {
+            r->hash = add_line(r->hash, entry->d_name, TRUE);
+            continue;
+        }
+        if ( NULL == (node = malloc(sizeof(posnode))) )
+            fatal_error(errno, "malloc");
+        node->pos  = pos;
+        node->next = NULL;
+        if ( head == NULL )
+            head = node;
+        else
+            last->next = node;
+        last = node;
+        r->saved++;
+        /* What malloc() really uses for a node, with its header. */
+        r->bytes += malloc_usable_size(node) + sizeof(size_t);
+    }
+    r->pass_secs = now() - start;
+    for ( node = head; node != NULL; node = node->next ) {
+        if ( limit > 0 && r->revisited == limit )
+            break;
+        seekdir(dirp, node->pos);
+        if ( NULL == (entry = readdir(dirp)) )
+            fatal_error(errno, "readdir after seekdir");
+        r->hash = add_line(r->hash, entry->d_name, FALSE);
+        r->revisited++;
+    }
+    r->secs = now() - start;
+    for ( node = head; node != NULL; node = next ) {
+        next = node->next;
+        free(node);
+    }
+    closedir(dirp);
+}
+
+/* Lists path in one pass, saving the names of files in a name_list. */
+void single( const char *path, result *r )
+{
+    DIR            *dirp = open_dir(path);
+    struct dirent  *entry;
+    name_list       rest;
+    double          start = now();
+
+    memset(r, 0, sizeof(result));
+    r->hash = 0xcbf29ce484222325ULL;
+    name_list_init(&rest);
+    while ( TRUE ) {
+        errno = 0;
+        if ( NULL == (entry = readdir(dirp)) ) {
+            if ( errno != 0 )
+                fatal_error(errno, "readdir");
+            break;
+        }
+        if ( entry->d_type == DT_DIR )
+            r->hash = add_line(r->hash, entry->d_name, TRUE);
+        else if ( -1 == name_list_add(&rest, entry->d_name, DT_UNKNOWN) )
+            fatal_error(errno, "name_list_add");
+    }
+    for ( size_t i = 0; i < rest.count; i++ )
+        r->hash = add_line(r->hash, NAME_LIST_NAME(&rest, i), FALSE);
+    r->secs      = r->pass_secs = now() - start;
+    r->saved     = r->revisited = rest.count;
+    r->bytes     = rest.size + rest.max * sizeof(size_t);
+    name_list_free(&rest);
+    closedir(dirp);
+}
+
+void print_result( const char *name, const result *r )
+{
+    double  total = r->secs;
+
+    if ( r->revisited < r->saved && r->revisited > 0 )
+        total = r->pass_secs +
+                (r->secs - r->pass_secs) * r->saved / r->revisited;
+    printf("%-8s %10zu %10zu %12.3f %12.3f %10.1f  %016jx\n", name,
+           r->saved, r->revisited, r->secs, total,
+           r->bytes / 1048576.0, (uintmax_t) r->hash);
+}
+
+int main( int argc, char *argv[] )
+{
+    int     ch;
+    long    limit = 0;
+    result  old_way, new_way;
+
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt(argc, argv, ":n:");
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'n':
+            if ( VALID_NUMBER != get_long(optarg, POS_ONLY, &limit, NULL) )
+                usage_error("Invalid argument to -n");
+            break;
+        default:
+            usage_error(USAGE);
+        }
+    }
+    if ( argc - optind != 1 )
+        usage_error(USAGE);
+
+    single(argv[optind], &new_way);
+    replay(argv[optind], limit, &old_way);
+    printf("%-8s %10s %10s %12s %12s %10s  %s\n", "method", "saved",
+           "reread", "seconds", "est. total", "MB held", "hash");
+    print_result("replay", &old_way);
+    print_result("single", &new_way);
+    if ( old_way.revisited == old_way.saved )
+        printf("The listings are %s.\n", old_way.hash == new_way.hash ?
+               "the same" : "different");
+    exit(EXIT_SUCCESS);
+}
@@ -3,16 +3,26 @@
   Author         : Stewart Weiss
   Created on     : November 1, 2023
   Description    : Directory hierarchy traversal
-  Purpose        : To show a simple application of the nftw function
-  Usage          : spl_du1  file file ...
+  Purpose        : To compare a tree walk by nftw() with one by statx()
+                   relative to the descriptor of each directory
+  Usage          : spl_du1  [-n | -j threads] file file ...
   Build with     : gcc -Wall -g -I ../include spl_du1.c -o spl_du1 \
-                   -L../lib -lspl
+                   -L../lib -lspl -pthread
   NOTES:
   This walks the directory tree for each file argument, displaying file name
   and type and accumulating total bytes in the tree.
   THIS COUNTS NAMES OF THE SAME FILE MULTIPLE TIMES. IT NEEDS TO DETECT
   WHEN A FILE HAS BEEN COUNTED ALREADY.
 
+  The tree is walked with nftw() only if -n is given. Otherwise it is
+  walked with du_walk() from libspl (see du_tree.h), which examines each
+  file with statx() relative to a descriptor of its directory instead of
+  by its full pathname, with one thread or, with -j, the given number of
+  threads, and is printed in the order in which nftw() visits it. Like
+  FTW_MOUNT, the flag DU_XDEV keeps the walk on the file system of the
+  argument. du_walk() leaves files with more than one link out of its
+  totals, so they are added back while printing.
+
 ******************************************************************************
 * Copyright (C) 2025 - Stewart Weiss                                         *
 *                                                                            *
@@ -28,8 +38,10 @@
 #include <ftw.h>
 #include <stdint.h>
 #include <limits.h>
+#include "du_tree.h"
 
 #define  MAXDEPTH  100
+#define  USAGE  "spl_du1 [-n | -j threads] file file ..."
 
 /*
   totalsize is an array with an entry for each level in the tree.
@@ -141,26 +153,129 @@ int file_usage(const char *fpath, const struct stat *sb,
 }
 
 
+/* Appends a slash and name to the path of length len in the buffer *path
+   of *size bytes, enlarging it if need be, and returns the length of the
+   new path.                                                            */
+size_t append_name( char **path, size_t *size, size_t len, const char *name )
+{
+    size_t  newlen = len + strlen(name) + 1;
+
+    if ( newlen + 1 > *size ) {
+        *size = 2 * newlen;
+        if ( NULL == (*path = realloc(*path, *size)) )
+            fatal_error(errno, "realloc");
+    }
+    (*path)[len] = '/';
+    strcpy(*path + len + 1, name);
+    return newlen;
+}
+
+/*
+   Prints the usage of everything below the node n, and then of n, in the
+   post-order in which nftw() visits the tree. The path of n is the first
+   len bytes of *path, a buffer of *size bytes that is enlarged as needed.
+   It returns the KB used by the files with more than one link at or below
+   n, which are not in the totals computed by du_walk().
+*/
+uintmax_t print_node( du_node *n, char **path, size_t *size, size_t len )
+{
+    uintmax_t  linked_usage = 0;
+    du_node   *child;
+
+    if ( n->kind == DU_MOUNT )      /* Not reported, as with FTW_MOUNT */
+        return 0;
+    if ( DU_IS_DIR(n) ) {
+        for ( child = ((du_dir*) n)->children; child != NULL;
+              child = child->next )
+            linked_usage += print_node(child, path, size,
+                                       append_name(path, size, len,
+                                                   child->name));
+        (*path)[len] = '\0';
+    }
+    else if ( n->linked )
+        linked_usage = n->usage;
+
+    printf("%ju\t%s", DU_IS_DIR(n) ? n->usage + linked_usage : n->usage,
+           *path);
+    if ( n->kind == DU_DNR )
+        printf(" (unreadable directory)");
+    else if ( n->kind == DU_SYMLINK )
+        printf(" (symbolic link)" );
+    else if ( n->kind == DU_NS )
+        printf("stat failed " );
+    printf("\n");
+    return linked_usage;
+}
+
+/* Walks the tree at fpath with num_threads threads and prints it. */
+void tree_usage( const char *fpath, int num_threads )
+{
+    du_tree  tree;
+    size_t   len = strlen(fpath);
+    size_t   size = len + 1;
+    char    *path;
+
+    if ( -1 == du_walk(fpath, num_threads, DU_XDEV, NULL, &tree) )
+        fatal_error(errno, fpath);
+    /* Like nftw(), drop the slashes at the end of the path, even "/". */
+    while ( len > 0 && fpath[len-1] == '/' )
+        len--;
+    if ( NULL == (path = malloc(size)) )
+        fatal_error(errno, "malloc");
+    memcpy(path, fpath, len);
+    path[len] = '\0';
+    print_node(tree.root, &path, &size, len);
+    free(path);
+    du_free(&tree);
+}
+
 int main(int argc, char *argv[])
 {
     int flags = FTW_DEPTH | FTW_PHYS | FTW_MOUNT;
     int status;
     int i = 1;
+    int  ch;
+    long num_threads = 1;         /* 0 means use nftw() */
+
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt(argc, argv, ":j:n");
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'j':
+            if ( VALID_NUMBER != get_long(optarg, POS_ONLY, &num_threads,
+                                          NULL) || num_threads == 0 )
+                usage_error("Invalid argument to -j");
+            break;
+        case 'n':
+            num_threads = 0;
+            break;
+        default:
+            usage_error(USAGE);
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
 
     if ( argc < 2 )  {
         memset( totalsize, 0, MAXDEPTH*sizeof(uintmax_t));
         prev_level = -1;
-        if ( 0 != (status = nftw(".", file_usage, 20, flags) ) )
+        if ( num_threads > 0 )
+            tree_usage(".", num_threads);
+        else if ( 0 != (status = nftw(".", file_usage, 20, flags) ) )
            fatal_error(status, "nftw");
     }
     else
         while (i < argc) {
             memset( totalsize, 0, MAXDEPTH*sizeof(uintmax_t));
             prev_level = -1;
-            if ( 0 != ( status = nftw(argv[i], file_usage, MAXDEPTH, flags)))
+            if ( num_threads > 0 )
+                tree_usage(argv[i], num_threads);
+            else if ( 0 != ( status = nftw(argv[i], file_usage, MAXDEPTH,
+                                           flags)))
                 fatal_error(status, "nftw");
-            else
-                i++;
+            i++;
         }
     exit(EXIT_SUCCESS);
 }
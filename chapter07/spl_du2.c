@@ -3,14 +3,45 @@
   Author         : Stewart Weiss
   Created on     : November 4, 2023
   Description    : Directory hierarchy traversal
-  Purpose        : To show a simple application of the nftw function
-  Usage          : spl_du2  file file ...
+  Purpose        : To compare a tree walk by nftw() with one by statx()
+                   relative to the descriptor of each directory
+  Usage          : spl_du2  [-n | -j threads] [-i indexfile] file file ...
+                   spl_du2  [-j threads] [-i indexfile] --watch[=secs] [dir]
   Build with     : gcc -Wall -g -I ../include spl_du2.c -o spl_du2 \
-                   -L../lib -lspl
+                   -L../lib -lspl -pthread
   NOTES:
   This walks the directory tree for each file argument, displaying file name
   and type and accumulating total bytes in the tree.
 
+  The tree is walked with nftw() only if -n is given. Otherwise it is
+  walked with du_walk() from libspl (see du_tree.h), which opens each
+  directory relative to its parent and examines each file with statx()
+  relative to its directory, instead of passing nftw()'s full pathnames to
+  lstat(), which makes the kernel look up every directory on the path
+  again for every file. With -j, du_walk() uses the given number of
+  threads. The tree is printed in the order in which nftw() would have
+  visited it, so the output is the same either way. du_walk() leaves files
+  with more than one link out of the totals, because the threads do not
+  reach their names in any fixed order; they are added while printing, to
+  the directories that contain the first of their names that nftw() would
+  visit.
+
+  With -i, du_walk() keeps the contents of the directories it reads in
+  indexfile (see du_index.h), and on later runs reads only the directories
+  whose modification or change time has moved since they were recorded,
+  taking the others from the file. The output is the same unless a file
+  was written to in place, which does not change the times of its
+  directory; in that case its old size is printed until the directory
+  itself changes.
+
+  With --watch (or -w), which takes a single directory, the tree is walked
+  and printed once, and then kept up to date by du_watch from libspl (see
+  du_watch.h), which subscribes to the kernel's events for the tree and
+  examines only the entries that they name. Every secs seconds (10 by
+  default), the directories whose totals have changed are printed, each
+  after those below it. If the kernel drops events, the tree is walked and
+  printed again.
+
 ******************************************************************************
 * Copyright (C) 2025 - Stewart Weiss                                         *
 *                                                                            *
@@ -24,12 +55,20 @@
 
 #include "common_hdrs.h"
 #include <ftw.h>
+#include <getopt.h>
+#include <poll.h>
 #include <stdint.h>
 #include <limits.h>
 #include "hash.h"
+#include "du_tree.h"
+#include "du_index.h"
+#include "du_watch.h"
 
 #define  MAXDEPTH  100
 #define  INITIAL_HASH_SIZE      1024
+#define  DEFAULT_INTERVAL       10
+#define  USAGE  "spl_du2 [-n | -j threads] [-i indexfile] file file ...\n" \
+    "       spl_du2 [-j threads] [-i indexfile] --watch[=secs] [dir]"
 
 
 
@@ -182,17 +221,231 @@ int file_usage(const char *fpath, const struct stat *sb,
 }
 
 
+/* Appends a slash and name to the path of length len in the buffer *path
+   of *size bytes, enlarging it if need be, and returns the length of the
+   new path.                                                            */
+size_t append_name( char **path, size_t *size, size_t len, const char *name )
+{
+    size_t  newlen = len + strlen(name) + 1;
+
+    if ( newlen + 1 > *size ) {
+        *size = 2 * newlen;
+        if ( NULL == (*path = realloc(*path, *size)) )
+            fatal_error(errno, "realloc");
+    }
+    (*path)[len] = '/';
+    strcpy(*path + len + 1, name);
+    return newlen;
+}
+
+/*
+   Prints the usage of everything below the node n, and then of n, whose
+   path is the first len bytes of *path, in the post-order in which
+   nftw() visits the tree. dev is the device of the directory containing n.
+   It returns the KB used by the files with more than one link that are
+   counted for the first time at or below n, which are not in the totals
+   computed by du_walk().
+*/
+uintmax_t print_node( du_node *n, dev_t dev, char **path, size_t *size,
+                      size_t len )
+{
+    uintmax_t  linked_usage = 0;
+    du_node   *child;
+
+    if ( DU_IS_DIR(n) ) {
+        for ( child = ((du_dir*) n)->children; child != NULL;
+              child = child->next )
+            linked_usage += print_node(child, ((du_dir*) n)->dev, path, size,
+                                       append_name(path, size, len,
+                                                   child->name));
+        (*path)[len] = '\0';
+    }
+    else if ( n->linked ) {
+        if ( was_visited(n->ino, dev) )
+            return 0;
+        if ( ! mark_visited(n->ino, dev) )
+            fatal_error(-1, "Could not insert inode into hash table");
+        linked_usage = n->usage;
+    }
+
+    printf("%ju\t%s", DU_IS_DIR(n) ? n->usage + linked_usage : n->usage,
+           *path);
+    if ( n->kind == DU_DNR )
+        printf(" (unreadable directory)");
+    else if ( n->kind == DU_SYMLINK )
+        printf(" (symbolic link)" );
+    else if ( n->kind == DU_NS )
+        printf("stat failed " );
+    printf("\n");
+    return linked_usage;
+}
+
+/* Walks the tree at fpath with num_threads threads into tree and prints
+   it. If idx is not NULL, the walk uses the index idx and then updates it. */
+void walk_tree( const char *fpath, int num_threads, du_index *idx,
+                du_tree *tree )
+{
+    size_t   len = strlen(fpath);
+    size_t   size = len + 1;
+    char    *path;
+    time_t   started = time(NULL);
+
+    if ( -1 == du_walk(fpath, num_threads, 0, idx, tree) )
+        fatal_error(errno, fpath);
+    if ( idx != NULL && -1 == du_index_save(idx, tree, started) )
+        error_mssge(errno, "could not update the index");
+    /* Like nftw(), drop the slashes at the end of the path, even "/". */
+    while ( len > 0 && fpath[len-1] == '/' )
+        len--;
+    if ( NULL == (path = malloc(size)) )
+        fatal_error(errno, "malloc");
+    memcpy(path, fpath, len);
+    path[len] = '\0';
+    print_node(tree->root, tree->dev, &path, &size, len);
+    free(path);
+}
+
+/* Walks the tree at fpath with num_threads threads and prints it. If idx
+   is not NULL, the walk uses the index idx and then updates it.        */
+void tree_usage( const char *fpath, int num_threads, du_index *idx )
+{
+    du_tree  tree;
+
+    walk_tree(fpath, num_threads, idx, &tree);
+    du_free(&tree);
+}
+
+/* Returns the milliseconds from now until the time t on the monotonic
+   clock, which are negative if t has passed.                          */
+long msecs_until( const struct timespec *t )
+{
+    struct timespec  now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (t->tv_sec - now.tv_sec) * 1000 +
+           (t->tv_nsec - now.tv_nsec) / 1000000;
+}
+
+/* Walks and prints the tree at fpath like tree_usage(), and then keeps its
+   totals up to date from the events that du_watch collects, printing the
+   directories whose totals have changed every interval seconds. If events
+   are lost, it starts again with a new walk. It never returns.       */
+void watch_usage( const char *fpath, int num_threads, du_index *idx,
+                  long interval )
+{
+    du_tree          tree;
+    du_watch        *w;
+    du_dir          *d;
+    const char      *path;
+    struct pollfd    pfd;
+    struct timespec  next;
+    long             timeout;
+    BOOL             lost;
+
+    while ( TRUE ) {
+        walk_tree(fpath, num_threads, idx, &tree);
+        fflush(stdout);
+        if ( NULL == (w = du_watch_start(&tree, 0)) )
+            fatal_error(errno, "could not watch the tree");
+        fprintf(stderr, "Watching %s with %s\n", fpath, du_watch_method(w));
+        pfd.fd     = du_watch_fd(w);
+        pfd.events = POLLIN;
+        clock_gettime(CLOCK_MONOTONIC, &next);
+        next.tv_sec += interval;
+        lost = FALSE;
+        while ( !lost ) {
+            timeout = msecs_until(&next);
+            if ( timeout > 0 && -1 == poll(&pfd, 1, timeout) &&
+                 errno != EINTR )
+                fatal_error(errno, "poll");
+            if ( -1 == du_watch_read(w) ) {
+                if ( errno != EOVERFLOW )
+                    fatal_error(errno, "could not read events");
+                error_mssge(-1, "events were lost; walking the tree again");
+                lost = TRUE;
+            }
+            else if ( msecs_until(&next) <= 0 ) {
+                if ( -1 == du_watch_update(w) )
+                    fatal_error(errno, "could not update the tree");
+                while ( NULL != (d = du_watch_next_changed(w)) )
+                    if ( NULL != (path = du_watch_path(w, d)) )
+                        printf("%ju\t%s\n", d->node.usage, path);
+                fflush(stdout);
+                next.tv_sec += interval;
+            }
+        }
+        du_watch_stop(w);
+        du_free(&tree);
+        free_hash(&visited);
+        init_hash(&visited, INITIAL_HASH_SIZE);
+    }
+}
+
 int main(int argc, char *argv[])
 {
     int flags = FTW_DEPTH | FTW_PHYS /*| FTW_MOUNT*/;
     int status;
     int i = 1;
+    int  ch;
+    long num_threads = 1;         /* 0 means use nftw() */
+    char *indexfile = NULL;
+    du_index *idx = NULL;
+    long interval = 0;            /* 0 means do not watch */
+    struct option longopts[] = {
+        {"watch", optional_argument, NULL, 'w'},
+        {0,       0,                 0,    0  }
+    };
 
-    if ( argc < 2 )  {
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt_long(argc, argv, ":i:j:nw::", longopts, NULL);
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'i':
+            indexfile = optarg;
+            break;
+        case 'j':
+            if ( VALID_NUMBER != get_long(optarg, POS_ONLY, &num_threads,
+                                          NULL) || num_threads == 0 )
+                usage_error("Invalid argument to -j");
+            break;
+        case 'n':
+            num_threads = 0;
+            break;
+        case 'w':
+            interval = DEFAULT_INTERVAL;
+            if ( optarg != NULL && ( VALID_NUMBER != get_long(optarg,
+                                     POS_ONLY, &interval, NULL) ||
+                                     interval == 0 ) )
+                usage_error("Invalid argument to --watch");
+            break;
+        default:
+            usage_error(USAGE);
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+    if ( interval > 0 && ( num_threads == 0 || argc > 2 ) )
+        usage_error(USAGE);
+    if ( indexfile != NULL ) {
+        if ( num_threads == 0 )
+            usage_error("-i cannot be used with -n");
+        if ( NULL == (idx = du_index_open(indexfile)) )
+            fatal_error(errno, indexfile);
+    }
+
+    if ( interval > 0 ) {
+        init_hash(&visited, INITIAL_HASH_SIZE);
+        watch_usage(argc < 2 ? "." : argv[1], num_threads, idx, interval);
+    }
+    else if ( argc < 2 )  {
         init_hash(&visited, INITIAL_HASH_SIZE);
         memset( total_usage, 0, MAXDEPTH*sizeof(uintmax_t));
         prev_level = -1;
-        if ( 0 != (status = nftw(".", file_usage, 20, flags) ) )
+        if ( num_threads > 0 )
+            tree_usage(".", num_threads, idx);
+        else if ( 0 != (status = nftw(".", file_usage, 20, flags) ) )
            fatal_error(status, "nftw");
         free_hash(&visited);
     }
@@ -201,12 +454,15 @@ int main(int argc, char *argv[])
             init_hash(&visited, INITIAL_HASH_SIZE);
             memset( total_usage, 0, MAXDEPTH*sizeof(uintmax_t));
             prev_level = -1;
-        if ( 0 != ( status = nftw(argv[i], file_usage, MAXDEPTH, flags)))
+            if ( num_threads > 0 )
+                tree_usage(argv[i], num_threads, idx);
+            else if ( 0 != ( status = nftw(argv[i], file_usage, MAXDEPTH,
+                                           flags)))
                 fatal_error(status, "nftw");
-            else {
-                i++;
-                free_hash(&visited);
-            }
+            i++;
+            free_hash(&visited);
         }
+    if ( idx != NULL )
+        du_index_close(idx);
     exit(EXIT_SUCCESS);
 }
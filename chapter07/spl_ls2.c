@@ -8,6 +8,15 @@
                    where files may be any file type including directories
   Build with     : gcc -Wall -g -I ../include spl_ls2.c -o spl_ls2 \
                    -L../lib -lspl
+  NOTES:
+  The directory is read once. Its subdirectories are printed as they are
+  read, and the names of its other entries are kept in a name_list from
+  libspl (see dir_stream.h), which packs them into one buffer, to be
+  printed at the end. An earlier version saved a telldir() position for
+  each of them in a list of malloc()ed nodes and went back to each with
+  seekdir(), but on most file systems every seekdir() makes the next
+  readdir() call getdents() again, so that a large directory was read
+  once for each of its files; ls2_bench measures the difference.
 
 ******************************************************************************
 * Copyright (C) 2025 - Stewart Weiss                                         *
@@ -24,6 +33,7 @@
 #define _BSD_SOURCE
 #include "common_hdrs.h"
 #include <dirent.h>
+#include "dir_stream.h"
 
 #define  LIST_DIRS_FIRST  1
 
@@ -44,69 +54,18 @@ BOOL isdir( const struct dirent *direntp)
         return FALSE;
 }
 
-/* List Functions */
-struct listnode{
-    long pos;
-    struct listnode *next;
-};
-typedef struct listnode poslist;
-
-void save(long pos,  poslist **list)
-{
-    poslist* pos_node_ptr;
-    static   poslist* last = NULL;
-
-    /* Allocate a new list node. */
-    errno = 0;
-    if ( NULL == (pos_node_ptr = (poslist*) malloc(sizeof(poslist)) ) )
-        fatal_error(errno, "malloc");
-
-    /* Copy the position into the new node. */
-    pos_node_ptr->pos = pos;
-
-    /* Attached the node to the end of the list. */
-    if ( *list == NULL ){
-        *list = pos_node_ptr;
-    }
-    else
-        last->next = pos_node_ptr;
-
-    last = pos_node_ptr;
-    pos_node_ptr->next  = NULL;
-}
-
-void printlist(DIR* dirp, poslist *list)
-{
-    poslist *ptr = list;
-    while ( ptr != NULL ) {
-        seekdir(dirp, ptr->pos);
-        printf("%s\n", readdir(dirp)->d_name);
-        ptr = ptr->next;
-    }
-}
-
-void eraselist(poslist **list)
-{
-    poslist *ptr = *list;
-    poslist *next;
-
-    while ( NULL != ptr ) {
-        next = ptr->next;
-        free(ptr);
-        ptr = next;
-    }
-    *list = NULL;
-}
-
-
-void listdir(DIR *dirp, int flags)
+/* Prints the entries of dirp, one per line, with a '/' after each
+   directory. With LIST_DIRS_FIRST, the directories are printed as they
+   are read, and the other entries are saved in rest and printed after the
+   last directory, so the directory is read only once. The names are
+   copied into the single buffer of rest, which is emptied first and
+   keeps its memory for the next directory.                           */
+void listdir(DIR *dirp, int flags, name_list *rest)
 {
     struct dirent  *entry;
-    long int       pos;
-    poslist        *saved_positions = NULL;
 
+    name_list_clear(rest);
     while ( 1 ) {
-        pos = telldir(dirp);       /* Save current position.     */
         errno = 0;                 /* Try to read entry.         */
         if ( NULL == (entry = readdir(dirp) ) && errno != 0 )
             perror("readdir");     /* Error reading entry.       */
@@ -114,15 +73,15 @@ void listdir(DIR *dirp, int flags)
             break;
         else {
             if ( (flags & LIST_DIRS_FIRST) && !isdir(entry) )  {
-                save(pos, &saved_positions);
+                if ( -1 == name_list_add(rest, entry->d_name, DT_UNKNOWN) )
+                    fatal_error(errno, "name_list_add");
                 continue;
             }
             printf("%s/\n", entry->d_name);
         }
     }
-    if ( flags & LIST_DIRS_FIRST )
-        printlist(dirp, saved_positions);
-    eraselist(&saved_positions);
+    for ( size_t i = 0; i < rest->count; i++ )
+        printf("%s\n", NAME_LIST_NAME(rest, i));
 }
 
 /*****************************************************************************
@@ -133,13 +92,16 @@ int main(int argc, char *argv[])
     DIR   *dirp;
     int    i;
     int    ls_flags = LIST_DIRS_FIRST;
+    name_list  rest;
+
+    name_list_init(&rest);
 
     if ( 1 == argc ) {      /* No arguments; use current working directory. */
         errno = 0;
         if ( ( dirp = opendir(".") ) == NULL )
             fatal_error(errno, "opendir");           /* Could not open cwd. */
         else
-           listdir( dirp, LIST_DIRS_FIRST );
+           listdir( dirp, LIST_DIRS_FIRST, &rest );
     }
     else {         /* For each command-line argument, call opendir() on it. */
         for ( i = 1; i < argc; i++) {
@@ -152,11 +114,12 @@ int main(int argc, char *argv[])
             }
             else {  /* A successful open of a directory */
                 printf("\n%s:\n", argv[i] );
-                listdir( dirp, ls_flags );
+                listdir( dirp, ls_flags, &rest );
                 closedir(dirp);
             }
         }
     }
+    name_list_free(&rest);
     return 0;
 }
 
@@ -3,11 +3,24 @@
   Author         : Stewart Weiss
   Created on     : September 30, 2023
   Description    : Lists directory contents, sorting directories before files
-  Purpose        : To show how to use scandir()
-  Usage          : spl_ls3 [file file ...]
+  Purpose        : To compare reading a directory with scandir() and with
+                   a getdents64() stream that reuses one buffer
+  Usage          : spl_ls3 [-f | -s] [file file ...]
                    where files may be any file type including directories
   Build with     : gcc -Wall -g -I ../include spl_ls3.c -o spl_ls3 \
                    -L../lib -lspl
+  NOTES:
+  With -s, each directory is read with scandir(), which allocates every
+  entry separately and holds the whole directory in memory, and sorted
+  with sortdirents() from dir_utils.h, which computes the collation key of
+  each name once rather than in every comparison. Otherwise it
+  is read with a dir_stream from libspl (see dir_stream.h), which reads
+  it with getdents64() into one buffer that is reused for every call. By
+  default the names are then kept in a name_list, whose entries are packed
+  into a single buffer indexed by an array of offsets, and sorted as
+  scandir() with dirsfirstsort() sorts them, so the output is the same.
+  With -f, the entries are not sorted, and each is printed as soon as it
+  is read, as ls -f does.
 
 ******************************************************************************
 * Copyright (C) 2025 - Stewart Weiss                                         *
@@ -23,6 +36,12 @@
 #define _BSD_SOURCE
 #include "common_hdrs.h"
 #include "dir_utils.h"   /* Needed for isdir() and dirsfirstsort() */
+#include "dir_stream.h"
+
+#define USAGE  "spl_ls3 [-f | -s] [file file ...]"
+
+/* The ways of reading a directory */
+typedef enum { READ_SORTED, READ_UNSORTED, READ_SCANDIR } read_mode;
 
 
 /** dirsfirstsort(&d1, &d2) compares the direct structures pointed to by
@@ -47,15 +66,25 @@ void print( const struct dirent* direntp )
     printf("\n");
 }
 
+/* Prints name, followed by a '/' if type is DT_DIR. */
+void print_name( const char *name, unsigned char type )
+{
+    fputs(name, stdout);
+    if ( type == DT_DIR )
+        putchar('/');
+    putchar('\n');
+}
+
 int scan_one_dir(const char* dirname, void (*process )(const struct dirent* ))
 {
     struct dirent **namelist;
     int n;
 
     errno = 0;
-    if ( (n = scandir(dirname, &namelist, NULL, dirsfirstsort) ) < 0){
+    if ( (n = scandir(dirname, &namelist, NULL, NULL) ) < 0){
         fatal_error(errno, "scandir");
     }
+    sortdirents(namelist, n, TRUE);
 
     int i;
     for (i = 0; i < n; i++) {
@@ -66,23 +95,86 @@ int scan_one_dir(const char* dirname, void (*process )(const struct dirent* ))
     return(EXIT_SUCCESS);
 }
 
+/* Lists dirname with the stream ds, sorted as scan_one_dir() sorts it if
+   names is not NULL, and otherwise in the order in which its entries are
+   read, printing each as it is read.                                   */
+void stream_one_dir( const char *dirname, dir_stream *ds, name_list *names )
+{
+    const char    *name;
+    unsigned char  type;
+
+    if ( -1 == dir_stream_open(ds, AT_FDCWD, dirname) )
+        fatal_error(errno, dirname);
+    if ( names != NULL )
+        name_list_clear(names);
+    errno = 0;
+    while ( NULL != (name = dir_stream_read(ds, &type)) )
+        if ( names == NULL )
+            print_name(name, type);
+        else if ( -1 == name_list_add(names, name, type) )
+            fatal_error(errno, "name_list_add");
+    if ( errno != 0 )
+        fatal_error(errno, "getdents64");
+    dir_stream_close(ds);
+    if ( names != NULL ) {
+        name_list_sort(names, TRUE);
+        for ( size_t i = 0; i < names->count; i++ )
+            print_name(NAME_LIST_NAME(names, i), NAME_LIST_TYPE(names, i));
+    }
+}
+
+/* Lists dirname in the way given by mode. */
+void list_dir( const char *dirname, read_mode mode, dir_stream *ds,
+               name_list *names )
+{
+    if ( mode == READ_SCANDIR )
+        scan_one_dir(dirname, print);
+    else
+        stream_one_dir(dirname, ds, mode == READ_SORTED ? names : NULL);
+}
+
 
 int main(int argc, char *argv[])
 {
+    int         ch;
+    read_mode   mode = READ_SORTED;
+    dir_stream  ds;
+    name_list   names;
 
     if ( setlocale(LC_TIME, "")  == NULL )
         fatal_error( LOCALE_ERROR,
                  "setlocale() could not set the given locale");
 
-    if ( 1 == argc ) /* If no arguments, list the CWD.                    */
-        scan_one_dir(".", print);
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt(argc, argv, ":fs");
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'f':
+            mode = READ_UNSORTED;
+            break;
+        case 's':
+            mode = READ_SCANDIR;
+            break;
+        default:
+            usage_error(USAGE);
+        }
+    }
+    dir_stream_init(&ds, 0);
+    name_list_init(&names);
+
+    if ( optind == argc ) /* If no arguments, list the CWD.               */
+        list_dir(".", mode, &ds, &names);
     else {           /* Otherwise, for each argument, scan it.            */
-        for (int i = 1; i < argc; i++ ) {
+        for (int i = optind; i < argc; i++ ) {
             printf("\n%s:\n", argv[i]);     /* Print the argument.        */
-            scan_one_dir(argv[i], print);   /* pass the print() function. */
+            list_dir(argv[i], mode, &ds, &names);
             if ( i < argc-1 ) printf("\n"); /* Put a newline before next. */
         }
     }
+    dir_stream_free(&ds);
+    name_list_free(&names);
     exit(EXIT_SUCCESS);
 }
 
@@ -3,11 +3,24 @@
   Author         : Stewart Weiss
   Created on     : September 29, 2023
   Description    : Lists directory contents, recursively
-  Purpose        : To do a tree walk by recursion on opendir()
-  Usage          : spl_ls_rec2 [file file ...]
+  Purpose        : To do a tree walk by recursion, reading each directory
+                   with a getdents64() stream or with scandir()
+  Usage          : spl_ls_rec2 [-f | -s] [file file ...]
                    where files may be any file type including directories
   Build with     : gcc -Wall -g -I ../include spl_ls_rec2.c -o spl_ls_rec2 \
                    -L../lib -lspl
+  NOTES:
+  With -s, each directory is read with scandir() and sorted with
+  sortdirents() from dir_utils.h, which computes the collation key of each
+  name once rather than in every comparison. Otherwise it is read
+  with a dir_stream from libspl (see dir_stream.h), which reads it with
+  getdents64() into one large buffer, and its subdirectories are opened
+  relative to it. By default the names are kept in a name_list, whose
+  entries are packed into a single buffer indexed by an array of offsets,
+  and sorted as alphasort() sorts them, so the output is the same as with
+  scandir(). With -f, the entries are not sorted, and each is printed as
+  soon as it is read. Each depth of the recursion has its own stream and
+  list, which are reused for every directory at that depth.
 
 ******************************************************************************
 * Copyright (C) 2025 - Stewart Weiss                                         *
@@ -23,7 +36,22 @@
 #define _BSD_SOURCE
 #include "common_hdrs.h"
 #include "dir_utils.h"
+#include "dir_stream.h"
 
+#define USAGE  "spl_ls_rec2 [-f | -s] [file file ...]"
+
+/* The ways of reading a directory */
+typedef enum { READ_SORTED, READ_UNSORTED, READ_SCANDIR } read_mode;
+
+/* The stream and list used at one depth of the recursion */
+typedef struct
+{
+    dir_stream   ds;
+    name_list    names;
+} level;
+
+static level  **levels;           /* levels[d] is used at depth d  */
+static int      num_levels;
 
 int scan_one_dir(const char* dirname )
 {
@@ -32,9 +60,10 @@ int scan_one_dir(const char* dirname )
     char   pathname[PATH_MAX];
 
     errno = 0;
-    if ( (n = scandir(dirname, &namelist, NULL, alphasort) ) < 0){
+    if ( (n = scandir(dirname, &namelist, NULL, NULL) ) < 0){
         fatal_error(errno, "scandir");
     }
+    sortdirents(namelist, n, FALSE);
     for (i = 0; i < n; i++) {
         if (strcmp(namelist[i]->d_name, ".") != 0
             && strcmp(namelist[i]->d_name, "..") != 0) {
@@ -50,23 +79,127 @@ int scan_one_dir(const char* dirname )
     return(EXIT_SUCCESS);
 }
 
+/* Returns the level for depth, creating it if need be. */
+level *get_level( int depth )
+{
+    if ( depth == num_levels ) {
+        if ( NULL == (levels = realloc(levels, (depth+1) * sizeof(level*)))
+             || NULL == (levels[depth] = malloc(sizeof(level))) )
+            fatal_error(errno, "malloc");
+        dir_stream_init(&levels[depth]->ds, 0);
+        name_list_init(&levels[depth]->names);
+        num_levels++;
+    }
+    return levels[depth];
+}
+
+void stream_one_dir( const char *dirname, int dirfd, const char *path,
+                     read_mode mode, int depth );
+
+/* Prints the entry name of dirname, whose descriptor is dirfd, and lists
+   it if it is a directory.                                             */
+void visit( const char *dirname, int dirfd, const char *name,
+            unsigned char type, read_mode mode, int depth )
+{
+    char   pathname[PATH_MAX];
+
+    if ( strcmp(name, ".") == 0 || strcmp(name, "..") == 0 )
+        return;
+    printf("%s/%s\n", dirname, name);
+    if ( type == DT_DIR ) {
+        snprintf(pathname, PATH_MAX, "%s/%s", dirname, name);
+        stream_one_dir(pathname, dirfd, name, mode, depth + 1);
+    }
+}
+
+/* Lists the directory dirname, which is at path relative to dirfd, and
+   everything below it, with the stream and list of the level at depth.
+   In READ_SORTED mode the entries are sorted as scan_one_dir() sorts
+   them; otherwise each is printed, and listed if it is a directory, as
+   soon as it is read.                                                 */
+void stream_one_dir( const char *dirname, int dirfd, const char *path,
+                     read_mode mode, int depth )
+{
+    level         *lv = get_level(depth);
+    const char    *name;
+    unsigned char  type;
+
+    if ( -1 == dir_stream_open(&lv->ds, dirfd, path) )
+        fatal_error(errno, dirname);
+    name_list_clear(&lv->names);
+    while ( TRUE ) {
+        errno = 0;
+        if ( NULL == (name = dir_stream_read(&lv->ds, &type)) )
+            break;
+        if ( mode == READ_UNSORTED )
+            visit(dirname, dir_stream_fd(&lv->ds), name, type, mode, depth);
+        else if ( -1 == name_list_add(&lv->names, name, type) )
+            fatal_error(errno, "name_list_add");
+    }
+    if ( errno != 0 )
+        fatal_error(errno, "getdents64");
+    if ( mode == READ_SORTED ) {
+        name_list_sort(&lv->names, FALSE);
+        for ( size_t i = 0; i < lv->names.count; i++ )
+            visit(dirname, dir_stream_fd(&lv->ds),
+                  NAME_LIST_NAME(&lv->names, i),
+                  NAME_LIST_TYPE(&lv->names, i), mode, depth);
+    }
+    dir_stream_close(&lv->ds);
+}
+
+/* Lists dirname in the way given by mode. */
+void list_dir( const char *dirname, read_mode mode )
+{
+    if ( mode == READ_SCANDIR )
+        scan_one_dir(dirname);
+    else
+        stream_one_dir(dirname, AT_FDCWD, dirname, mode, 0);
+}
+
 
 int main(int argc, char *argv[])
 {
+    int        ch;
+    read_mode  mode = READ_SORTED;
+
     if ( setlocale(LC_TIME, "")  == NULL )
         fatal_error( LOCALE_ERROR,
                  "setlocale() could not set the given locale");
 
-    if ( 1 == argc )
-        scan_one_dir(".");
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt(argc, argv, ":fs");
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'f':
+            mode = READ_UNSORTED;
+            break;
+        case 's':
+            mode = READ_SCANDIR;
+            break;
+        default:
+            usage_error(USAGE);
+        }
+    }
+
+    if ( optind == argc )
+        list_dir(".", mode);
     else {
         int i;
-        for (i = 1; i < argc; i++ ) {
+        for (i = optind; i < argc; i++ ) {
             printf("%s:\n", argv[i]);
-            scan_one_dir(argv[i]);
+            list_dir(argv[i], mode);
             if ( i < argc-1 ) printf("\n");
         }
     }
+    for ( int i = 0; i < num_levels; i++ ) {
+        dir_stream_free(&levels[i]->ds);
+        name_list_free(&levels[i]->names);
+        free(levels[i]);
+    }
+    free(levels);
     exit(EXIT_SUCCESS);
 }
 
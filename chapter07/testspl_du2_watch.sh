@@ -0,0 +1,63 @@
+#!/bin/bash
+#  Checks that spl_du2 --watch keeps its totals right as a tree changes.
+#  After each change, the last total that the watch printed for the root
+#  is compared with the total from a new walk of the tree.
+#  Run it in this directory after making spl_du2. As root, the watch uses
+#  fanotify; as any other user, it uses inotify. The files with several
+#  links are made before the watch starts, since a new link to a file with
+#  one link is counted twice until the next walk (see du_watch.h).
+
+if [ ! -x spl_du2 ] ; then
+    echo "Make sure the executable, spl_du2, exists before running this script."
+    exit 1
+fi
+
+top=$(mktemp -d)
+tree=$top/lt
+out=$top/watch.out
+failures=0
+
+mkdir -p $tree/a $tree/z/y
+head -c 40960 /dev/zero > $tree/a/g
+ln $tree/a/g $tree/z/f
+head -c 8192 /dev/zero > $tree/z/y/h
+ln $tree/z/y/h $tree/z/y/i
+ln $tree/z/y/h $tree/a/j
+
+./spl_du2 --watch=1 $tree > $out 2> /dev/null &
+watcher=$!
+trap 'kill $watcher 2> /dev/null; rm -rf $top' EXIT
+sleep 1
+
+# check description: waits for the watch to report, and compares its last
+# total for the root with that of a new walk.
+check() {
+    sleep 2
+    watched=$(awk -F'\t' -v root=$tree '$2 == root { t = $1 } END { print t }' $out)
+    walked=$(./spl_du2 $tree | tail -1 | cut -f1)
+    if [ "$watched" = "$walked" ] ; then
+        echo "ok    $1: $walked"
+    else
+        echo "FAIL  $1: watch says $watched, a walk says $walked"
+        failures=$((failures + 1))
+    fi
+}
+
+check "start"
+head -c 16384 /dev/zero > $tree/a/new;       check "new file"
+head -c 16384 /dev/zero >> $tree/a/new;      check "file grows"
+rm $tree/z/f;                                check "remove the counted name of a linked file"
+rm $tree/a/g;                                check "remove its last name"
+rm $tree/a/j;                                check "remove an uncounted name"
+ln $tree/z/y/h $tree/a/k;                    check "link again"
+rm -rf $tree/z;                              check "remove a directory holding counted names"
+mkdir -p $tree/b/c && head -c 4096 /dev/zero > $tree/b/c/d
+                                             check "new directory"
+mv $tree/b $tree/a/b;                        check "move a directory"
+rm -rf $tree/a/b;                            check "remove a directory"
+
+if [ $failures -gt 0 ] ; then
+    echo "$failures checks failed"
+    exit 1
+fi
+echo "All checks passed"
@@ -4,9 +4,22 @@
   Created on     : March 26, 2024
   Description    : Prints the process IDs of the ancestors of a process
   Purpose        : To show how to access /proc files
-  Usage          : ancestors <pid>
+  Usage          : ancestors [pid]
+                   ancestors pid pid ...
+                   ancestors -b  < file-of-pids
   Build with     : gcc -g -Wall -o ancestors -I../include -L../lib \
-                       ancestors.c -lspl
+                       ancestors.c -lspl -pthread
+
+  Notes:
+  With at most one pid, the ancestors are printed one per line, and they
+  are found by reading the status file of each ancestor in turn.
+
+  With more than one pid, or with -b, which reads whitespace-separated
+  pids from standard input, the program answers all of the queries from a
+  proc_tree built by a single scan of /proc, and prints one line per pid:
+       pid: parent grandparent ...
+  This costs one stat file per process in total, rather than one file per
+  ancestor of each pid queried.
 
 ******************************************************************************
 * Copyright (C) 2024 - Stewart Weiss                                         *
@@ -21,8 +34,12 @@
 
 #include "common_hdrs.h"
 #include "get_nums.h"
+#include "proc_tree.h"
+#include "bulk_parse.h"
 #include <ctype.h>
 
+#define MAX_ANCESTORS  4096
+
 pid_t getparentid( pid_t p)
 {
     pid_t   parentpid = 0;  /* The parent PID found by the function   */
@@ -48,13 +65,58 @@ pid_t getparentid( pid_t p)
             break;
     }
     free(buf);
+    fclose(fp);
     return parentpid;
 }
 
+/* Prints the ancestors of pid on one line, using the tree. */
+void print_ancestors( proc_tree *tree, pid_t pid, pid_t *list )
+{
+    int   n;
+    char  mssge[64];
+
+    if ( -1 == (n = get_ancestors(tree, pid, list, MAX_ANCESTORS)) ) {
+        sprintf(mssge, "%d: no such process", pid);
+        error_mssge(-1, mssge);
+        return;
+    }
+    printf("%d:", pid);
+    for ( int i = 0; i < n; i++ )
+        printf(" %d", list[i]);
+    printf("\n");
+}
+
 int main( int argc, char *argv[])
 {
     pid_t pid, parentpid;
     char errmessage[128];
+    proc_tree  tree;
+    pid_t     *list;
+    long      *pids, n;
+    BOOL       from_stdin = ( argc == 2 && strcmp(argv[1], "-b") == 0 );
+
+    if ( argc > 2 || from_stdin ) {
+        if ( -1 == build_proc_tree(&tree) )
+            fatal_error(errno, "build_proc_tree");
+        if ( NULL == (list = malloc(MAX_ANCESTORS * sizeof(pid_t))) )
+            fatal_error(errno, "malloc");
+        if ( from_stdin ) {
+            if ( -1 == (n = bulk_parse_long(STDIN_FILENO, &pids, 1)) )
+                fatal_error(errno, "bulk_parse_long");
+            for ( long i = 0; i < n; i++ )
+                print_ancestors(&tree, pids[i], list);
+            free(pids);
+        }
+        else
+            for ( int i = 1; i < argc; i++ ) {
+                if ( VALID_NUMBER != get_int(argv[i], 0, &pid, errmessage ) )
+                    usage_error("bad number");
+                print_ancestors(&tree, pid, list);
+            }
+        free(list);
+        free_proc_tree(&tree);
+        return 0;
+    }
 
     if ( argc > 1 ) {
         if ( VALID_NUMBER != get_int(argv[1], 0, &pid, errmessage ) )
@@ -68,5 +130,3 @@ int main( int argc, char *argv[])
     }
     return 0;
 }
-
-
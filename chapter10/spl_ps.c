@@ -4,10 +4,31 @@
   Created on     : March 24, 2024
   Description    : A simplified ps command
   Purpose        : To show how to use /procfs for accessing process stats
-  Usage          : spl_ps
+  Usage          : spl_ps [-H|--forest] [-o fieldlist] [-p pidlist]
+                          [-u userlist]
   Build with     : gcc -Wall -o spl_ps -I../include -L../lib spl_ps.c \
                       -lspl -lm -lrt
 
+  Notes:
+  Without options, spl_ps prints the fixed set of columns produced by
+  printheadings() and print_one_ps() for every process.
+
+  -o fieldlist  selects the columns to print, in the order given. The list
+                is separated by commas or blanks, and -o may be repeated.
+                The valid field names are those in fieldtab below.
+  -p pidlist    restricts the output to the listed process IDs.
+  -u userlist   restricts the output to processes whose effective owner
+                is one of the listed user names or numeric user IDs.
+  -H, --forest  prints the processes as a forest, each one below its parent
+                with its command indented by its depth. The forest comes
+                from a proc_tree, which is built by one scan of /proc.
+
+  Each field records which files in /proc/[pid] it is computed from. Before
+  any process is visited, the set of files needed by the selected fields
+  and filters is computed once, and only those files are read for each
+  process. When -p is given, only the listed /proc/[pid] directories are
+  visited and /proc itself is never read.
+
 ******************************************************************************
 * Copyright (C) 2024 - Stewart Weiss                                         *
 *                                                                            *
@@ -19,31 +40,383 @@
 * PARTICULAR PURPOSE. See the file COPYING.gplv3 for details.                *
 *****************************************************************************/
 #include "common_hdrs.h"
+#include <ctype.h>
 #include <dirent.h>
 #include <pwd.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
+#include <getopt.h>
 #include "ps_utils.h"
+#include "proc_tree.h"
+
+#define MAX_IDS      1024   /* Maximum number of pids or users in filters */
+#define STATUS_SIZE  4096   /* Large enough for /proc/[pid]/status        */
+
+/* The files in /proc/[pid] from which fields are computed. */
+#define SRC_DIR       1     /* stat() of /proc/[pid] itself, for the uid  */
+#define SRC_STAT      2     /* /proc/[pid]/stat                           */
+#define SRC_STATM     4     /* /proc/[pid]/statm                          */
+#define SRC_STATUS    8     /* /proc/[pid]/status                         */
+#define SRC_CMDLINE  16     /* /proc/[pid]/cmdline                        */
+
+enum field_t {USER, UID, PID, PPID, S, PRI, NI, STIME, TTY, TIME, VSZ, RSS,
+              SHR, SWAP, RUSER, COMM, ARGS, NUM_FIELDS};
+
+typedef struct {
+    char*  name;        /* The name of the field in a -o list             */
+    int    sources;     /* The /proc files the field is computed from     */
+    char*  fmt;         /* The printf format for the heading and value    */
+    char*  colheading;  /* The column heading for the field               */
+} field;
 
+/* The field table, indexed by field_t. All values are converted to strings
+   before they are printed, so one format serves heading and value. */
+field fieldtab[] = {
+     {"user",   SRC_DIR,                "%-8s",  "USER"   },
+     {"uid",    SRC_DIR,                "%5s",   "UID"    },
+     {"pid",    0,                      "%7s",   "PID"    },
+     {"ppid",   SRC_STAT,               "%7s",   "PPID"   },
+     {"s",      SRC_STAT,               "%1s",   "S"      },
+     {"pri",    SRC_STAT,               "%3s",   "PRI"    },
+     {"ni",     SRC_STAT,               "%3s",   "NI"     },
+     {"stime",  SRC_STAT,               "%5s",   "STIME"  },
+     {"tty",    SRC_STAT,               "%-8s",  "TTY"    },
+     {"time",   SRC_STAT,               "%8s",   "TIME"   },
+     {"vsz",    SRC_STAT,               "%9s",   "VSZ"    },
+     {"rss",    SRC_STATM,              "%8s",   "RSS"    },
+     {"shr",    SRC_STATM,              "%8s",   "SHR"    },
+     {"swap",   SRC_STATUS,             "%8s",   "SWAP"   },
+     {"ruser",  SRC_STATUS,             "%-8s",  "RUSER"  },
+     {"comm",   SRC_STAT,               "%-15s", "COMMAND"},
+     {"args",   SRC_CMDLINE,            "%-s",   "COMMAND"}
+};
 
-void printallprocs( DIR *dirp )
+/* Everything that might be printed for one process. */
+typedef struct {
+    procstat  ps;                 /* Fields from stat, plus uid and memory */
+    long      swap;               /* VmSwap from status, in KB             */
+    uid_t     ruid;               /* Real uid from status                  */
+    char      args[MAX_LINE];     /* Command line, blank-separated         */
+} procinfo;
+
+static int    fieldlist[NUM_FIELDS];     /* Selected fields, in order     */
+static int    numfields = 0;
+static pid_t  pidlist[MAX_IDS];          /* Argument of -p                */
+static int    numpids   = 0;
+static uid_t  uidlist[MAX_IDS];          /* Argument of -u                */
+static int    numuids   = 0;
+static long   page_kb;                   /* Page size in KB               */
+static BOOL   forest    = FALSE;         /* Set by -H or --forest         */
+
+
+/** add_fields(list) appends the fields named in the comma or blank separated
+    list to fieldlist. */
+void add_fields( char *list )
 {
-    struct dirent   *direntp;     /* Pointer to directory entry structure   */
-    char*   accepts="0123456789"; /* For matching directory names           */
-    char    pathname[PATH_MAX];   /* Pathname to file to open               */
-    char    heading[MAX_LINE];    /* String containing heading              */
-    char    psline[MAX_LINE];     /* String containing one proc's data      */
-    size_t  len = MAX_LINE;       /* Length of line getline() returned      */
-    FILE*   fp;                   /* File stream to read                    */
-    char*   buf;
-    procstat  ps_fields;
+    char *name;
+    char  errmssge[MAXLEN];
+    int   i;
+
+    for ( name = strtok(list, ", "); name != NULL; name = strtok(NULL, ", ")) {
+        for ( i = 0; i < NUM_FIELDS; i++ )
+            if ( strcmp(name, fieldtab[i].name) == 0 )
+                break;
+        if ( i == NUM_FIELDS ) {
+            sprintf(errmssge, "unknown field %.64s in -o list", name);
+            usage_error(errmssge);
+        }
+        if ( numfields == NUM_FIELDS )
+            usage_error("too many fields in -o list");
+        fieldlist[numfields++] = i;
+    }
+}
+
+/** add_pids(list) appends the process IDs in list to pidlist. */
+void add_pids( char *list )
+{
+    char *tok;
+    int   pid;
+
+    for ( tok = strtok(list, ", "); tok != NULL; tok = strtok(NULL, ", ")) {
+        if ( VALID_NUMBER != get_int(tok, PURE | POS_ONLY, &pid, NULL) )
+            usage_error("invalid process ID in -p list");
+        if ( numpids == MAX_IDS )
+            usage_error("too many process IDs in -p list");
+        pidlist[numpids++] = pid;
+    }
+}
+
+/** add_uids(list) appends the uids of the user names or numeric uids in
+    list to uidlist. */
+void add_uids( char *list )
+{
+    char *tok;
+    int   uid;
+
+    for ( tok = strtok(list, ", "); tok != NULL; tok = strtok(NULL, ", ")) {
+        if ( VALID_NUMBER != get_int(tok, PURE | NON_NEG_ONLY, &uid, NULL) )
+            if ( -1 == (uid = name2uid(tok)) )
+                usage_error("unknown user in -u list");
+        if ( numuids == MAX_IDS )
+            usage_error("too many users in -u list");
+        uidlist[numuids++] = uid;
+    }
+}
+
+int pidcmp( const void *a, const void *b )
+{
+    return *((pid_t*) a) - *((pid_t*) b);
+}
+
+/** plan_sources() returns the set of /proc/[pid] files that must be read
+    for each process to produce the selected fields and apply the filters.
+    Without -o, the fixed output of print_one_ps() needs stat and the uid. */
+int plan_sources()
+{
+    int sources = 0;
+
+    if ( numfields == 0 )
+        sources = SRC_DIR | SRC_STAT;
+    for ( int i = 0; i < numfields; i++ )
+        sources |= fieldtab[fieldlist[i]].sources;
+    if ( numuids > 0 )
+        sources |= SRC_DIR;
+    /* An explicit pid that doesn't exist must not be printed, so make sure
+       at least one file is consulted for it. */
+    if ( numpids > 0 && sources == 0 )
+        sources = SRC_DIR;
+    return sources;
+}
+
+/** parse_status(buf, pi) extracts the real uid and the swap usage from the
+    contents of a status file. */
+void parse_status( char *buf, procinfo *pi )
+{
+    char *line;
+
+    if ( NULL != (line = strstr(buf, "\nUid:")) )
+        sscanf(line, "\nUid: %u", &pi->ruid);
+    if ( NULL != (line = strstr(buf, "\nVmSwap:")) )
+        sscanf(line, "\nVmSwap: %ld", &pi->swap);
+}
+
+/** load_extra(pid, sources, pi) fills pi with the data for process pid that
+    is found in the statm, status, and cmdline files, if they are in sources.
+    It returns 1 if successful and 0 if the process no longer exists. */
+int load_extra( pid_t pid, int sources, procinfo *pi )
+{
+    char    buf[STATUS_SIZE];
+    unsigned long size, resident, shared;
+    ssize_t n;
+
+    if ( sources & SRC_STATM ) {
+        if ( -1 == read_proc_file(pid, "statm", buf, sizeof(buf)) )
+            return 0;
+        if ( 3 == sscanf(buf, "%lu %lu %lu", &size, &resident, &shared) ) {
+            pi->ps.rss    = resident * page_kb;
+            pi->ps.shared = shared   * page_kb;
+        }
+    }
+    if ( sources & SRC_STATUS ) {
+        if ( -1 == read_proc_file(pid, "status", buf, sizeof(buf)) )
+            return 0;
+        parse_status(buf, pi);
+    }
+    if ( sources & SRC_CMDLINE ) {
+        /* The arguments are separated by null bytes; replace them, and
+           show unprintable characters as '?', as ps does. */
+        if ( -1 == (n = read_proc_file(pid, "cmdline", pi->args,
+                                        sizeof(pi->args))) )
+            return 0;
+        while ( n > 0 && pi->args[n-1] == '\0' )
+            n--;
+        for ( int i = 0; i < n; i++ )
+            if ( pi->args[i] == '\0' )
+                pi->args[i] = ' ';
+            else if ( iscntrl((unsigned char) pi->args[i]) )
+                pi->args[i] = '?';
+        /* Kernel threads have no command line. Like ps, show the command
+           name in brackets instead; only in this case is comm needed. */
+        if ( n == 0 ) {
+            if ( -1 == read_proc_file(pid, "comm", buf, sizeof(buf)) )
+                return 0;
+            buf[strcspn(buf, "\n")] = '\0';
+            snprintf(pi->args, sizeof(pi->args), "[%.64s]", buf);
+        }
+    }
+    return 1;
+}
+
+/** load_proc(pid, sources, pi) fills pi with the data for process pid that
+    is found in the files in sources, reading no others. It returns 1 if
+    successful and 0 if the process no longer exists. */
+int load_proc( pid_t pid, int sources, procinfo *pi )
+{
+    char    buf[MAX_LINE];
+    char    pathname[32];
     struct  stat  statbuffer;
 
-    memset(heading,0, MAX_LINE);
-    printheadings(heading);
-    printf("%s", heading);
-    if ( NULL == (buf = malloc(MAX_LINE))) /* Allocate buffer for getline() */
-        fatal_error(errno, "malloc");
+    memset(pi, 0, sizeof(procinfo));
+    pi->ps.pid = pid;
+
+    if ( sources & SRC_DIR ) {
+        sprintf(pathname, "/proc/%d", pid);
+        if ( -1 == stat(pathname, &statbuffer) )
+            return 0;
+        /* The /proc/[pid]/stat file doesn't store real uid. */
+        pi->ps.uid = statbuffer.st_uid;
+    }
+    if ( sources & SRC_STAT ) {
+        if ( -1 == read_proc_file(pid, "stat", buf, sizeof(buf)) )
+            return 0;
+        if ( parse_buf(buf, &pi->ps) < 13 ) {
+            free(pi->ps.comm);
+            return 0;
+        }
+    }
+    if ( ! load_extra(pid, sources, pi) ) {
+        free(pi->ps.comm);
+        return 0;
+    }
+    return 1;
+}
+
+/** selected(pi) returns TRUE if the process passes the -u filter. The -p
+    filter is applied by visiting only the listed processes. */
+BOOL selected( procinfo *pi )
+{
+    if ( numuids == 0 )
+        return TRUE;
+    for ( int i = 0; i < numuids; i++ )
+        if ( uidlist[i] == pi->ps.uid )
+            return TRUE;
+    return FALSE;
+}
+
+/** print_fields_heading(buf) prints the headings of the selected fields. */
+void print_fields_heading( char *buf )
+{
+    char *p = buf;
+
+    for ( int i = 0; i < numfields; i++ ) {
+        if ( i > 0 )
+            *p++ = ' ';
+        p += sprintf(p, fieldtab[fieldlist[i]].fmt,
+                     fieldtab[fieldlist[i]].colheading);
+    }
+    while ( p > buf && *(p-1) == ' ' )
+        p--;
+    *p = '\0';
+}
+
+/** print_fields(pi, buf) prints the values of the selected fields for the
+    process pi into buf. */
+void print_fields( procinfo *pi, char *buf )
+{
+    char  value[MAX_LINE];
+    char *p = buf;
+    procstat *ps = &pi->ps;
+
+    for ( int i = 0; i < numfields; i++ ) {
+        switch ( fieldlist[i] ) {
+        case USER:  strcpy(value, uid2name(ps->uid));               break;
+        case UID:   sprintf(value, "%d", ps->uid);                  break;
+        case PID:   sprintf(value, "%d", ps->pid);                  break;
+        case PPID:  sprintf(value, "%d", ps->ppid);                 break;
+        case S:     sprintf(value, "%c", ps->state);                break;
+        case PRI:   sprintf(value, "%ld", ps->priority);            break;
+        case NI:    sprintf(value, "%ld", ps->nice);                break;
+        case STIME: make_start_time_str(*ps, value);                break;
+        case TTY:
+            if ( ! tty_name(value, major(ps->tty_nr), minor(ps->tty_nr)) )
+                strcpy(value, "?");
+            break;
+        case TIME:  make_cpu_time_str(*ps, value);                  break;
+        case VSZ:   sprintf(value, "%lu", ps->vsize/1024);          break;
+        case RSS:   sprintf(value, "%ld", ps->rss);                 break;
+        case SHR:   sprintf(value, "%ld", ps->shared);              break;
+        case SWAP:  sprintf(value, "%ld", pi->swap);                break;
+        case RUSER: strcpy(value, uid2name(pi->ruid));              break;
+        case COMM:
+            snprintf(value, MAX_LINE, "%s", strip_cmmd_parens(ps->comm));
+            break;
+        case ARGS:  strcpy(value, pi->args);                        break;
+        }
+        if ( i > 0 )
+            *p++ = ' ';
+        p += snprintf(p, MAX_LINE, fieldtab[fieldlist[i]].fmt, value);
+    }
+    /* Don't leave trailing blanks after a left-justified last column. */
+    while ( p > buf && *(p-1) == ' ' )
+        p--;
+    *p = '\0';
+}
+
+/** indent_command(pi, depth) prefixes the command name and command line in
+    pi with the indentation for a process at the given depth in the forest:
+    four blanks per level and a branch symbol. */
+void indent_command( procinfo *pi, int depth )
+{
+    char  prefix[MAX_LINE];
+    char *comm;
+    size_t len, n;
+    int   width = 4 * (depth - 1);
+
+    if ( depth == 0 || width > MAX_LINE - 8 )
+        return;
+    sprintf(prefix, "%*s \\_ ", width, "");
+    if ( pi->ps.comm != NULL && pi->ps.comm[0] == '(' ) {
+        /* Keep the parentheses so strip_cmmd_parens() still works. */
+        if ( NULL == (comm = malloc(strlen(prefix) + strlen(pi->ps.comm) + 1)))
+            fatal_error(errno, "malloc");
+        sprintf(comm, "(%s%s", prefix, pi->ps.comm + 1);
+        free(pi->ps.comm);
+        pi->ps.comm = comm;
+    }
+    /* Shift the command line right to make room for the prefix. */
+    len = strlen(prefix);
+    n = strlen(pi->args);
+    if ( n + len >= MAX_LINE )
+        n = MAX_LINE - len - 1;
+    memmove(pi->args + len, pi->args, n);
+    memcpy(pi->args, prefix, len);
+    pi->args[len + n] = '\0';
+}
+
+/** print_one_proc(pid, sources, depth) loads and prints the process pid if
+    it passes the filters, indenting its command by depth levels. It returns
+    1 if it printed it and 0 if not. */
+int print_one_proc( pid_t pid, int sources, int depth )
+{
+    procinfo  pi;
+    char      psline[MAX_LINE * (NUM_FIELDS + 1)];
+
+    if ( ! load_proc(pid, sources, &pi) )
+        return 0;
+    if ( ! selected(&pi) ) {
+        free(pi.ps.comm);
+        return 0;
+    }
+    indent_command(&pi, depth);
+    if ( numfields == 0 ) {
+        print_one_ps(pi.ps, psline);    /* print_one_ps() frees comm. */
+        printf("%s", psline);
+    }
+    else {
+        print_fields(&pi, psline);
+        printf("%s\n", psline);
+        free(pi.ps.comm);
+    }
+    return 1;
+}
+
+/** printallprocs(dirp, sources) prints every process in the open /proc
+    directory dirp. It returns the number of processes printed. */
+int printallprocs( DIR *dirp, int sources )
+{
+    struct dirent   *direntp;     /* Pointer to directory entry structure   */
+    char*   accepts="0123456789"; /* For matching directory names           */
+    int     count = 0;
 
     while ( TRUE ) {
         errno = 0;
@@ -53,39 +426,108 @@ void printallprocs( DIR *dirp )
         else if ( direntp == NULL )   /* The end of the stream was reached  */
             break;
         else if (strspn(direntp->d_name, accepts) == strlen(direntp->d_name))
-        {   /* Directory name is a number. */
-            memset(pathname, '\0', PATH_MAX);
-            sprintf(pathname, "/proc/%s/",direntp->d_name);
-            if ( -1 == stat(pathname, &statbuffer)) /* Stat directory */
-                continue;
-            /* The /proc/[pid]/stat file doesn't store real uid. */
-            ps_fields.uid = statbuffer.st_uid;
-
-            sprintf(pathname+strlen(pathname), "stat");
-            if ( NULL == (fp = fopen(pathname, "r") ))
-                continue;
-
-            if ( -1 == getline(&buf,&len, fp ) )
-                fatal_error(errno, "getline()");
-            parse_buf(buf, &ps_fields);
-            print_one_ps(ps_fields, psline);
-            printf("%s", psline);
-            fclose(fp);
-        }
+            /* Directory name is a number. */
+            count += print_one_proc(atoi(direntp->d_name), sources, 0);
+    }
+    return count;
+}
+
+/** printlistedprocs(sources) prints the processes in pidlist in increasing
+    order, each once. It returns the number of processes printed. */
+int printlistedprocs( int sources )
+{
+    int count = 0;
+
+    qsort(pidlist, numpids, sizeof(pid_t), pidcmp);
+    for ( int i = 0; i < numpids; i++ )
+        if ( i == 0 || pidlist[i] != pidlist[i-1] )
+            count += print_one_proc(pidlist[i], sources, 0);
+    return count;
+}
+
+/** printforest(sources) prints the processes in preorder of the process
+    forest, restricted to those in pidlist if -p was given. It returns the
+    number of processes printed. */
+int printforest( int sources )
+{
+    proc_tree  tree;
+    proc_node *node;
+    int        count = 0;
+
+    if ( -1 == build_proc_tree(&tree) )
+        fatal_error(errno, "build_proc_tree");
+    qsort(pidlist, numpids, sizeof(pid_t), pidcmp);
+    for ( int i = next_preorder(&tree, NO_PROC); i != NO_PROC;
+              i = next_preorder(&tree, i) ) {
+        node = &tree.nodes[i];
+        if ( numpids > 0 && NULL == bsearch(&node->pid, pidlist, numpids,
+                                            sizeof(pid_t), pidcmp) )
+            continue;
+        count += print_one_proc(node->pid, sources, node->depth);
     }
-    free(buf);
-    printf("\n");
+    free_proc_tree(&tree);
+    return count;
 }
 
 int main(int argc, char *argv[])
 {
     DIR   *dirp;
+    int    ch;
+    char   options[] = ":Ho:p:u:";
+    struct option longopts[] = {
+        {"forest", no_argument, NULL, 'H'},
+        {0,        0,           0,    0  }
+    };
+    char   heading[MAX_LINE * (NUM_FIELDS + 1)];
+    int    sources;
+    int    count;
+
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt_long(argc, argv, options, longopts, NULL);
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'H': forest = TRUE;      break;
+        case 'o': add_fields(optarg); break;
+        case 'p': add_pids(optarg);   break;
+        case 'u': add_uids(optarg);   break;
+        case '?':
+        case ':':
+            usage_error("spl_ps [-H|--forest] [-o fieldlist] [-p pidlist] "
+                        "[-u userlist]");
+        }
+    }
 
     get_hertz();
-    errno = 0;
-    if ( ( dirp = opendir("/proc") ) == NULL )
-        fatal_error(errno, "opendir");           /* Could not open cwd. */
-    else
-        printallprocs(dirp);
+    page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    sources = plan_sources();
+
+    memset(heading,0, sizeof(heading));
+    if ( numfields == 0 ) {
+        printheadings(heading);
+        printf("%s", heading);
+    }
+    else {
+        print_fields_heading(heading);
+        printf("%s\n", heading);
+    }
+
+    if ( forest )
+        count = printforest(sources);
+    else if ( numpids > 0 )
+        count = printlistedprocs(sources);
+    else {
+        errno = 0;
+        if ( ( dirp = opendir("/proc") ) == NULL )
+            fatal_error(errno, "opendir");       /* Could not open /proc. */
+        count = printallprocs(dirp, sources);
+        closedir(dirp);
+    }
+    if ( numfields == 0 )
+        printf("\n");
+    /* Like ps, fail if a filter was given and nothing matched it. */
+    if ( count == 0 && (numpids > 0 || numuids > 0) )
+        exit(EXIT_FAILURE);
     exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,216 @@
+/*****************************************************************************
+  Title          : reduce_bench.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Compares barrier-based and pooled parallel reductions
+  Purpose        : To show the cost of false sharing and of creating threads
+                   for every reduction
+  Usage          : reduce_bench [-n array_size] [-r repetitions]
+                                [-t max_threads]
+  Build with     : gcc -Wall -g -O3 -I../include -L../lib -o reduce_bench \
+                   reduce_bench.c -lspl -pthread -lrt
+
+  Notes:
+  The program sums an array of array_size longs (default 16M) with 1, 2, 4,
+  ... up to max_threads (default 64) threads, and with max_threads itself
+  if it is not a power of 2, in two ways:
+
+  barrier  The method of vmem_usage.c: for each sum, threads are created,
+           each adds its segment directly into its cell of a shared array
+           of partial sums, and the partial sums are combined by a tree
+           reduction synchronized with a barrier. Adjacent cells share
+           cache lines, so the threads' writes contend for them.
+  pool     parallel_reduce() from libspl: the threads are created once,
+           each adds into a local variable, and each result is stored in
+           an accumulator padded to a full cache line.
+
+  Each sum is repeated the given number of times (default 20), and the
+  mean time per sum is printed, with the speedup relative to one thread.
+
+  The program must be compiled with -O3, as parallel_reduce.o in libspl
+  is, so that both methods are built alike and only their design differs.
+  Compiled without optimization, the barrier method would appear far
+  slower than it is.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.gplv3 for details.                *
+*****************************************************************************/
+
+#include "common_hdrs.h"
+#include <pthread.h>
+#include "parallel_reduce.h"
+#include "time_utils.h"
+
+long       *partial_sum;   /* Shared array of partial sums (barrier method) */
+pthread_barrier_t barrier; /* Barrier for threads to synchronize            */
+
+/* Data structure passed to each thread start function */
+typedef struct _task_data
+{
+    long first;      /* Index of first element for thread */
+    long last;       /* index of last element for thread  */
+    int task_id;     /* Thread's program ID               */
+    int num_threads; /* Total number of threads           */
+    long *data;
+} task_data;
+
+
+/* Thread start function for the barrier method, as in vmem_usage.c. */
+void  *sum_reduce( void * thread_data )
+{
+    int   half;
+    int   retval;
+
+    task_data *t_data  = (task_data*) thread_data;
+    int tid            = t_data->task_id;
+
+    partial_sum[tid] = 0;
+    for ( long k = t_data->first; k <= t_data->last; k++ )
+        partial_sum[tid] += t_data->data[k];
+
+    half = t_data->num_threads;
+    while ( half > 1 ) {
+        retval = pthread_barrier_wait(&barrier);
+        if ( PTHREAD_BARRIER_SERIAL_THREAD != retval &&
+             0 != retval )
+           pthread_exit((void*) 0);
+
+        if ( half % 2 == 1 && tid == 0 )
+            partial_sum[0] +=  partial_sum[half-1];
+        half = half/2; // integer division
+        if ( tid < half )
+            partial_sum[tid] +=  partial_sum[tid+half];
+    }
+    pthread_exit((void*) 0);
+}
+
+/* Sums values[0..size-1] with num_threads new threads and a barrier. */
+long barrier_sum( long *values, long size, int num_threads )
+{
+    int         retval;
+    int         t;
+    pthread_t   *threads;
+    task_data   *thread_data;
+    long        sum;
+
+    threads     = calloc( num_threads, sizeof(pthread_t));
+    thread_data = calloc( num_threads, sizeof(task_data));
+    partial_sum = calloc( num_threads, sizeof(long));
+    if ( threads == NULL || thread_data == NULL || partial_sum == NULL )
+        fatal_error(errno, "calloc");
+
+    pthread_barrier_init(&barrier, NULL, num_threads);
+    for ( t = 0 ; t < num_threads; t++) {
+        thread_data[t].first       = (t*size)/num_threads;
+        thread_data[t].last        = ((t+1)*size)/num_threads -1;
+        thread_data[t].task_id     = t;
+        thread_data[t].num_threads = num_threads;
+        thread_data[t].data        = values;
+        retval = pthread_create(&threads[t], NULL, sum_reduce,
+                            (void *) &thread_data[t]);
+        if ( retval )
+            fatal_error(retval, " pthread_create");
+    }
+    for ( t = 0 ; t < num_threads; t++)
+        pthread_join(threads[t], (void**) NULL);
+    pthread_barrier_destroy(&barrier);
+    sum = partial_sum[0];
+    free ( threads );
+    free ( thread_data );
+    free ( partial_sum );
+    return sum;
+}
+
+/* Returns the number of threads after t: twice t, but not more than max,
+   or 0 if t is max.                                                   */
+int next_count( int t, int max )
+{
+    if ( t == max )
+        return 0;
+    return ( t <= max / 2 ) ? 2 * t : max;
+}
+
+int main( int argc, char *argv[])
+{
+    int    ch;
+    char   options[] = ":n:r:t:";
+    int    array_size  = 16 * 1024 * 1024;
+    int    reps        = 20;
+    int    max_threads = 64;
+    long  *data;
+    long   expected = 0, sum;
+    double barrier_time, pool_time, barrier_base = 0, pool_base = 0;
+    struct timespec start;
+    reduce_pool *pool;
+
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt(argc, argv, options);
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'n':
+            if ( VALID_NUMBER != get_int(optarg, POS_ONLY, &array_size, NULL))
+                usage_error("Invalid argument to -n");
+            break;
+        case 'r':
+            if ( VALID_NUMBER != get_int(optarg, POS_ONLY, &reps, NULL) )
+                usage_error("Invalid argument to -r");
+            break;
+        case 't':
+            if ( VALID_NUMBER != get_int(optarg, POS_ONLY, &max_threads, NULL))
+                usage_error("Invalid argument to -t");
+            break;
+        default:
+            usage_error("reduce_bench [-n array_size] [-r repetitions] "
+                        "[-t max_threads]");
+        }
+    }
+
+    if ( NULL == (data = malloc(array_size * sizeof(long))) )
+        fatal_error(errno, "malloc");
+    for ( long i = 0; i < array_size; i++ ) {
+        data[i] = i % 1000;
+        expected += data[i];
+    }
+
+    printf("Summing %d longs, mean of %d runs\n", array_size, reps);
+    printf("%8s  %12s %8s  %12s %8s\n", "threads", "barrier(ms)", "speedup",
+           "pool(ms)", "speedup");
+    /* The number of threads doubles from row to row, and the last row is
+       for max_threads even if it is not a power of 2. */
+    for ( int t = 1; t > 0; t = next_count(t, max_threads) ) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for ( int r = 0; r < reps; r++ )
+            if ( expected != (sum = barrier_sum(data, array_size, t)) )
+                fatal_error(-1, "barrier sum is incorrect");
+        barrier_time = elapsed(start) / reps;
+
+        if ( NULL == (pool = reduce_pool_create(t)) )
+            fatal_error(errno, "reduce_pool_create");
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for ( int r = 0; r < reps; r++ )
+            if ( expected != (sum = parallel_reduce(pool, data, array_size,
+                                                    REDUCE_SUM)) )
+                fatal_error(-1, "pool sum is incorrect");
+        pool_time = elapsed(start) / reps;
+        reduce_pool_destroy(pool);
+
+        if ( t == 1 ) {
+            barrier_base = barrier_time;
+            pool_base    = pool_time;
+        }
+        printf("%8d  %12.3f %8.2f  %12.3f %8.2f\n", t,
+               1000 * barrier_time, barrier_base / barrier_time,
+               1000 * pool_time, pool_base / pool_time);
+    }
+    free(data);
+    return 0;
+}
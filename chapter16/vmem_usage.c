@@ -2,12 +2,36 @@
   Title          : vmem_usage.c
   Author         : Stewart Weiss
   Created on     : June 28, 2024
-  Description    : Prints the sum of virtual memory usage of all processes
-  Purpose        : To show how to use barrier synchronization in a
-                    multithreaded program.
+  Description    : Reports the memory usage of all processes, in total and
+                   grouped by user and by command
+  Purpose        : To show how to organize a multithreaded program as a
+                   pipeline of producers feeding a single consumer.
   Build with     : gcc -Wall -g -I../include -L../lib -o vmem_usage \
                    vmem_usage.c -lspl -pthread -lrt
-  Usage          : vmem_usage
+  Usage          : vmem_usage num_threads
+
+  Notes:
+  Reading the /proc files of every process is by far the most expensive
+  part of this program, so that is the work that is divided among threads.
+  num_threads reader threads take process IDs from a shared list, read
+  each process's stat file and smaps_rollup file, and put a record of its
+  virtual size (VSZ), resident set size (RSS), and proportional set size
+  (PSS) into a bounded buffer, in batches to reduce contention for the
+  buffer's mutex. The main thread is the only consumer. It removes the
+  batches from the buffer and adds every record into the totals and into
+  two hash tables, one keyed by user and one by command name.
+
+  PSS can only be read for processes whose smaps_rollup file the user may
+  read; unless run by root, PSS is therefore a lower bound, and the number
+  of processes for which it was unavailable is reported.
+
+  Modifications  : October 2026
+                   Replaced the sequential gathering of virtual sizes,
+                   which leaked a FILE stream per process, and the barrier
+                   reduction that followed it with a reader/reducer
+                   pipeline, and added RSS, PSS, and the per-user and
+                   per-command reports. reduce_bench.c in this directory
+                   retains the barrier reduction.
 
 ******************************************************************************
 * Copyright (C) 2024 - Stewart Weiss                                         *
@@ -23,63 +47,187 @@
 #include "common_hdrs.h"
 #include <dirent.h>
 #include <pthread.h>
+#include "ps_utils.h"
 
-#define MAX_LINE    512
+#define   BATCH_SIZE       64    /* Records per batch in the buffer     */
+#define   BUFFER_SIZE      16    /* Batches the buffer can hold         */
+#define   COMM_LEN         16    /* Length of comm in the kernel        */
+#define   INITIAL_GROUPS   64    /* Initial size of each hash table     */
+#define   ROLLUP_SIZE      2048  /* Large enough for smaps_rollup       */
 
-long       *partial_sum;  /* array of partial sums of data           */
-long       *vmsizes;      /* dynamically allocated array of data     */
-pthread_barrier_t barrier; /* Barrier for threads to synchronize     */
+/*----------------------------------------------------------------------------
+                                 Data Types
+----------------------------------------------------------------------------*/
 
-/* Data structure passed to each thread start function */
-typedef struct _task_data
+/* The memory usage of one process, in KB. pss is -1 if unavailable. */
+typedef struct
 {
-    int first;       /* Index of first element for thread */
-    int last;        /* index of last element for thread  */
-    int task_id;     /* Thread's program ID               */
-    int num_threads; /* Total number of threads           */
-    long *data;
-} task_data;
+    uid_t  uid;
+    char   comm[COMM_LEN + 1];
+    long   vsz;
+    long   rss;
+    long   pss;
+} proc_record;
+
+typedef struct
+{
+    int          count;
+    proc_record  rec[BATCH_SIZE];
+} batch;
 
+/* The sums for one user or one command. */
+typedef struct
+{
+    char   key[COMM_LEN + 1];   /* Command name, or uid in decimal       */
+    long   nprocs;
+    long   vsz;
+    long   rss;
+    long   pss;
+    BOOL   in_use;
+} group;
+
+typedef struct
+{
+    group  *slots;
+    int     size;               /* Always a power of 2                   */
+    int     count;
+} group_table;
+
+/*----------------------------------------------------------------------------
+                                Global, Shared Data
+----------------------------------------------------------------------------*/
+
+struct dirent  **namelist;      /* The /proc/[pid] directories           */
+int              numprocs;
+int              next_proc = 0; /* Index of next entry to be read        */
+pthread_mutex_t  next_mutex       = PTHREAD_MUTEX_INITIALIZER;
+
+pthread_mutex_t  buf_mutex        = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t   space_available  = PTHREAD_COND_INITIALIZER;
+pthread_cond_t   data_available   = PTHREAD_COND_INITIALIZER;
+int              reader_count;  /* Readers still running                 */
+long             page_kb;       /* Page size in KB                       */
+
+/*----------------------------------------------------------------------------
+                                Buffer Object
+----------------------------------------------------------------------------*/
+
+batch  *buffer[BUFFER_SIZE];
+int     buf_count = 0;          /* number of full elements */
+int     front     = 0;
+int     rear      = 0;
+
+void add_buffer( batch *b )
+{
+    buffer[rear] = b;
+    rear = (rear + 1) % BUFFER_SIZE;
+    buf_count++;
+}
 
-/* Extracts the value of vm size from line in /proc/[pid]/stat file.        */
-void extract_vmsize_from_buffer(char* buf, long int *vsize)
+batch* get_buffer()
 {
-    sscanf(buf, " %*d %*s %*c %*d  %*d " /* pid, comm, state, ppid, pgrp    */
-                " %*d %*d "         /* session, tty_nr                      */
-                " %*d %*u %*u "     /* skipping tty_pgrp, flags, min_flt    */
-                " %*u  %*u %*u "    /* skipping cmin_flt, maj_flt, cmaj_flt */
-                " %*u %*u "         /* utime, stime,                        */
-                " %*d %*d "         /* skipping cutime, cstime              */
-                " %*d %*d "         /* priority, nice                       */
-                " %*d %*d "         /* skipping num_threads, alarm          */
-                " %*u %lu",         /* start_time, vsize                    */
-                                    /* skipping everything after vsize      */
-            vsize );
+    batch *b = buffer[front];
+    front = (front + 1) % BUFFER_SIZE;
+    buf_count--;
+    return b;
 }
 
-/* Gets the virtual memory size in /proc/[pid]/stat and stores in vmdata[i].*/
-void get_vmsize( const struct dirent *direntp, int i, long *vmdata )
+/*----------------------------------------------------------------------------
+                                Group-by Tables
+----------------------------------------------------------------------------*/
+
+/* The FNV-1a hash of the string s. */
+unsigned long hash_key( const char *s )
 {
-    char    pathname[PATH_MAX];   /* Pathname to file to open               */
-    size_t  len = MAX_LINE;       /* Length of line getline() returned      */
-    FILE*   fp;                   /* File stream to read                    */
-    char*   buf;
-    long int vsize;
+    unsigned long h = 14695981039346656037UL;
+    while ( *s ) {
+        h ^= (unsigned char) *s++;
+        h *= 1099511628211UL;
+    }
+    return h;
+}
 
-    if ( NULL == (buf = calloc(MAX_LINE, 1)))/*Allocate buffer for getline()*/
+void init_groups( group_table *t, int size )
+{
+    t->size  = size;
+    t->count = 0;
+    if ( NULL == (t->slots = calloc(size, sizeof(group))) )
         fatal_error(errno, "calloc");
+}
 
-    memset(pathname, '\0', PATH_MAX);
-    sprintf(pathname, "/proc/%s/stat",direntp->d_name);
-    if ( NULL == (fp = fopen(pathname, "r") ))
-        fatal_error(errno, "fopen");     /* Error opening stat file */
-    if ( -1 == getline(&buf,&len, fp ) )
-        fatal_error(errno, "getline()");
-    extract_vmsize_from_buffer(buf, &vsize);
-    vmdata[i] = vsize/1024;               /* Convert to KB */
-    free(buf);
+/* Returns the group for key in t, creating it if it doesn't exist. The
+   table is doubled whenever it becomes half full, so probes are short. */
+group* find_group( group_table *t, const char *key )
+{
+    group_table  bigger;
+    unsigned int i;
+
+    if ( t->count >= t->size / 2 ) {
+        init_groups(&bigger, 2 * t->size);
+        for ( i = 0; i < t->size; i++ )
+            if ( t->slots[i].in_use )
+                *find_group(&bigger, t->slots[i].key) = t->slots[i];
+        free(t->slots);
+        *t = bigger;
+    }
+    i = hash_key(key) & (t->size - 1);
+    while ( t->slots[i].in_use && strcmp(t->slots[i].key, key) != 0 )
+        i = (i + 1) & (t->size - 1);
+    if ( ! t->slots[i].in_use ) {
+        memset(&t->slots[i], 0, sizeof(group));
+        strcpy(t->slots[i].key, key);
+        t->slots[i].in_use = TRUE;
+        t->count++;
+    }
+    return &t->slots[i];
+}
+
+void add_to_group( group *g, proc_record *r )
+{
+    g->nprocs++;
+    g->vsz += r->vsz;
+    g->rss += r->rss;
+    if ( r->pss >= 0 )
+        g->pss += r->pss;
+}
+
+/* Sorts groups by decreasing PSS, then by decreasing RSS. */
+int groupcmp( const void *a, const void *b )
+{
+    const group *g1 = a, *g2 = b;
+    if ( g1->pss != g2->pss )
+        return ( g2->pss > g1->pss ) ? 1 : -1;
+    if ( g1->rss != g2->rss )
+        return ( g2->rss > g1->rss ) ? 1 : -1;
+    return strcmp(g1->key, g2->key);
+}
+
+/* Prints the groups of t, largest first. If by_user, keys are uids. */
+void print_groups( group_table *t, const char *heading, BOOL by_user )
+{
+    int   i, n = 0;
+    char *name;
+
+    for ( i = 0; i < t->size; i++ )
+        if ( t->slots[i].in_use )
+            t->slots[n++] = t->slots[i];
+    qsort(t->slots, n, sizeof(group), groupcmp);
+
+    printf("\n%-16s %6s %12s %12s %12s\n", heading, "NPROC", "VSZ(KB)",
+           "RSS(KB)", "PSS(KB)");
+    for ( i = 0; i < n; i++ ) {
+        name = t->slots[i].key;
+        if ( by_user && '\0' == *(name = uid2name(atoi(t->slots[i].key))) )
+            name = t->slots[i].key;
+        printf("%-16s %6ld %12ld %12ld %12ld\n", name, t->slots[i].nprocs,
+               t->slots[i].vsz, t->slots[i].rss, t->slots[i].pss);
+    }
 }
 
+/*----------------------------------------------------------------------------
+                            Reading Process Data
+----------------------------------------------------------------------------*/
+
 /* Selects directories whose names are strictly numeric. */
 int numeric_dir_filter(  const struct dirent *direntp)
 {
@@ -91,112 +239,115 @@ int numeric_dir_filter(  const struct dirent *direntp)
         return 0;
 }
 
-/* Creates an array containing the virtual memory sizes of all processes. */
-void get_all_vmsizes(long **array, long *n)
+/* Fills r with the memory usage of process pid. Returns 0 if the process
+   has terminated, else 1. */
+int read_record( pid_t pid, proc_record *r )
 {
-    struct dirent **namelist;
-    long i = 0;
-
-    errno = 0;
-    if ( ((*n) = scandir("/proc", &namelist, numeric_dir_filter, NULL) ) < 0)
-        fatal_error(errno, "scandir");
+    char          buf[ROLLUP_SIZE];
+    char          pathname[32];
+    char         *open_paren, *close_paren, *line;
+    struct stat   statbuffer;
+    unsigned long vsize;
+    long          rss_pages;
+    size_t        len;
+
+    sprintf(pathname, "/proc/%d", pid);
+    if ( -1 == stat(pathname, &statbuffer) )
+        return 0;
+    r->uid = statbuffer.st_uid;
 
-    *array = (long*) calloc((*n), sizeof(long));
-    if ( *array == NULL )
-        fatal_error(errno, "malloc");
-    while (i < (*n) - 1) {
-        get_vmsize(namelist[i], i, *array );
-        free(namelist[i]);
-        i++;
+    if ( -1 == read_proc_file(pid, "stat", buf, sizeof(buf)) )
+        return 0;
+    /* The command name is between the first '(' and the last ')'. */
+    if ( NULL == (open_paren = strchr(buf, '(')) ||
+         NULL == (close_paren = strrchr(buf, ')')) )
+        return 0;
+    len = close_paren - open_paren - 1;
+    if ( len > COMM_LEN )
+        len = COMM_LEN;
+    memcpy(r->comm, open_paren + 1, len);
+    r->comm[len] = '\0';
+    if ( 2 != sscanf(close_paren + 1,
+                " %*c %*d %*d "     /* state, ppid, pgrp                    */
+                " %*d %*d "         /* session, tty_nr                      */
+                " %*d %*u %*u "     /* skipping tty_pgrp, flags, min_flt    */
+                " %*u  %*u %*u "    /* skipping cmin_flt, maj_flt, cmaj_flt */
+                " %*u %*u "         /* utime, stime,                        */
+                " %*d %*d "         /* skipping cutime, cstime              */
+                " %*d %*d "         /* priority, nice                       */
+                " %*d %*d "         /* skipping num_threads, alarm          */
+                " %*u %lu %ld",     /* start_time, vsize, rss               */
+                &vsize, &rss_pages) )
+        return 0;
+    r->vsz = vsize / 1024;
+    r->rss = rss_pages * page_kb;
+
+    /* A kernel thread has no memory map, so its PSS is 0 even though its
+       smaps_rollup file cannot be read. */
+    r->pss = ( vsize == 0 ) ? 0 : -1;
+    if ( vsize != 0 &&
+         -1 != read_proc_file(pid, "smaps_rollup", buf, sizeof(buf)) ) {
+        r->pss = 0;
+        if ( NULL != (line = strstr(buf, "\nPss:")) )
+            sscanf(line, "\nPss: %ld", &r->pss);
     }
-    free(namelist);
+    return 1;
 }
 
-
-/* Thread start function --- adds the elements of thread_data->data. */
-void  *sum_reduce( void * thread_data )
+/* Reader thread start function. Takes processes from namelist until none
+   are left and puts their records into the buffer in batches. */
+void *reader( void *data )
 {
-    int   half;
-    int   retval;
-
-    task_data *t_data  = (task_data*) thread_data;
-    int tid            = t_data->task_id;
-
-    partial_sum[tid] = 0;
-    for ( int k = t_data->first; k <= t_data->last; k++ )
-        partial_sum[tid] += t_data->data[k];
-
-    half = t_data->num_threads;
-    while ( half > 1 ) {
-        retval = pthread_barrier_wait(&barrier);
-        if ( PTHREAD_BARRIER_SERIAL_THREAD != retval &&
-             0 != retval )
-           pthread_exit((void*) 0);
-
-        if ( half % 2 == 1 && tid == 0 )
-            partial_sum[0] +=  partial_sum[half-1];
-        half = half/2; // integer division
-        if ( tid < half )
-            partial_sum[tid] +=  partial_sum[tid+half];
+    batch *b = NULL;
+    int    i;
+
+    while ( TRUE ) {
+        pthread_mutex_lock(&next_mutex);
+        i = next_proc++;
+        pthread_mutex_unlock(&next_mutex);
+
+        if ( b == NULL && NULL == (b = calloc(1, sizeof(batch))) )
+            fatal_error(errno, "calloc");
+        if ( i < numprocs &&
+             read_record(atoi(namelist[i]->d_name), &b->rec[b->count]) )
+            b->count++;
+
+        if ( b->count == BATCH_SIZE || (i >= numprocs && b->count > 0) ) {
+            pthread_mutex_lock(&buf_mutex);
+            while ( BUFFER_SIZE == buf_count )
+                pthread_cond_wait(&space_available, &buf_mutex);
+            add_buffer(b);
+            pthread_cond_signal(&data_available);
+            pthread_mutex_unlock(&buf_mutex);
+            b = NULL;
+        }
+        if ( i >= numprocs )
+            break;
     }
-    pthread_exit((void*) 0);
-
-}
-
-/* Compute the sum of values[0]...values[size-1] with num_threads threads. */
-long compute_sum( long *values, int size, int num_threads )
-{
-    int         retval;
-    int         t;
-    pthread_t   *threads;
-    task_data   *thread_data;
-    pthread_attr_t attr;
-    long        sum;
-
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    free(b);
 
-   /* Allocate the array of threads, task_data structures, data and sums */
-    threads     = calloc( num_threads, sizeof(pthread_t));
-    thread_data = calloc( num_threads, sizeof(task_data));
-    partial_sum = calloc( num_threads, sizeof(double));
-
-    if ( threads == NULL || thread_data == NULL || partial_sum == NULL )
-        fatal_error(errno, "calloc");
-
-    /* Initialize a barrier with a count equal to the number of threads. */
-    pthread_barrier_init(&barrier, NULL, num_threads);
-
-    for ( t = 0 ; t < num_threads; t++) {
-        thread_data[t].first     = (t*size)/num_threads;
-        thread_data[t].last      = ((t+1)*size)/num_threads -1;
-        thread_data[t].task_id   = t;
-        thread_data[t].num_threads = num_threads;
-        thread_data[t].data      = values;
-        retval = pthread_create(&threads[t], &attr, sum_reduce,
-                            (void *) &thread_data[t]);
-        if ( retval )
-            fatal_error(retval, " pthread_create");
-    }
-    /* Join all threads so that we can add up their partial sums */
-    for ( t = 0 ; t < num_threads; t++) {
-        pthread_join(threads[t], (void**) NULL);
-    }
-    pthread_barrier_destroy(&barrier);
-    sum = partial_sum[0];
-    free ( threads );
-    free ( thread_data );
-    free ( partial_sum );
-    return ( sum);
+    pthread_mutex_lock(&buf_mutex);
+    reader_count--;
+    pthread_cond_signal(&data_available);   /* The consumer may be waiting */
+    pthread_mutex_unlock(&buf_mutex);
+    pthread_exit(NULL);
 }
 
+/*----------------------------------------------------------------------------
+                                   Main Program
+----------------------------------------------------------------------------*/
 
 int main( int argc, char *argv[])
 {
-    long        array_size;
-    long        sum;
-    int         retval;
-    int         num_threads; /* number of threads this program will use */
+    int          retval;
+    int          num_threads; /* number of threads this program will use */
+    pthread_t   *threads;
+    batch       *b;
+    group_table  by_user, by_comm;
+    group        total;
+    proc_record *r;
+    char         key[COMM_LEN + 1];
+    long         no_pss = 0;
 
     if ( argc < 2 )
         usage_error("this prog num_threads");
@@ -208,10 +359,62 @@ int main( int argc, char *argv[])
     if ( 0 >= num_threads  )
         fatal_error(-1, "Negative number of threads");
 
-    get_all_vmsizes(&vmsizes, &array_size);
+    page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    errno = 0;
+    if ( (numprocs = scandir("/proc", &namelist, numeric_dir_filter, NULL)) < 0)
+        fatal_error(errno, "scandir");
+
+    if ( NULL == (threads = calloc(num_threads, sizeof(pthread_t))) )
+        fatal_error(errno, "calloc");
+    reader_count = num_threads;
+    for ( int t = 0; t < num_threads; t++ )
+        if ( 0 != (retval = pthread_create(&threads[t], NULL, reader, NULL)) )
+            fatal_error(retval, "pthread_create");
+
+    /* The main thread is the reducer. */
+    init_groups(&by_user, INITIAL_GROUPS);
+    init_groups(&by_comm, INITIAL_GROUPS);
+    memset(&total, 0, sizeof(group));
+    while ( TRUE ) {
+        pthread_mutex_lock(&buf_mutex);
+        while ( 0 == buf_count && reader_count > 0 )
+            pthread_cond_wait(&data_available, &buf_mutex);
+        if ( 0 == buf_count ) {           /* All readers have finished. */
+            pthread_mutex_unlock(&buf_mutex);
+            break;
+        }
+        b = get_buffer();
+        pthread_cond_signal(&space_available);
+        pthread_mutex_unlock(&buf_mutex);
+
+        for ( int k = 0; k < b->count; k++ ) {
+            r = &b->rec[k];
+            add_to_group(&total, r);
+            sprintf(key, "%u", r->uid);
+            add_to_group(find_group(&by_user, key), r);
+            add_to_group(find_group(&by_comm, r->comm), r);
+            if ( r->pss < 0 )
+                no_pss++;
+        }
+        free(b);
+    }
 
-    sum = compute_sum(vmsizes, array_size, num_threads);
-    printf("%-10ld KB\n", sum);
-    free ( vmsizes );
+    for ( int t = 0; t < num_threads; t++ )
+        pthread_join(threads[t], NULL);
+
+    printf("%-10ld KB\n", total.vsz);
+    printf("%ld processes: VSZ %ld KB, RSS %ld KB, PSS %ld KB\n",
+           total.nprocs, total.vsz, total.rss, total.pss);
+    if ( no_pss > 0 )
+        printf("PSS was unavailable for %ld processes.\n", no_pss);
+    print_groups(&by_user, "USER", TRUE);
+    print_groups(&by_comm, "COMMAND", FALSE);
+
+    for ( int i = 0; i < numprocs; i++ )
+        free(namelist[i]);
+    free(namelist);
+    free(threads);
+    free(by_user.slots);
+    free(by_comm.slots);
     return 0;
 }
@@ -4,10 +4,17 @@
   Created on     : August 1, 2024
   Description    : Monitors progress of aio writes
   Purpose        : To show an example of the aio_error(0 and aio_write()
-  Usage          : cp_aio targetfile
+  Usage          : aio_write_demo [-d durability] targetfile
   Build with     : gcc -Wall -g -I../include -L ../lib -lspl \
                    -o aio_write_demo  aio_write_demo.c
 
+  Notes:
+  A completed aio_write() means only that the data is in the page cache.
+  -d says how to make it durable: none (the default), fsync,
+  fdatasync[:MB], dsync, or sync_range[:MB], as described in
+  durability.h in libspl. With dsync, each write completes only when its
+  data is on the device.
+
 ******************************************************************************
 * Copyright (C) 2024 - Stewart Weiss                                         *
 *                                                                            *
@@ -23,6 +30,7 @@
 #include "common_hdrs.h"
 #include <aio.h>
 #include <fcntl.h>
+#include "durability.h"
 
 
 #define BUFFER_SIZE      64
@@ -54,12 +62,25 @@ int main(int argc, char *argv[])
     struct stat  st;
     int total_bytes = 0;
     struct timespec ts;
+    int     ch;
+    durability  dur;
+
+    durability_init(&dur, DURABLE_NONE, 0);
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt(argc, argv, ":d:");
+        if ( -1 == ch )
+            break;
+        if ( ch != 'd' || -1 == parse_durability(optarg, &dur) )
+            usage_error("aio_write_demo [-d durability] destination");
+    }
 
     /* Check for correct usage.                                             */
-    if ( argc != 2 ){
-        sprintf(message,"%s destination", basename(argv[0]));
+    if ( argc - optind != 1 ){
+        sprintf(message,"%s [-d durability] destination", basename(argv[0]));
         usage_error(message);
     }
+    argv += optind - 1;  /* So that argv[1] is the target, as before. */
 
     /* Set up signal handling  */
     sigact.sa_sigaction = on_output;
@@ -76,8 +97,8 @@ int main(int argc, char *argv[])
         fatal_error(errno, "read");
 
     /* Open target file for writing.                                        */
-    if ( (target_fd = open( argv[1], O_WRONLY|O_CREAT|O_TRUNC| O_APPEND,
-                            permissions) ) == -1 ) {
+    if ( (target_fd = open( argv[1], O_WRONLY|O_CREAT|O_TRUNC| O_APPEND|
+                            durable_open_flags(&dur), permissions) ) == -1 ) {
         sprintf(message, "unable to open %s for writing", argv[1]);
         fatal_error(errno, message);
     }
@@ -106,6 +127,9 @@ int main(int argc, char *argv[])
               num_bytes_written = aio_return(&aio_block);
 
               if ( num_bytes_written >= 1 ) {
+                  if ( -1 == durable_wrote(target_fd, &dur, total_bytes,
+                                           num_bytes_written) )
+                      fatal_error(errno, "sync");
                   total_bytes += num_bytes_written;
                   printf("Bytes written = %d\n", num_bytes_written);
                   if ( total_bytes < num_bytes_read)  {
@@ -135,7 +159,9 @@ int main(int argc, char *argv[])
          }
       }
 
-    /* Close file.                                                       */
+    /* Make the file durable as -d says, then close it.                  */
+    if ( -1 == durable_finish(target_fd, &dur) )
+        fatal_error(errno, "sync");
     if ( close(target_fd) == -1 ) {
         sprintf(message, "error closing target file %s", argv[2]);
         fatal_error(errno, "error closing target file");
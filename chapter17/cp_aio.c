@@ -2,11 +2,32 @@
   Title          : cp_aio.c
   Author         : Stewart Weiss
   Created on     : August 1, 2023
-  Description    : Copies a file with asynchronous reads & synchronous writes
+  Description    : Copies a file with asynchronous reads and writes
   Purpose        : To show an example of the POSIX AIO API
-  Usage          : cp_aio sourcefile targetfile
-  Build with     : gcc -Wall -g -I../include -L ../lib -lspl \
-                   -o cp_aio  cp_aio.c
+  Usage          : cp_aio [-v] [-k depth] [-b blocksize] sourcefile \
+                          targetfile
+  Build with     : gcc -Wall -g -I../include -L ../lib -o cp_aio  cp_aio.c \
+                   -lspl -lrt
+
+  Notes:
+  The source is divided into blocks of blocksize bytes (default 128 KB),
+  and a ring of depth control blocks (default 16) is used to keep up to
+  depth requests in flight at once, both reads and writes. Block b always
+  uses control block b % depth, which it gives up when its write has
+  completed, so the ring never holds more than depth blocks.
+
+  The program waits in aio_suspend() until one of the requests in flight
+  completes, and then checks each of them with aio_error(). A completed
+  read does not start its write right away. Writes are started in order
+  of their offsets, so that the target file grows from beginning to end,
+  as it would with write().
+
+  A short read or write is continued with a request for the rest of the
+  block. The source must be a regular file, because its size is used to
+  divide it into blocks.
+
+  With -v it prints the number of bytes copied and the rate in MB/s (2^20
+  bytes per second).
 
 ******************************************************************************
 * Copyright (C) 2024 - Stewart Weiss                                         *
@@ -24,121 +45,202 @@
 #include <aio.h>
 #include <fcntl.h>
 
-#define BUFFER_SIZE    4096
+#define DEFAULT_DEPTH  16
+#define DEFAULT_BLOCK  (128*1024)
 #define MESSAGE_SIZE   512
-#define PERMISSIONS    S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH  /*rw-rw-r-- */
-volatile sig_atomic_t  input_ready = 0;
+#define MB             1048576.0
 
-/* The signal handler for SIGIO */
-void on_input(int sig, siginfo_t *si, void *ucontext)
-{
-    input_ready = 1;
-}
+#define USAGE "cp_aio [-v] [-k depth] [-b blocksize] source target"
 
-void setup_handler()
-{
-    struct  sigaction sigact;
+/* The states of a slot of the ring */
+typedef enum { IDLE, READING, READ_DONE, WRITING } slot_state;
 
-    sigact.sa_sigaction = on_input;
-    sigact.sa_flags = SA_RESTART | SA_SIGINFO;
-    sigemptyset(&sigact.sa_mask);
-    if ( sigaction(SIGIO, &sigact, NULL) == -1 )
-        fatal_error(errno, "sigaction");
+/* A slot of the ring: the control block and buffer for one block, and how
+   much of the block has been transferred by the current operation.      */
+typedef struct
+{
+    struct aiocb  cb;
+    slot_state    state;
+    off_t         offset;   /* Offset of the block in the file   */
+    size_t        len;      /* Length of the block               */
+    size_t        done;     /* Bytes read or written so far      */
+    char         *buf;
+} slot;
+
+/* Starts a read or write, as op says, of the part of the block in s that
+   has not yet been transferred.                                         */
+void start_io( slot *s, int fd, slot_state op )
+{
+    s->state                     = op;
+    s->cb.aio_fildes             = fd;
+    s->cb.aio_buf                = s->buf + s->done;
+    s->cb.aio_nbytes             = s->len - s->done;
+    s->cb.aio_offset             = s->offset + s->done;
+    s->cb.aio_sigevent.sigev_notify = SIGEV_NONE;
+    if ( op == READING ) {
+        if ( -1 == aio_read(&s->cb) )
+            fatal_error(errno, "aio_read");
+    }
+    else if ( -1 == aio_write(&s->cb) )
+        fatal_error(errno, "aio_write");
 }
 
 int main(int argc, char *argv[])
 {
+    int     ch;
+    char    options[] = ":b:k:v";
     int     source_fd;
     int     target_fd;
-    int     num_bytes_read;
-    int     num_bytes_written;
-    mode_t  permissions = PERMISSIONS;
-    int     i = 0;
-    char    *buf[2];
-    char    *writebuf;
+    int     depth = DEFAULT_DEPTH;
+    long    blocksize = DEFAULT_BLOCK;
+    BOOL    verbose = FALSE;
     char    message[MESSAGE_SIZE];
-    struct  aiocb  aio_block;
-
-
-    /* Check for correct usage.                                             */
-    if ( argc != 3 ){
-        sprintf(message,"%s source destination", basename(argv[0]));
-        usage_error(message);
+    struct  stat   sb;
+    struct  aioinit init;
+    slot   *ring;
+    const struct aiocb **in_flight;
+    long    num_blocks;
+    long    next_read = 0;    /* Next block to read            */
+    long    next_write = 0;   /* Next block to write           */
+    long    num_written = 0;  /* Blocks completely written     */
+    ssize_t n;
+    struct  timespec start, finish;
+    double  secs;
+
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt(argc, argv, options);
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'b':
+            if ( VALID_NUMBER != get_long(optarg, POS_ONLY, &blocksize, NULL) )
+                usage_error("Invalid argument to -b");
+            break;
+        case 'k':
+            if ( VALID_NUMBER != get_int(optarg, POS_ONLY, &depth, NULL) )
+                usage_error("Invalid argument to -k");
+            break;
+        case 'v':
+            verbose = TRUE;
+            break;
+        default:
+            usage_error(USAGE);
+        }
     }
-
-    /* Set up signal handling  */
-    setup_handler();
+    if ( argc - optind != 2 )
+        usage_error(USAGE);
 
     /* Open source file for reading.                                        */
-    if ( (source_fd = open(argv[1], O_RDONLY)) == -1 ) {
-        sprintf(message, "unable to open %s for reading", argv[1]);
+    if ( (source_fd = open(argv[optind], O_RDONLY)) == -1 ) {
+        sprintf(message, "unable to open %s for reading", argv[optind]);
         fatal_error(errno, message);
     }
+    if ( -1 == fstat(source_fd, &sb) )
+        fatal_error(errno, "fstat");
+    if ( !S_ISREG(sb.st_mode) )
+        fatal_error(-1, "the source must be a regular file");
 
     /* Open target file for writing.                                        */
-    if ( (target_fd = open( argv[2], O_WRONLY|O_CREAT|O_TRUNC,
-                            permissions) ) == -1 ) {
-        sprintf(message, "unable to open %s for writing", argv[2]);
+    if ( (target_fd = open( argv[optind+1], O_WRONLY|O_CREAT|O_TRUNC,
+                            sb.st_mode & 0777) ) == -1 ) {
+        sprintf(message, "unable to open %s for writing", argv[optind+1]);
         fatal_error(errno, message);
     }
 
-    if ( (NULL == (buf[0] = calloc(BUFFER_SIZE,1)))
-         || (NULL == (buf[1] = calloc(BUFFER_SIZE,1))) )
+    /* glibc carries out the requests with threads; allow one per request. */
+    memset(&init, 0, sizeof(init));
+    init.aio_threads = depth;
+    init.aio_num     = depth;
+    aio_init(&init);
+
+    ring      = calloc(depth, sizeof(slot));
+    in_flight = calloc(depth, sizeof(struct aiocb*));
+    if ( ring == NULL || in_flight == NULL )
         fatal_error(errno, "calloc");
+    for ( int i = 0; i < depth; i++ )
+        if ( NULL == (ring[i].buf = malloc(blocksize)) )
+            fatal_error(errno, "malloc");
+
+    num_blocks = (sb.st_size + blocksize - 1) / blocksize;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while ( num_written < num_blocks ) {
+        /* Start reading every block that has a free slot. */
+        while ( next_read < num_blocks &&
+                ring[next_read % depth].state == IDLE ) {
+            slot *s   = &ring[next_read % depth];
+            s->offset = next_read * blocksize;
+            s->len    = ( sb.st_size - s->offset < blocksize ) ?
+                        sb.st_size - s->offset : blocksize;
+            s->done   = 0;
+            start_io(s, source_fd, READING);
+            next_read++;
+        }
+
+        /* Start the writes that are next in order and have been read. */
+        while ( next_write < next_read &&
+                ring[next_write % depth].state == READ_DONE ) {
+            slot *s = &ring[next_write % depth];
+            s->done = 0;
+            start_io(s, target_fd, WRITING);
+            next_write++;
+        }
 
-    memset(&aio_block, 0, sizeof(aio_block));
-    aio_block.aio_buf     = buf[0];
-    aio_block.aio_fildes  = source_fd;
-    aio_block.aio_nbytes  = BUFFER_SIZE;
-    aio_block.aio_reqprio = 0;
-    aio_block.aio_offset  = 0;
-    aio_block.aio_sigevent.sigev_notify = SIGEV_SIGNAL;
-    aio_block.aio_sigevent.sigev_signo  = SIGIO;
-
-    if ( -1 == aio_read(&aio_block))
-        fatal_error(errno, "aio_read");
-
-    BOOL done = FALSE;
-    while ( !done ){
-        if ( input_ready ) {
-            input_ready = 0;
-            num_bytes_read = aio_return(&aio_block);
-            if ( num_bytes_read > 0 ) {
-                writebuf = (char*) aio_block.aio_buf;
-                i = i^1;
-                aio_block.aio_buf     = buf[i];
-                aio_block.aio_offset += num_bytes_read;
-                if ( -1 == aio_read(&aio_block))
-                    fatal_error(errno, "aio_read");
-                num_bytes_written = write( target_fd, writebuf, num_bytes_read ) ;
-                if ( errno == EINTR )
-                   printf("write() was interrupted by read completion\n");
-                else if ( errno != 0 ) /* Some other error */
-                    fatal_error(errno, "write()");
-                else /* Successful write; check if all bytes were written.*/
-                    if ( num_bytes_written  != num_bytes_read) {
-                        sprintf(message,"write error to %s\n", argv[2]);
-                        fatal_error(-1, message);
-                    }
+        /* Wait for at least one request to complete. */
+        for ( int i = 0; i < depth; i++ )
+            in_flight[i] = ( ring[i].state == READING ||
+                             ring[i].state == WRITING ) ? &ring[i].cb : NULL;
+        if ( -1 == aio_suspend(in_flight, depth, NULL) && errno != EINTR )
+            fatal_error(errno, "aio_suspend");
+
+        for ( int i = 0; i < depth; i++ ) {
+            slot *s = &ring[i];
+            if ( in_flight[i] == NULL || aio_error(&s->cb) == EINPROGRESS )
+                continue;
+            if ( -1 == (n = aio_return(&s->cb)) )
+                fatal_error(aio_error(&s->cb),
+                            s->state == READING ? "aio_read" : "aio_write");
+            if ( n == 0 && s->state == READING )
+                fatal_error(-1, "the source file became shorter");
+            s->done += n;
+            if ( s->done < s->len )       /* Continue a short transfer. */
+                start_io(s, s->state == READING ? source_fd : target_fd,
+                         s->state);
+            else if ( s->state == READING )
+                s->state = READ_DONE;
+            else {
+                s->state = IDLE;
+                num_written++;
             }
-            else
-                done = TRUE;
         }
     }
 
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    secs = (finish.tv_sec - start.tv_sec) +
+           (finish.tv_nsec - start.tv_nsec) / 1e9;
+    if ( verbose ) {
+        printf("%lld bytes in %.3f s", (long long) sb.st_size, secs);
+        if ( secs > 0 )
+            printf(" (%.1f MB/s)", sb.st_size / MB / secs);
+        printf("\n");
+    }
+
     /* Close files.                                                       */
     if ( close(source_fd) == -1 ) {
-        sprintf(message, "error closing  %s", argv[1]);
+        sprintf(message, "error closing  %s", argv[optind]);
         fatal_error(-1, message);
     }
     if (-1 == fsync(target_fd))  /* Flush data to device. */
         if (errno != EINVAL)     /* If not a terminal */
             fatal_error(errno, "fsync");
     if ( close(target_fd) == -1 ) {
-        sprintf(message, "error closing %s", argv[2]);
+        sprintf(message, "error closing %s", argv[optind+1]);
         fatal_error(-1, message);
     }
-    free(buf[0]);
-    free(buf[1]);
+    for ( int i = 0; i < depth; i++ )
+        free(ring[i].buf);
+    free(ring);
+    free(in_flight);
     return 0;
-  }
+}
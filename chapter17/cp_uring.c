@@ -0,0 +1,404 @@
+/*****************************************************************************
+  Title          : cp_uring.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Copies a file with many reads and writes in flight at once
+  Purpose        : To show an example of the io_uring interface
+  Usage          : cp_uring [-v] [-d depth] [-b blocksize] sourcefile \
+                            targetfile
+  Build with     : gcc -Wall -g -I../include -L ../lib -o cp_uring \
+                   cp_uring.c -lspl
+
+  Notes:
+  cp_aio keeps a single read in flight and writes synchronously. This
+  program divides the source into blocks of blocksize bytes (default
+  128 KB) and keeps depth of them (default 32) in flight at once. For each
+  block it queues a read and a write linked to it, so the kernel starts
+  the write as soon as the read completes, without waiting for this
+  process to notice. When a block is finished, its buffer is used for the
+  next unread block.
+
+  The program calls the io_uring system calls directly instead of using
+  liburing. The kernel shares two rings with the process: the submission
+  queue (SQ), into which the program puts requests, and the completion
+  queue (CQ), from which it takes their results. io_uring_enter() tells
+  the kernel that requests are waiting and waits for completions.
+
+  The two files and all of the buffers are registered with the kernel
+  once, so it does not have to look up the descriptors and pin the pages
+  of the buffers for every request.
+
+  A read of a regular file returns fewer bytes than requested only at end
+  of file, and the size of the last block is known, so short reads should
+  not happen. If one does, the kernel cancels the linked write, and the
+  bytes that were read are written and the rest of the block is read again.
+
+  With -v it prints the bytes copied, the rate in MB/s (2^20 bytes per
+  second), and the number of reads and writes completed per second.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.gplv3 for details.                *
+*****************************************************************************/
+
+#define _GNU_SOURCE
+#include "common_hdrs.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#define MESSAGE_SIZE   512
+#define DEFAULT_DEPTH  32
+#define DEFAULT_BLOCK  (128*1024)
+#define MB             1048576.0
+#define SOURCE_INDEX   0          /* Indices of the registered files */
+#define TARGET_INDEX   1
+
+#define USAGE "cp_uring [-v] [-d depth] [-b blocksize] source target"
+
+/* The process's view of the two rings that it shares with the kernel. */
+typedef struct
+{
+    int       fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned  sq_local_tail;   /* Tail including requests not yet submitted */
+    unsigned  to_submit;       /* Number of requests not yet submitted      */
+} uring;
+
+/* A block being copied. got and written count bytes of the block that
+   have been read and written; a block is done when both equal len.     */
+typedef struct
+{
+    off_t   offset;
+    size_t  len;
+    size_t  got;
+    size_t  written;
+    int     pending;     /* Requests whose completions have not arrived */
+    char   *buf;
+} block;
+
+/* Wrappers for the system calls, which glibc does not provide. */
+int io_uring_setup( unsigned entries, struct io_uring_params *p )
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+int io_uring_enter( int fd, unsigned to_submit, unsigned min_complete,
+                    unsigned flags )
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   NULL, 0);
+}
+
+int io_uring_register( int fd, unsigned opcode, void *arg, unsigned nr_args )
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* Creates a ring with room for entries requests and maps its queues. */
+void setup_ring( uring *ring, unsigned entries )
+{
+    struct io_uring_params p;
+    size_t  sq_len, cq_len;
+    char   *sq_ptr, *cq_ptr;
+
+    memset(&p, 0, sizeof(p));
+    if ( -1 == (ring->fd = io_uring_setup(entries, &p)) )
+        fatal_error(errno, "io_uring_setup");
+
+    sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+        if ( cq_len > sq_len )
+            sq_len = cq_len;
+    }
+    sq_ptr = mmap(NULL, sq_len, PROT_READ|PROT_WRITE,
+                  MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if ( sq_ptr == MAP_FAILED )
+        fatal_error(errno, "mmap");
+    if ( p.features & IORING_FEAT_SINGLE_MMAP )
+        cq_ptr = sq_ptr;
+    else {
+        cq_ptr = mmap(NULL, cq_len, PROT_READ|PROT_WRITE,
+                      MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if ( cq_ptr == MAP_FAILED )
+            fatal_error(errno, "mmap");
+    }
+    ring->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                      PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if ( ring->sqes == MAP_FAILED )
+        fatal_error(errno, "mmap");
+
+    ring->sq_head  = (unsigned*) (sq_ptr + p.sq_off.head);
+    ring->sq_tail  = (unsigned*) (sq_ptr + p.sq_off.tail);
+    ring->sq_mask  = (unsigned*) (sq_ptr + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned*) (sq_ptr + p.sq_off.array);
+    ring->cq_head  = (unsigned*) (cq_ptr + p.cq_off.head);
+    ring->cq_tail  = (unsigned*) (cq_ptr + p.cq_off.tail);
+    ring->cq_mask  = (unsigned*) (cq_ptr + p.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe*) (cq_ptr + p.cq_off.cqes);
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->to_submit     = 0;
+}
+
+/* Returns a cleared submission queue entry to fill in. The caller never
+   has more requests outstanding than the ring has entries.              */
+struct io_uring_sqe *get_sqe( uring *ring )
+{
+    unsigned index = ring->sq_local_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    ring->sq_array[index] = index;
+    ring->sq_local_tail++;
+    ring->to_submit++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+/* Makes the queued requests visible to the kernel and submits them, then
+   waits until at least one has completed.                                */
+void submit_and_wait( uring *ring )
+{
+    int n;
+
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    while ( TRUE ) {
+        n = io_uring_enter(ring->fd, ring->to_submit, 1,
+                           IORING_ENTER_GETEVENTS);
+        if ( n >= 0 )
+            break;
+        if ( errno != EINTR )
+            fatal_error(errno, "io_uring_enter");
+    }
+    ring->to_submit -= n;
+}
+
+/* Fills in sqe for a read or write of len bytes at addr in the buffer of
+   block index, at the given file offset of the registered file.        */
+void prep_rw( struct io_uring_sqe *sqe, int opcode, int file_index,
+              char *addr, size_t len, off_t offset, int index )
+{
+    sqe->opcode    = opcode;
+    sqe->flags     = IOSQE_FIXED_FILE;
+    sqe->fd        = file_index;
+    sqe->addr      = (unsigned long) addr;
+    sqe->len       = len;
+    sqe->off       = offset;
+    sqe->buf_index = index;
+    /* The block index and whether it is a write identify the request
+       in its completion.                                              */
+    sqe->user_data = 2 * index + ( opcode == IORING_OP_WRITE_FIXED );
+}
+
+/* Queues a read of block index followed by a write linked to it. */
+void queue_copy( uring *ring, block *blocks, int index )
+{
+    block *b = &blocks[index];
+    struct io_uring_sqe *sqe;
+
+    b->got = b->written = 0;
+    sqe = get_sqe(ring);
+    prep_rw(sqe, IORING_OP_READ_FIXED, SOURCE_INDEX, b->buf, b->len,
+            b->offset, index);
+    sqe->flags |= IOSQE_IO_LINK;
+    sqe = get_sqe(ring);
+    prep_rw(sqe, IORING_OP_WRITE_FIXED, TARGET_INDEX, b->buf, b->len,
+            b->offset, index);
+    b->pending = 2;
+}
+
+/* Queues a write of the bytes of block index that were read but not yet
+   written.                                                               */
+void queue_write( uring *ring, block *blocks, int index )
+{
+    block *b = &blocks[index];
+
+    prep_rw(get_sqe(ring), IORING_OP_WRITE_FIXED, TARGET_INDEX,
+            b->buf + b->written, b->got - b->written,
+            b->offset + b->written, index);
+    b->pending = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int     ch;
+    char    options[] = ":b:d:v";
+    int     source_fd, target_fd;
+    int     depth = DEFAULT_DEPTH;
+    long    blocksize = DEFAULT_BLOCK;
+    BOOL    verbose = FALSE;
+    char    message[MESSAGE_SIZE];
+    struct  stat sb;
+    int     files[2];
+    struct  iovec *iovecs;
+    char   *buffers;
+    block  *blocks;
+    uring   ring;
+    off_t   next_offset = 0;
+    int     active = 0;
+    long    completed = 0;
+    unsigned head;
+    struct  io_uring_cqe *cqe;
+    struct  timespec start, finish;
+    double  secs;
+
+    opterr = 0;  /* Turn off error messages by getopt(). */
+    while  (TRUE) {
+        ch = getopt(argc, argv, options);
+        if ( -1 == ch )
+            break;
+        switch ( ch ) {
+        case 'b':
+            if ( VALID_NUMBER != get_long(optarg, POS_ONLY, &blocksize, NULL) )
+                usage_error("Invalid argument to -b");
+            break;
+        case 'd':
+            if ( VALID_NUMBER != get_int(optarg, POS_ONLY, &depth, NULL) )
+                usage_error("Invalid argument to -d");
+            break;
+        case 'v':
+            verbose = TRUE;
+            break;
+        default:
+            usage_error(USAGE);
+        }
+    }
+    if ( argc - optind != 2 )
+        usage_error(USAGE);
+
+    if ( (source_fd = open(argv[optind], O_RDONLY)) == -1 ) {
+        sprintf(message, "unable to open %s for reading", argv[optind]);
+        fatal_error(errno, message);
+    }
+    if ( -1 == fstat(source_fd, &sb) )
+        fatal_error(errno, "fstat");
+    if ( !S_ISREG(sb.st_mode) )
+        fatal_error(-1, "the source must be a regular file");
+    if ( (target_fd = open(argv[optind+1], O_WRONLY|O_CREAT|O_TRUNC,
+                           sb.st_mode & 0777)) == -1 ) {
+        sprintf(message, "unable to open %s for writing", argv[optind+1]);
+        fatal_error(errno, message);
+    }
+
+    /* Each block can have a read and a write in the queue at once. */
+    setup_ring(&ring, 2 * depth);
+
+    files[SOURCE_INDEX] = source_fd;
+    files[TARGET_INDEX] = target_fd;
+    if ( -1 == io_uring_register(ring.fd, IORING_REGISTER_FILES, files, 2) )
+        fatal_error(errno, "io_uring_register files");
+
+    blocks = calloc(depth, sizeof(block));
+    iovecs = calloc(depth, sizeof(struct iovec));
+    if ( blocks == NULL || iovecs == NULL )
+        fatal_error(errno, "calloc");
+    errno = posix_memalign((void**) &buffers, sysconf(_SC_PAGESIZE),
+                           depth * blocksize);
+    if ( errno != 0 )
+        fatal_error(errno, "posix_memalign");
+    for ( int i = 0; i < depth; i++ ) {
+        blocks[i].buf       = buffers + i * blocksize;
+        iovecs[i].iov_base  = blocks[i].buf;
+        iovecs[i].iov_len   = blocksize;
+    }
+    if ( -1 == io_uring_register(ring.fd, IORING_REGISTER_BUFFERS, iovecs,
+                                 depth) )
+        fatal_error(errno, "io_uring_register buffers");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* Start as many blocks as there are buffers. */
+    for ( int i = 0; i < depth && next_offset < sb.st_size; i++ ) {
+        blocks[i].offset = next_offset;
+        blocks[i].len    = ( sb.st_size - next_offset < blocksize ) ?
+                           sb.st_size - next_offset : blocksize;
+        next_offset     += blocks[i].len;
+        queue_copy(&ring, blocks, i);
+        active++;
+    }
+
+    while ( active > 0 ) {
+        submit_and_wait(&ring);
+
+        /* Take every completion that is ready. */
+        head = *ring.cq_head;
+        while ( head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE) ) {
+            cqe = &ring.cqes[head & *ring.cq_mask];
+            int    i = cqe->user_data / 2;
+            block *b = &blocks[i];
+
+            head++;
+            completed++;
+            b->pending--;
+            if ( cqe->user_data % 2 == 0 ) {   /* A read */
+                if ( cqe->res < 0 )
+                    fatal_error(-cqe->res, "read");
+                b->got = cqe->res;
+            }
+            else if ( cqe->res == -ECANCELED )
+                ; /* A write cancelled by a short read. */
+            else if ( cqe->res < 0 )
+                fatal_error(-cqe->res, "write");
+            else
+                b->written += cqe->res;
+
+            if ( b->pending > 0 )
+                continue;
+            if ( b->written < b->got )         /* Short read or write. */
+                queue_write(&ring, blocks, i);
+            else if ( b->got < b->len ) {      /* Read the rest. */
+                if ( b->got == 0 )
+                    fatal_error(-1, "the source file became shorter");
+                b->offset += b->got;
+                b->len    -= b->got;
+                queue_copy(&ring, blocks, i);
+            }
+            else if ( next_offset < sb.st_size ) {  /* Start next block. */
+                b->offset    = next_offset;
+                b->len       = ( sb.st_size - next_offset < blocksize ) ?
+                               sb.st_size - next_offset : blocksize;
+                next_offset += b->len;
+                queue_copy(&ring, blocks, i);
+            }
+            else
+                active--;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    secs = (finish.tv_sec - start.tv_sec) +
+           (finish.tv_nsec - start.tv_nsec) / 1e9;
+    if ( verbose ) {
+        printf("%lld bytes in %.3f s", (long long) sb.st_size, secs);
+        if ( secs > 0 )
+            printf(" (%.1f MB/s, %.0f IOPS)", sb.st_size / MB / secs,
+                   completed / secs);
+        printf("\n");
+    }
+
+    close(ring.fd);
+    if ( close(source_fd) == -1 ) {
+        sprintf(message, "error closing  %s", argv[optind]);
+        fatal_error(errno, message);
+    }
+    if ( close(target_fd) == -1 ) {
+        sprintf(message, "error closing %s", argv[optind+1]);
+        fatal_error(errno, message);
+    }
+    free(buffers);
+    free(iovecs);
+    free(blocks);
+    return 0;
+}
@@ -28,6 +28,7 @@
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 #include "top_utils.h"
+#include "collate.h"
 #include <math.h>
 
 
@@ -102,8 +103,41 @@ int time_cmp(const void* a, const void* b,  void* dir )
                  ((procstat*) a)->utime + ((procstat*) a)->stime );
 }
 
+/* Returns the user name of process i of the procstat array list. */
+static const char *proc_user( size_t i, void *list, int *group )
+{
+    return uid2name(((procstat*) list)[i].uid);
+}
+
+/* Sorts proclist by user name as user_cmp() does, but looking up each
+   process's user name once, instead of twice in every comparison. The
+   names are compared by their bytes, as strcmp() compares them. Returns
+   0, or -1 if there is no memory.                                     */
+static int sort_by_user( procstat* proclist, int numprocs, BOOL increasing )
+{
+    size_t    *order  = malloc(numprocs * sizeof(size_t));
+    procstat  *sorted = malloc(numprocs * sizeof(procstat));
+    int        result = -1;
+
+    if ( order != NULL && sorted != NULL
+         && 0 == collate_sort(numprocs, proc_user, proclist,
+                    COLLATE_BYTES | (increasing ? 0 : COLLATE_REVERSE),
+                    order) ) {
+        for ( int i = 0; i < numprocs; i++ )
+            sorted[i] = proclist[order[i]];
+        memcpy(proclist, sorted, numprocs * sizeof(procstat));
+        result = 0;
+    }
+    free(order);
+    free(sorted);
+    return result;
+}
+
 void sortprocs(  procstat* proclist, int numprocs, compar_t cmpfunc, BOOL increasing)
 {
+    if ( cmpfunc == user_cmp && numprocs > 1
+         && 0 == sort_by_user(proclist, numprocs, increasing) )
+        return;
     qsort_r(proclist, numprocs, sizeof(procstat), cmpfunc, (void*)   &increasing);
 }
 
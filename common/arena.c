@@ -0,0 +1,96 @@
+/*****************************************************************************
+  Title          : arena.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Allocation of many small objects that are freed together
+
+  Notes:
+  Each chunk is obtained with malloc() and linked into a list through its
+  first bytes. Allocations are taken from the front chunk only; when it
+  cannot satisfy one, a new chunk is put in front of it and the space left
+  in the old one is abandoned, which wastes at most the size of one
+  object per chunk.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#include "common_hdrs.h"
+#include <stddef.h>
+#include "arena.h"
+
+#define ALIGNMENT  (sizeof(max_align_t))
+
+struct arena_chunk_tag
+{
+    arena_chunk  *next;
+    size_t        size;        /* Usable bytes in data */
+    size_t        used;
+    max_align_t   data[];
+};
+
+void arena_init( arena *a, size_t chunk_size )
+{
+    a->chunks     = NULL;
+    a->chunk_size = ( chunk_size > 0 ) ? chunk_size : ARENA_CHUNK_SIZE;
+    a->total      = 0;
+}
+
+/* Returns size bytes from a at a multiple of align, a power of 2. */
+static void *take( arena *a, size_t size, size_t align )
+{
+    arena_chunk *c = a->chunks;
+    size_t       csize;
+    void        *p;
+
+    if ( c != NULL )
+        c->used = (c->used + align - 1) & ~(align - 1);
+    if ( c == NULL || c->used > c->size || c->size - c->used < size ) {
+        csize = ( size > a->chunk_size ) ? size : a->chunk_size;
+        if ( NULL == (c = malloc(sizeof(arena_chunk) + csize)) )
+            return NULL;
+        c->size   = csize;
+        c->used   = 0;
+        c->next   = a->chunks;
+        a->chunks = c;
+    }
+    p = (char*) c->data + c->used;
+    c->used  += size;
+    a->total += size;
+    return p;
+}
+
+void *arena_alloc( arena *a, size_t size )
+{
+    return take(a, size, ALIGNMENT);
+}
+
+/* Strings need no alignment, so they are packed end to end. */
+char *arena_strndup( arena *a, const char *s, size_t len )
+{
+    char *copy = take(a, len + 1, 1);
+
+    if ( copy != NULL ) {
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+void arena_free( arena *a )
+{
+    arena_chunk *c, *next;
+
+    for ( c = a->chunks; c != NULL; c = next ) {
+        next = c->next;
+        free(c);
+    }
+    a->chunks = NULL;
+    a->total  = 0;
+}
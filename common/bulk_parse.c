@@ -0,0 +1,454 @@
+/*****************************************************************************
+  Title          : bulk_parse.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Fast parsing of large amounts of whitespace-separated
+                   numbers
+
+  Notes:
+  A token belongs to the segment in which it starts; segment boundaries
+  are moved forward so that no token is split. Each thread records the
+  index of the first token in its segment that is not a number, and the
+  result is cut off at the first such token overall.
+
+  The eight-digit conversion is the method of Lemire and Mula: after
+  subtracting '0' from each byte, adjacent digits are combined pairwise by
+  multiplying and shifting, so 8 digits take 3 multiplications instead of
+  8. It assumes a little-endian machine and is disabled otherwise.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#include "common_hdrs.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "bulk_parse.h"
+
+#define READ_BLOCK    (1 << 20)   /* Size of each read() from a pipe      */
+#define MAX_TOKEN     64          /* Longest token for the slow path      */
+#define NO_BAD_TOKEN  LONG_MAX
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define USE_SWAR 1
+#endif
+
+/* One thread's share of the input and of the output. */
+typedef struct
+{
+    const char *start;      /* First byte of segment                     */
+    const char *end;        /* One past last byte of segment             */
+    long        count;      /* Number of tokens in segment               */
+    long        offset;     /* Index in output of segment's first value  */
+    long        bad;        /* Output index of first bad token, if any   */
+    BOOL        is_double;
+    void       *out;        /* Output array                              */
+} segment;
+
+static const double pow10tab[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline int is_space( char c )
+{
+    return (c == ' ') | ((unsigned char) (c - '\t') < 5);
+}
+
+static inline BOOL is_digit( char c )
+{
+    return (unsigned char) (c - '0') < 10;
+}
+
+#ifdef USE_SWAR
+static const uint64_t pow10int[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+};
+
+static inline uint64_t load8( const char *p )
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+/* The number of leading bytes of v (in memory order) that are ASCII
+   digits. A byte is a digit if its high nibble is 3 and adding 6 to it
+   leaves the high nibble 3. Adding 6 can carry into the next byte only
+   from a byte that is not a digit, so the bytes before the first
+   non-digit are tested correctly. */
+static inline int leading_digits8( uint64_t v )
+{
+    uint64_t nondigit = 0x3333333333333333ULL ^
+                        ((v & 0xF0F0F0F0F0F0F0F0ULL) |
+                        (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL)
+                         >> 4));
+    return ( nondigit == 0 ) ? 8 : __builtin_ctzll(nondigit) >> 3;
+}
+
+/* The value of the 8 ASCII digits in v, the first digit being the lowest
+   byte. */
+static inline uint32_t convert_digits8( uint64_t v )
+{
+    const uint64_t mask = 0x000000FF000000FFULL;
+    const uint64_t mul1 = 100 + (1000000ULL << 32);
+    const uint64_t mul2 = 1 + (10000ULL << 32);
+
+    v -= 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    return (uint32_t) ((((v & mask) * mul1) + (((v >> 16) & mask) * mul2))
+                       >> 32);
+}
+#endif
+
+/* Accumulates the digits at *pp into *mant, advancing *pp past them, and
+   returns how many there were. Digits beyond the 19th are counted but not
+   accumulated, since they could overflow. */
+static inline int scan_digits( const char **pp, const char *end,
+                               uint64_t *mant )
+{
+    const char *p = *pp;
+    int         n = 0, k;
+#ifdef USE_SWAR
+    uint64_t    v;
+
+    /* Convert up to 8 digits at a time. A run of k < 8 digits is moved to
+       the high end of the word and padded with '0's, which doesn't change
+       its value, and it ends the number. */
+    while ( end - p >= 8 ) {
+        v = load8(p);
+        k = leading_digits8(v);
+        if ( k == 0 || n + k > 19 )
+            break;
+        if ( k < 8 )
+            v = (v << (8 * (8 - k))) | (0x3030303030303030ULL >> (8 * k));
+        *mant = *mant * pow10int[k] + convert_digits8(v);
+        p += k;
+        n += k;
+        if ( k < 8 ) {
+            *pp = p;
+            return n;
+        }
+    }
+#endif
+    while ( p < end && is_digit(*p) ) {
+        if ( n < 19 )
+            *mant = *mant * 10 + (*p - '0');
+        p++;
+        n++;
+    }
+    *pp = p;
+    return n;
+}
+
+/* Converts the token [s, e) with strtol() or strtod(). Returns 1 if the
+   whole token is a number. */
+static int slow_parse( const char *s, const char *e, BOOL is_double,
+                       void *value )
+{
+    char  token[MAX_TOKEN + 1];
+    char *endp;
+
+    if ( e - s > MAX_TOKEN )
+        return 0;
+    memcpy(token, s, e - s);
+    token[e - s] = '\0';
+    /* Like fscanf(), accept a double that overflows or underflows, with
+       the value strtod() gives it, but not an integer out of range. */
+    errno = 0;
+    if ( is_double )
+        *(double*) value = strtod(token, &endp);
+    else
+        *(long*) value = strtol(token, &endp, 10);
+    return ( endp != token && *endp == '\0' && (is_double || errno == 0) );
+}
+
+/* Returns a pointer to the first whitespace character at or after p. */
+static inline const char* token_end( const char *p, const char *end )
+{
+    while ( p < end && ! is_space(*p) )
+        p++;
+    return p;
+}
+
+/* Parses the token starting at *pp, which is not whitespace, into *value
+   and advances *pp to the end of the token. Returns 1 if the token is a
+   valid number and 0 if not. The token is converted as it is scanned;
+   only the tokens that fail the fast path are scanned twice. */
+static int parse_token( const char **pp, const char *end, BOOL is_double,
+                        void *value )
+{
+    const char *s = *pp, *p = *pp;
+    BOOL        negative = FALSE;
+    uint64_t    mant = 0;
+    int         nint, nfrac = 0, exp10 = 0, expsign = 1, expval = 0;
+    double      d;
+
+    if ( *p == '-' || *p == '+' )
+        negative = ( *p++ == '-' );
+    nint = scan_digits(&p, end, &mant);
+
+    if ( ! is_double ) {
+        if ( nint == 0 || (p < end && ! is_space(*p)) ) {
+            *pp = token_end(p, end);
+            return 0;
+        }
+        *pp = p;
+        if ( nint > 18 )
+            return slow_parse(s, p, FALSE, value);
+        *(long*) value = negative ? -(long) mant : (long) mant;
+        return 1;
+    }
+
+    if ( p < end && *p == '.' ) {
+        p++;
+        nfrac = scan_digits(&p, end, &mant);
+        exp10 = -nfrac;
+    }
+    if ( nint + nfrac > 0 && p < end && (*p == 'e' || *p == 'E') ) {
+        p++;
+        if ( p < end && (*p == '-' || *p == '+') )
+            expsign = ( *p++ == '-' ) ? -1 : 1;
+        if ( p == end || ! is_digit(*p) )
+            nint = nfrac = 0;                   /* Force the slow path */
+        while ( p < end && is_digit(*p) && expval < 10000 )
+            expval = expval * 10 + (*p++ - '0');
+        exp10 += expsign * expval;
+    }
+
+    /* The fast path applies if the token ends here, mant is exact and
+       exactly representable, and so is 10^|exp10|, since then one
+       multiplication or division gives the correctly rounded result.
+       Anything else, including "inf" and "nan", goes to strtod(). */
+    if ( nint + nfrac == 0 || nint + nfrac > 19 || mant > (1ULL << 53) ||
+         exp10 < -22 || exp10 > 22 || (p < end && ! is_space(*p)) ) {
+        *pp = token_end(p, end);
+        return slow_parse(s, *pp, TRUE, value);
+    }
+    *pp = p;
+    d = (double) mant;
+    d = ( exp10 < 0 ) ? d / pow10tab[-exp10] : d * pow10tab[exp10];
+    *(double*) value = negative ? -d : d;
+    return 1;
+}
+
+/* Thread start function for the first pass: counts tokens. */
+static void* count_segment( void *arg )
+{
+    segment    *seg = arg;
+    const char *p   = seg->start;
+    long        n;
+
+    /* A segment starts at a token or at whitespace. After that, a token
+       starts wherever a non-space follows a space. Each iteration depends
+       only on two bytes and not on the one before, so the compiler can
+       vectorize the loop. */
+    if ( p == seg->end )
+        n = 0;
+    else
+        n = ! is_space(*p);
+    for ( p++; p < seg->end; p++ )
+        n += is_space(p[-1]) & ! is_space(*p);
+    seg->count = n;
+    return NULL;
+}
+
+/* Thread start function for the second pass: converts tokens. */
+static void* parse_segment( void *arg )
+{
+    segment    *seg = arg;
+    const char *p   = seg->start;
+    long        i   = seg->offset;
+    void       *v;
+
+    seg->bad = NO_BAD_TOKEN;
+    while ( TRUE ) {
+        while ( p < seg->end && is_space(*p) )
+            p++;
+        if ( p == seg->end )
+            break;
+        if ( seg->is_double )
+            v = (double*) seg->out + i;
+        else
+            v = (long*) seg->out + i;
+        if ( ! parse_token(&p, seg->end, seg->is_double, v) ) {
+            seg->bad = i;
+            break;
+        }
+        i++;
+    }
+    return NULL;
+}
+
+/* Runs func on every segment, each in its own thread except the first,
+   which runs in the caller. */
+static int run_segments( void* (*func)(void*), segment *segs, int n )
+{
+    pthread_t *threads;
+    int        t, retval;
+
+    if ( NULL == (threads = calloc(n, sizeof(pthread_t))) )
+        return -1;
+    for ( t = 1; t < n; t++ )
+        if ( 0 != (retval = pthread_create(&threads[t], NULL, func,
+                                           &segs[t])) ) {
+            while ( --t > 0 )
+                pthread_join(threads[t], NULL);
+            free(threads);
+            errno = retval;
+            return -1;
+        }
+    func(&segs[0]);
+    for ( t = 1; t < n; t++ )
+        pthread_join(threads[t], NULL);
+    free(threads);
+    return 0;
+}
+
+/* Makes the whole input of fd available in memory, mapping it if it is a
+   regular file and reading it in large blocks otherwise. Sets *mapped to
+   tell the caller how to release it. Returns NULL on error. */
+static char* load_input( int fd, size_t *len, BOOL *mapped )
+{
+    struct stat sb;
+    char       *buf = NULL, *bigger;
+    size_t      size = 0, capacity = 0;
+    ssize_t     nbytes;
+
+    *mapped = FALSE;
+    if ( -1 == fstat(fd, &sb) )
+        return NULL;
+    if ( S_ISREG(sb.st_mode) && sb.st_size > 0 ) {
+        buf = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if ( buf != MAP_FAILED ) {
+            madvise(buf, sb.st_size, MADV_SEQUENTIAL);
+            *mapped = TRUE;
+            *len = sb.st_size;
+            return buf;
+        }
+        buf = NULL;
+    }
+    while ( TRUE ) {
+        if ( capacity - size < READ_BLOCK ) {
+            capacity = ( capacity == 0 ) ? 4 * READ_BLOCK : 2 * capacity;
+            if ( NULL == (bigger = realloc(buf, capacity)) ) {
+                free(buf);
+                return NULL;
+            }
+            buf = bigger;
+        }
+        if ( -1 == (nbytes = read(fd, buf + size, capacity - size)) ) {
+            if ( errno == EINTR )
+                continue;
+            free(buf);
+            return NULL;
+        }
+        if ( nbytes == 0 )
+            break;
+        size += nbytes;
+    }
+    *len = size;
+    return buf;
+}
+
+/* Parses buf[0..len-1] into a newly allocated array in *values with
+   num_threads threads. Returns the number of values, or -1 on error. */
+static long parse_buffer( const char *buf, size_t len, void **values,
+                          BOOL is_double, int num_threads )
+{
+    segment *segs;
+    size_t   b;
+    long     total = 0;
+    int      t;
+
+    if ( len < (size_t) num_threads * READ_BLOCK )  /* Not worth a thread */
+        num_threads = 1 + len / READ_BLOCK;
+    if ( NULL == (segs = calloc(num_threads, sizeof(segment))) )
+        return -1;
+
+    /* Divide the input, moving each boundary past the token it splits. */
+    for ( t = 0; t < num_threads; t++ ) {
+        b = ( t == 0 ) ? 0 : (t * len) / num_threads;
+        if ( t > 0 && b < segs[t-1].start - buf )
+            b = segs[t-1].start - buf;
+        while ( b > 0 && b < len && ! is_space(buf[b-1]) )
+            b++;
+        segs[t].start     = buf + b;
+        segs[t].end       = buf + len;
+        segs[t].is_double = is_double;
+        if ( t > 0 )
+            segs[t-1].end = segs[t].start;
+    }
+
+    if ( -1 == run_segments(count_segment, segs, num_threads) ) {
+        free(segs);
+        return -1;
+    }
+    for ( t = 0; t < num_threads; t++ ) {
+        segs[t].offset = total;
+        total += segs[t].count;
+    }
+    if ( NULL == (*values = malloc((total > 0 ? total : 1) *
+                        (is_double ? sizeof(double) : sizeof(long)))) ) {
+        free(segs);
+        return -1;
+    }
+    for ( t = 0; t < num_threads; t++ )
+        segs[t].out = *values;
+    if ( -1 == run_segments(parse_segment, segs, num_threads) ) {
+        free(*values);
+        *values = NULL;
+        free(segs);
+        return -1;
+    }
+
+    /* Stop at the first token that is not a number. */
+    for ( t = 0; t < num_threads; t++ )
+        if ( segs[t].bad != NO_BAD_TOKEN ) {
+            total = segs[t].bad;
+            break;
+        }
+    free(segs);
+    return total;
+}
+
+static long bulk_parse( int fd, void **values, BOOL is_double,
+                        int num_threads )
+{
+    char    *buf;
+    size_t   len;
+    BOOL     mapped;
+    long     result;
+    int      saved_errno;
+
+    *values = NULL;
+    if ( num_threads < 1 )
+        num_threads = 1;
+    if ( NULL == (buf = load_input(fd, &len, &mapped)) )
+        return -1;
+    result = parse_buffer(buf, len, values, is_double, num_threads);
+    saved_errno = errno;
+    if ( mapped )
+        munmap(buf, len);
+    else
+        free(buf);
+    errno = saved_errno;
+    return result;
+}
+
+long bulk_parse_long( int fd, long **values, int num_threads )
+{
+    return bulk_parse(fd, (void**) values, FALSE, num_threads);
+}
+
+long bulk_parse_dbl( int fd, double **values, int num_threads )
+{
+    return bulk_parse(fd, (void**) values, TRUE, num_threads);
+}
@@ -0,0 +1,287 @@
+/*****************************************************************************
+  Title          : checksum.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Checksums of data that arrives a block at a time
+
+  Notes:
+  The CRC is the reflected form with polynomial 0x82F63B78, initial value
+  and final XOR of all ones, as in RFC 3720; the CRC32C of "123456789" is
+  0xE3069283. The table-driven version looks up each of eight bytes in its
+  own table and XORs the results, which needs one table lookup per byte
+  but no dependency between the lookups for the eight bytes.
+
+  xxHash64 is computed with seed 0, as specified at
+  https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md; the
+  XXH64 of the empty string is 0xEF46DB3751D8E999. Its input is read as
+  little-endian words on every machine.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#include "common_hdrs.h"
+#include <pthread.h>
+#include <stdint.h>
+#include "checksum.h"
+
+#define CRC32C_POLY  0x82F63B78U
+#define STRIPE       32             /* Bytes taken by one xxHash round  */
+
+#define P1  0x9E3779B185EBCA87ULL     /* The primes of xxHash64        */
+#define P2  0xC2B2AE3D27D4EB4FULL
+#define P3  0x165667B19E3779F9ULL
+#define P4  0x85EBCA77C2B2AE63ULL
+#define P5  0x27D4EB2F165667C5ULL
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_HW_CRC 1
+#endif
+
+static const char *checksum_names[NUM_CHECKSUMS] = { "crc32c", "xxh64" };
+
+static uint32_t crc_table[8][256];
+static uint32_t (*crc_func)( uint32_t, const unsigned char*, size_t );
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+const char *checksum_name( checksum_type type )
+{
+    return checksum_names[type];
+}
+
+int parse_checksum( const char *name )
+{
+    for ( int i = 0; i < NUM_CHECKSUMS; i++ )
+        if ( 0 == strcmp(name, checksum_names[i]) )
+            return i;
+    return -1;
+}
+
+int checksum_digits( checksum_type type )
+{
+    return ( type == SUM_CRC32C ) ? 8 : 16;
+}
+
+/* Returns the 8 bytes at p as a little-endian number. */
+static inline uint64_t read64( const unsigned char *p )
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t read32( const unsigned char *p )
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+/*----------------------------------------------------------------------------
+                                  CRC32C
+----------------------------------------------------------------------------*/
+
+/* Computes the CRC of len bytes at p, eight bytes at a time with tables. */
+static uint32_t crc32c_sw( uint32_t crc, const unsigned char *p, size_t len )
+{
+    uint64_t w;
+
+    while ( len >= 8 ) {
+        w   = read64(p) ^ crc;
+        crc = crc_table[7][w & 0xFF]         ^ crc_table[6][(w >> 8) & 0xFF] ^
+              crc_table[5][(w >> 16) & 0xFF] ^ crc_table[4][(w >> 24) & 0xFF] ^
+              crc_table[3][(w >> 32) & 0xFF] ^ crc_table[2][(w >> 40) & 0xFF] ^
+              crc_table[1][(w >> 48) & 0xFF] ^ crc_table[0][w >> 56];
+        p   += 8;
+        len -= 8;
+    }
+    while ( len-- > 0 )
+        crc = crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef HAVE_HW_CRC
+/* Computes the CRC of len bytes at p with the SSE4.2 crc32 instruction. */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw( uint32_t crc, const unsigned char *p, size_t len )
+{
+    uint64_t c = crc;
+    uint64_t w;
+
+    while ( len >= 8 ) {
+        memcpy(&w, p, sizeof(w));
+        c    = __builtin_ia32_crc32di(c, w);
+        p   += 8;
+        len -= 8;
+    }
+    while ( len-- > 0 )
+        c = __builtin_ia32_crc32qi((uint32_t) c, *p++);
+    return (uint32_t) c;
+}
+#endif
+
+/* Builds the tables and chooses the fastest way to compute the CRC. */
+static void crc_init( void )
+{
+    uint32_t crc;
+
+    for ( int n = 0; n < 256; n++ ) {
+        crc = n;
+        for ( int k = 0; k < 8; k++ )
+            crc = ( crc & 1 ) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        crc_table[0][n] = crc;
+    }
+    for ( int n = 0; n < 256; n++ )
+        for ( int k = 1; k < 8; k++ )
+            crc_table[k][n] = (crc_table[k-1][n] >> 8) ^
+                              crc_table[0][crc_table[k-1][n] & 0xFF];
+    crc_func = crc32c_sw;
+#ifdef HAVE_HW_CRC
+    if ( __builtin_cpu_supports("sse4.2") )
+        crc_func = crc32c_hw;
+#endif
+}
+
+uint32_t crc32c( uint32_t crc, const void *buf, size_t len )
+{
+    pthread_once(&crc_once, crc_init);
+    return ~crc_func(~crc, buf, len);
+}
+
+/*----------------------------------------------------------------------------
+                                  xxHash64
+----------------------------------------------------------------------------*/
+
+static inline uint64_t rotl64( uint64_t x, int r )
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_round( uint64_t acc, uint64_t input )
+{
+    acc += input * P2;
+    acc  = rotl64(acc, 31);
+    return acc * P1;
+}
+
+static inline uint64_t xxh_merge( uint64_t acc, uint64_t val )
+{
+    acc ^= xxh_round(0, val);
+    return acc * P1 + P4;
+}
+
+/* Adds the 32-byte stripe at p to the four lanes in acc. */
+static inline void xxh_stripe( uint64_t acc[4], const unsigned char *p )
+{
+    acc[0] = xxh_round(acc[0], read64(p));
+    acc[1] = xxh_round(acc[1], read64(p + 8));
+    acc[2] = xxh_round(acc[2], read64(p + 16));
+    acc[3] = xxh_round(acc[3], read64(p + 24));
+}
+
+static uint64_t xxh64_final( const checksum_state *s )
+{
+    const unsigned char *p = s->pending;
+    size_t   len = s->num_pending;
+    uint64_t h;
+
+    if ( s->total >= STRIPE ) {
+        h = rotl64(s->acc[0], 1) + rotl64(s->acc[1], 7) +
+            rotl64(s->acc[2], 12) + rotl64(s->acc[3], 18);
+        for ( int i = 0; i < 4; i++ )
+            h = xxh_merge(h, s->acc[i]);
+    }
+    else
+        h = P5;
+    h += s->total;
+
+    for ( ; len >= 8; p += 8, len -= 8 ) {
+        h ^= xxh_round(0, read64(p));
+        h  = rotl64(h, 27) * P1 + P4;
+    }
+    if ( len >= 4 ) {
+        h ^= (uint64_t) read32(p) * P1;
+        h  = rotl64(h, 23) * P2 + P3;
+        p += 4;
+        len -= 4;
+    }
+    for ( ; len > 0; p++, len-- ) {
+        h ^= *p * P5;
+        h  = rotl64(h, 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/*----------------------------------------------------------------------------
+                                Checksums
+----------------------------------------------------------------------------*/
+
+void checksum_init( checksum_state *state, checksum_type type )
+{
+    memset(state, 0, sizeof(checksum_state));
+    state->type = type;
+    if ( type == SUM_XXH64 ) {
+        state->acc[0] = P1 + P2;
+        state->acc[1] = P2;
+        state->acc[2] = 0;
+        state->acc[3] = -P1;
+    }
+}
+
+void checksum_update( checksum_state *state, const void *buf, size_t len )
+{
+    const unsigned char *p = buf;
+    size_t  n;
+
+    state->total += len;
+    if ( state->type == SUM_CRC32C ) {
+        state->acc[0] = crc32c((uint32_t) state->acc[0], buf, len);
+        return;
+    }
+
+    /* Complete the stripe begun by the previous call, if there is one. */
+    if ( state->num_pending > 0 ) {
+        n = STRIPE - state->num_pending;
+        if ( n > len )
+            n = len;
+        memcpy(state->pending + state->num_pending, p, n);
+        state->num_pending += n;
+        p   += n;
+        len -= n;
+        if ( state->num_pending < STRIPE )
+            return;
+        xxh_stripe(state->acc, state->pending);
+        state->num_pending = 0;
+    }
+    for ( ; len >= STRIPE; p += STRIPE, len -= STRIPE )
+        xxh_stripe(state->acc, p);
+    memcpy(state->pending, p, len);
+    state->num_pending = len;
+}
+
+uint64_t checksum_final( const checksum_state *state )
+{
+    if ( state->type == SUM_CRC32C )
+        return state->acc[0];
+    return xxh64_final(state);
+}
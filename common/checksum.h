@@ -0,0 +1,94 @@
+/*****************************************************************************
+  Title          : checksum.h
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Checksums of data that arrives a block at a time
+
+  Notes:
+  Two checksums are provided, both of which are much faster than a
+  cryptographic hash and are meant for detecting corruption, not
+  tampering:
+
+  SUM_CRC32C   The 32-bit CRC with the Castagnoli polynomial, which is the
+               one used by iSCSI, ext4 and Btrfs. On x86-64 processors with
+               SSE4.2 it is computed with the crc32 instruction, which is
+               chosen when the program runs, and otherwise eight bytes at a
+               time with tables ("slicing by 8").
+  SUM_XXH64    The 64-bit xxHash of Yann Collet, which processes 32 bytes
+               at a time in four independent lanes, so that the compiler
+               and processor can work on them in parallel.
+
+  A checksum is computed by passing the data to checksum_update() in
+  blocks of any size, between checksum_init() and checksum_final(). The
+  result does not depend on how the data was divided into blocks.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include "common_hdrs.h"
+#include <stdint.h>
+
+typedef enum
+{
+    SUM_CRC32C,
+    SUM_XXH64,
+    NUM_CHECKSUMS
+} checksum_type;
+
+/* The state of a checksum that is being computed. */
+typedef struct
+{
+    checksum_type  type;
+    uint64_t       total;        /* Bytes passed to checksum_update()     */
+    uint64_t       acc[4];       /* CRC in acc[0], or the xxHash lanes    */
+    unsigned char  pending[32];  /* Bytes not yet making a full stripe    */
+    size_t         num_pending;
+} checksum_state;
+
+
+/** checksum_name(type) returns the name of type, as accepted by
+    parse_checksum().
+*/
+const char *checksum_name( checksum_type type );
+
+/** parse_checksum(name) returns the checksum called name, which is
+    "crc32c" or "xxh64", or -1 if there is no such checksum.
+*/
+int parse_checksum( const char *name );
+
+/** checksum_digits(type) returns the number of hexadecimal digits in a
+    checksum of the given type: 8 for SUM_CRC32C and 16 for SUM_XXH64.
+*/
+int checksum_digits( checksum_type type );
+
+/** crc32c(crc, buf, len) returns the CRC32C of the len bytes at buf,
+    continuing from crc, which is the CRC32C of the data before them, or 0
+    at the start.
+*/
+uint32_t crc32c( uint32_t crc, const void *buf, size_t len );
+
+/** checksum_init(&state, type) starts a checksum of the given type. */
+void checksum_init( checksum_state *state, checksum_type type );
+
+/** checksum_update(&state, buf, len) adds the len bytes at buf to the
+    checksum in state.
+*/
+void checksum_update( checksum_state *state, const void *buf, size_t len );
+
+/** checksum_final(&state) returns the checksum of all of the data passed
+    to checksum_update(). It does not change state, so more data can be
+    added after it is called.
+*/
+uint64_t checksum_final( const checksum_state *state );
+
+#endif /* CHECKSUM_H */
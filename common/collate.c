@@ -0,0 +1,229 @@
+/*****************************************************************************
+  Title          : collate.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Sorting by name with collation keys computed once
+
+  Notes:
+  The first sixteen bytes of a key are stored in two integers, most
+  significant first, so that comparing them as integers orders them as
+  strcmp() would, and the bytes after the end of a shorter key are zero.
+  Since a key contains no null byte before its end, two keys with the same
+  prefix are either both shorter than sixteen bytes, and equal, or both at
+  least sixteen bytes long, and only then is the rest of each key compared.
+  Sixteen bytes are enough to tell apart most names in a directory whose
+  names begin alike, such as a mail spool's, and keep an item 32 bytes.
+
+  The items are sorted by a most significant digit radix sort, whose
+  digits are the item's group and then the bytes of its key: the items are
+  distributed by their first digit into 256 buckets, and each bucket is
+  sorted in the same way by the next digit, until a bucket holds fewer
+  than SMALL_SORT items, which are sorted by insertion. It looks at each
+  byte of a key at most once, where a comparison sort looks at the bytes
+  that names have in common again in every comparison. Each distribution
+  keeps the items of a bucket in the order they had, so items whose keys
+  are equal end up in the order in which they were given. To reverse the
+  order, each byte b of a key is taken as 255-b, which puts a key after
+  any longer key that begins with it, since its null byte becomes 255.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#include "common_hdrs.h"
+#include <stdint.h>
+#include "arena.h"
+#include "collate.h"
+
+#define INITIAL_KEY  256     /* Initial size of the buffer for strxfrm() */
+
+#define PREFIX_LEN   16      /* Bytes of a key kept in an item          */
+#define SMALL_SORT   32      /* Fewer items than this are not bucketed  */
+
+/* An item to be sorted */
+typedef struct
+{
+    uint64_t     prefix[2];  /* The first PREFIX_LEN bytes of key       */
+    const char  *key;        /* In the arena                            */
+    int          group;
+    uint32_t     index;      /* Of the item in the caller's array       */
+} item;
+
+/* Stores the first PREFIX_LEN bytes of key in prefix, as integers that
+   compare as they do, with zeros after the end of key.                */
+static void set_prefix( uint64_t prefix[2], const char *key )
+{
+    int  i;
+
+    prefix[0] = prefix[1] = 0;
+    for ( i = 0; i < PREFIX_LEN && key[i] != '\0'; i++ )
+        prefix[i / 8] |= (uint64_t) (unsigned char) key[i] << (56 - 8*(i%8));
+}
+
+/* Compares the items x and y by group, then by key, reversed if flags
+   has COLLATE_REVERSE, then by index.                                 */
+static int by_key( const item *x, const item *y, int flags )
+{
+    int  c = 0;
+
+    if ( x->group != y->group )
+        return ( x->group < y->group ) ? -1 : 1;
+    if ( x->prefix[0] != y->prefix[0] )
+        c = ( x->prefix[0] < y->prefix[0] ) ? -1 : 1;
+    else if ( x->prefix[1] != y->prefix[1] )
+        c = ( x->prefix[1] < y->prefix[1] ) ? -1 : 1;
+    else if ( (x->prefix[1] & 0xff) != 0 )
+        c = strcmp(x->key + PREFIX_LEN, y->key + PREFIX_LEN);
+    if ( c != 0 )
+        return ( flags & COLLATE_REVERSE ) ? -c : c;
+    return ( x->index < y->index ) ? -1 : ( x->index > y->index );
+}
+
+/* Returns digit d of x: its group if d is 0, and otherwise byte d-1 of
+   its key, or 255 minus it if flags has COLLATE_REVERSE.              */
+static int digit( const item *x, size_t d, int flags )
+{
+    int  b;
+
+    if ( d == 0 )
+        return x->group;
+    d--;
+    if ( d < PREFIX_LEN )
+        b = (x->prefix[d / 8] >> (56 - 8*(d%8))) & 0xff;
+    else
+        b = (unsigned char) x->key[d];
+    return ( flags & COLLATE_REVERSE ) ? 255 - b : b;
+}
+
+/* Sorts the n items a by insertion. */
+static void insertion_sort( item *a, size_t n, int flags )
+{
+    size_t  i, j;
+    item    x;
+
+    for ( i = 1; i < n; i++ ) {
+        x = a[i];
+        for ( j = i; j > 0 && by_key(&a[j-1], &x, flags) > 0; j-- )
+            a[j] = a[j-1];
+        a[j] = x;
+    }
+}
+
+/* Sorts the n items a, whose digits before digit d are all the same,
+   using tmp, which has room for n items.                              */
+static void radix_sort( item *a, size_t n, size_t d, int flags, item *tmp )
+{
+    size_t  count[256], start[256];
+    size_t  i, pos;
+    int     b, end;
+
+    /* The null byte at the end of a key is the digit of the items whose
+       keys have no more bytes; they are equal, and already in order.   */
+    end = ( flags & COLLATE_REVERSE ) ? 255 : 0;
+    while ( n >= SMALL_SORT ) {
+        memset(count, 0, sizeof(count));
+        for ( i = 0; i < n; i++ )
+            count[digit(&a[i], d, flags)]++;
+        for ( b = 0; b < 256 && count[b] < n; b++ )
+            ;
+        if ( b < 256 ) {        /* All of the items have the digit b. */
+            if ( d > 0 && b == end )
+                return;
+            d++;
+        }
+        else {
+            for ( b = 0, pos = 0; b < 256; b++ ) {
+                start[b] = pos;
+                pos += count[b];
+            }
+            for ( i = 0; i < n; i++ )
+                tmp[start[digit(&a[i], d, flags)]++] = a[i];
+            memcpy(a, tmp, n * sizeof(item));
+            for ( b = 0, pos = 0; b < 256; pos += count[b++] )
+                if ( count[b] > 1 && (d == 0 || b != end) )
+                    radix_sort(a + pos, count[b], d + 1, flags, tmp);
+            return;
+        }
+    }
+    insertion_sort(a, n, flags);
+}
+
+/* Stores a copy in keys of the collation key of name, transformed in buf,
+   whose size is *size and which is enlarged as needed. Returns the copy,
+   or NULL if there is no memory.                                       */
+static const char *make_key( arena *keys, const char *name, char **buf,
+                             size_t *size )
+{
+    size_t  len;
+    char   *p;
+
+    while ( (len = strxfrm(*buf, name, *size)) >= *size ) {
+        if ( NULL == (p = realloc(*buf, len + 1)) )
+            return NULL;
+        *buf  = p;
+        *size = len + 1;
+    }
+    return arena_strndup(keys, *buf, len);
+}
+
+int collate_sort( size_t n, collate_name_fn name_of, void *arg, int flags,
+                  size_t *order )
+{
+    item        *items, *tmp = NULL;
+    arena        keys;
+    char        *buf = NULL;
+    size_t       size = 0;
+    size_t       i;
+    const char  *name;
+    int          result = 0;
+
+    if ( n == 0 )
+        return 0;
+    if ( n > UINT32_MAX ) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    if ( NULL == (items = malloc(n * sizeof(item))) )
+        return -1;
+    if ( !(flags & COLLATE_BYTES) ) {
+        if ( NULL == (buf = malloc(INITIAL_KEY)) ) {
+            free(items);
+            return -1;
+        }
+        size = INITIAL_KEY;
+    }
+    arena_init(&keys, 0);
+    for ( i = 0; i < n && result == 0; i++ ) {
+        items[i].group = 0;
+        items[i].index = i;
+        name = name_of(i, arg, &items[i].group);
+        if ( flags & COLLATE_BYTES )
+            items[i].key = arena_strndup(&keys, name, strlen(name));
+        else
+            items[i].key = make_key(&keys, name, &buf, &size);
+        if ( items[i].key == NULL )
+            result = -1;
+        else
+            set_prefix(items[i].prefix, items[i].key);
+    }
+    if ( result == 0 && NULL == (tmp = malloc(n * sizeof(item))) )
+        result = -1;
+    if ( result == 0 ) {
+        radix_sort(items, n, 0, flags, tmp);
+        for ( i = 0; i < n; i++ )
+            order[i] = items[i].index;
+    }
+    else
+        errno = ENOMEM;
+    arena_free(&keys);
+    free(buf);
+    free(tmp);
+    free(items);
+    return result;
+}
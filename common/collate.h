@@ -0,0 +1,59 @@
+/*****************************************************************************
+  Title          : collate.h
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Sorting by name with collation keys computed once
+
+  Notes:
+  A comparison function that calls strcoll(), such as alphasort(), makes
+  the C library transform both names by the rules of the locale on every
+  comparison, and a sort of n names makes about n log n comparisons, so
+  each name is transformed some 20 times when n is a million. strxfrm()
+  does the same transformation once and returns the result as a key, and
+  two keys compared with strcmp() are in the order strcoll() would put
+  their names in. collate_sort() computes the key of every name once,
+  keeps the keys in an arena, and sorts records that hold the first
+  sixteen bytes of each key in two 64-bit integers, so that most names are
+  ordered without reading their keys from the arena.
+
+  Names that compare equal are left in the order in which they were given,
+  as the merge sort that glibc's qsort() uses leaves them.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#ifndef COLLATE_H
+#define COLLATE_H
+
+#include "common_hdrs.h"
+
+/* Flags for collate_sort() */
+#define COLLATE_BYTES    1   /* Order names as strcmp() does, not strcoll() */
+#define COLLATE_REVERSE  2   /* Order names from last to first              */
+
+/* The type of the function that collate_sort() calls to get the name of
+   item i of the caller's array, and optionally to set its group.        */
+typedef const char *(*collate_name_fn)( size_t i, void *arg, int *group );
+
+
+/** collate_sort(n, name_of, arg, flags, order) sorts n items by name. It
+    calls name_of(i, arg, &group) once for each i from 0 to n-1, with group
+    set to 0; name_of returns the name of item i, which is copied before the
+    next call, and may set group to a number from 0 to 255, so that items
+    of lower groups come first whatever their names. It stores in order[j]
+    the index of the item that goes in position j. The names are ordered as
+    strcoll() orders them in the current locale, or as flags say. It
+    returns 0, or -1 with errno ENOMEM, or EOVERFLOW if n is more than
+    UINT32_MAX, in which case order is unchanged.
+*/
+int collate_sort( size_t n, collate_name_fn name_of, void *arg, int flags,
+                  size_t *order );
+
+#endif /* COLLATE_H */
@@ -0,0 +1,593 @@
+/*****************************************************************************
+  Title          : copy_utils.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Functions that copy data between file descriptors
+
+  Notes:
+  Each engine copies until it has copied the requested number of bytes or
+  reached end of file, and keeps the running totals in the caller's
+  variables, so that when copy_fd() has to fall back to another engine,
+  that engine continues from where the last one stopped.
+
+  copy_file_range() and sendfile() return 0 at end of file, but also
+  return 0 for files such as those in /proc whose size is reported as 0.
+  If the very first call returns 0 while the file's size says there is
+  more to read, the engine is treated as unable to copy the file.
+
+  copy_sparse() writes nothing at all for a hole. The target gets its size
+  from ftruncate() at the end, so the holes cost no I/O, and a file that is
+  mostly holes is copied in the time it takes to copy its data.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#define _GNU_SOURCE
+#include "common_hdrs.h"
+#include <sys/sendfile.h>
+#include <sys/mman.h>
+#include "copy_utils.h"
+
+#define MAX_CHUNK     (1L << 30)   /* Most bytes requested by one call     */
+#define DRAIN_BUFSIZE (64*1024)    /* Buffer for emptying a pipe by hand    */
+#define MMAP_WINDOW   (64L*1024*1024) /* Bytes mapped at a time             */
+
+/* Every engine has this signature; it returns 0 when done, -1 on error. */
+typedef int (*engine_func)( int in_fd, int out_fd, off_t *remaining,
+                            off_t *copied, size_t bufsize );
+
+static const char *engine_names[NUM_COPY_ENGINES] = {
+    "auto", "copy_file_range", "sendfile", "splice", "rw", "mmap",
+    "mmap_both"
+};
+
+static const char *sparse_names[NUM_SPARSE_MODES] = {
+    "never", "auto", "always"
+};
+
+static BOOL map_populate = FALSE;   /* Whether to use MAP_POPULATE */
+
+const char *copy_engine_name( copy_engine engine )
+{
+    return engine_names[engine];
+}
+
+int parse_copy_engine( const char *name )
+{
+    for ( int i = 0; i < NUM_COPY_ENGINES; i++ )
+        if ( strcmp(name, engine_names[i]) == 0 )
+            return i;
+    return -1;
+}
+
+ssize_t write_all( int fd, const void *buf, size_t count )
+{
+    const char *p = buf;
+    size_t      left = count;
+    ssize_t     n;
+
+    while ( left > 0 ) {
+        if ( -1 == (n = write(fd, p, left)) ) {
+            if ( errno == EINTR )
+                continue;
+            return -1;
+        }
+        p    += n;
+        left -= n;
+    }
+    return count;
+}
+
+/* Returns TRUE if err is an error by which the kernel says that a method
+   of copying cannot be used for the given files.                        */
+static BOOL unsupported( int err )
+{
+    return err == EINVAL || err == EXDEV || err == ENOSYS ||
+           err == EOPNOTSUPP;
+}
+
+/* Returns the number of bytes to request next: what remains to be copied,
+   but no more than limit.                                               */
+static size_t next_chunk( off_t remaining, size_t limit )
+{
+    if ( remaining == COPY_TO_EOF || (size_t) remaining > limit )
+        return limit;
+    return remaining;
+}
+
+/* Adds n bytes to the total copied and takes them from what remains. */
+static void account( off_t *remaining, off_t *copied, ssize_t n )
+{
+    *copied += n;
+    if ( *remaining != COPY_TO_EOF )
+        *remaining -= n;
+}
+
+/* Returns TRUE if fd is a regular file whose offset is at or past the end
+   of the file, i.e., if a 0 returned by a read from it really means EOF. */
+static BOOL at_eof( int fd )
+{
+    struct stat sb;
+
+    if ( -1 == fstat(fd, &sb) || !S_ISREG(sb.st_mode) )
+        return FALSE;
+    return lseek(fd, 0, SEEK_CUR) >= sb.st_size;
+}
+
+static int range_copy( int in_fd, int out_fd, off_t *remaining,
+                       off_t *copied, size_t bufsize )
+{
+    ssize_t n;
+    BOOL    first = TRUE;
+
+    while ( *remaining != 0 ) {
+        n = copy_file_range(in_fd, NULL, out_fd, NULL,
+                            next_chunk(*remaining, MAX_CHUNK), 0);
+        if ( n == -1 ) {
+            if ( errno == EINTR )
+                continue;
+            return -1;
+        }
+        if ( n == 0 ) {
+            if ( first && !at_eof(in_fd) ) {
+                errno = EINVAL;
+                return -1;
+            }
+            break;
+        }
+        account(remaining, copied, n);
+        first = FALSE;
+    }
+    return 0;
+}
+
+static int sendfile_copy( int in_fd, int out_fd, off_t *remaining,
+                          off_t *copied, size_t bufsize )
+{
+    ssize_t n;
+    BOOL    first = TRUE;
+
+    while ( *remaining != 0 ) {
+        n = sendfile(out_fd, in_fd, NULL, next_chunk(*remaining, MAX_CHUNK));
+        if ( n == -1 ) {
+            if ( errno == EINTR )
+                continue;
+            return -1;
+        }
+        if ( n == 0 ) {
+            if ( first && !at_eof(in_fd) ) {
+                errno = EINVAL;
+                return -1;
+            }
+            break;
+        }
+        account(remaining, copied, n);
+        first = FALSE;
+    }
+    return 0;
+}
+
+/* Moves count bytes from the pipe to out_fd. If out_fd cannot be spliced
+   to, the bytes still in the pipe are moved with read() and write() so
+   that none are lost, and -1 is returned with errno set by splice(), so
+   that the caller can switch to another engine.                         */
+static int drain_pipe( int pipe_fd, int out_fd, size_t count )
+{
+    char    buf[DRAIN_BUFSIZE];
+    ssize_t n;
+    int     saved_errno;
+
+    while ( count > 0 ) {
+        n = splice(pipe_fd, NULL, out_fd, NULL, count,
+                   SPLICE_F_MOVE | SPLICE_F_MORE);
+        if ( n == -1 ) {
+            if ( errno == EINTR )
+                continue;
+            break;
+        }
+        count -= n;
+    }
+    if ( count == 0 )
+        return 0;
+
+    saved_errno = errno;
+    if ( !unsupported(saved_errno) )
+        return -1;
+    while ( count > 0 ) {
+        n = read(pipe_fd, buf, count < sizeof(buf) ? count : sizeof(buf));
+        if ( n <= 0 || -1 == write_all(out_fd, buf, n) )
+            return -1;
+        count -= n;
+    }
+    errno = saved_errno;
+    return -1;
+}
+
+static int splice_copy( int in_fd, int out_fd, off_t *remaining,
+                        off_t *copied, size_t bufsize )
+{
+    int     pipefd[2];
+    ssize_t n;
+    int     retval = 0;
+    int     saved_errno;
+
+    if ( -1 == pipe(pipefd) )
+        return -1;
+    /* A larger pipe means fewer calls; if it fails, the default is used. */
+    fcntl(pipefd[1], F_SETPIPE_SZ, bufsize);
+
+    while ( *remaining != 0 ) {
+        n = splice(in_fd, NULL, pipefd[1], NULL,
+                   next_chunk(*remaining, bufsize),
+                   SPLICE_F_MOVE | SPLICE_F_MORE);
+        if ( n == -1 ) {
+            if ( errno == EINTR )
+                continue;
+            retval = -1;
+            break;
+        }
+        if ( n == 0 )
+            break;
+        if ( -1 == drain_pipe(pipefd[0], out_fd, n) ) {
+            if ( unsupported(errno) )   /* The bytes were written anyway. */
+                account(remaining, copied, n);
+            retval = -1;
+            break;
+        }
+        account(remaining, copied, n);
+    }
+    saved_errno = errno;
+    close(pipefd[0]);
+    close(pipefd[1]);
+    errno = saved_errno;
+    return retval;
+}
+
+static int buffered_copy( int in_fd, int out_fd, off_t *remaining,
+                          off_t *copied, size_t bufsize )
+{
+    char   *buf;
+    ssize_t n;
+    int     retval = 0;
+
+    if ( NULL == (buf = malloc(bufsize)) )
+        return -1;
+    while ( *remaining != 0 ) {
+        n = read(in_fd, buf, next_chunk(*remaining, bufsize));
+        if ( n == -1 ) {
+            if ( errno == EINTR )
+                continue;
+            retval = -1;
+            break;
+        }
+        if ( n == 0 )
+            break;
+        if ( -1 == write_all(out_fd, buf, n) ) {
+            retval = -1;
+            break;
+        }
+        account(remaining, copied, n);
+    }
+    free(buf);
+    return retval;
+}
+
+void set_mmap_populate( BOOL populate )
+{
+    map_populate = populate;
+}
+
+/* Maps len bytes of fd starting at offset, which need not be a multiple of
+   the page size, with protection prot. Returns the address of offset in
+   the mapping, and sets *base and *maplen for munmap(), or returns NULL. */
+static char *map_range( int fd, off_t offset, size_t len, int prot,
+                        char **base, size_t *maplen )
+{
+    off_t  start = offset - offset % sysconf(_SC_PAGESIZE);
+    int    flags = MAP_SHARED | ( map_populate ? MAP_POPULATE : 0 );
+
+    *maplen = len + (offset - start);
+    *base   = mmap(NULL, *maplen, prot, flags, fd, start);
+    if ( *base == MAP_FAILED )
+        return NULL;
+    /* These are only hints, so failures are ignored. */
+    madvise(*base, *maplen, MADV_SEQUENTIAL);
+    madvise(*base, *maplen, MADV_HUGEPAGE);
+    return *base + (offset - start);
+}
+
+/* Sets *offset to the offset of in_fd and *end to where the copy stops:
+   the end of the file, or sooner if less than that remains to copy.
+   Returns 0, or -1 on error. Files that cannot be mapped, and files such
+   as those in /proc whose size is 0 although they have data, are EINVAL. */
+static int map_bounds( int in_fd, off_t remaining, off_t *offset,
+                       off_t *end )
+{
+    struct stat sb;
+    char        c;
+
+    if ( -1 == fstat(in_fd, &sb) || -1 == (*offset = lseek(in_fd, 0,
+                                                           SEEK_CUR)) )
+        return -1;
+    if ( !S_ISREG(sb.st_mode) ||
+         (*offset >= sb.st_size && pread(in_fd, &c, 1, *offset) > 0) ) {
+        errno = EINVAL;
+        return -1;
+    }
+    *end = sb.st_size;
+    if ( remaining != COPY_TO_EOF && *offset + remaining < *end )
+        *end = *offset + remaining;
+    return 0;
+}
+
+static int mmap_copy( int in_fd, int out_fd, off_t *remaining,
+                      off_t *copied, size_t bufsize )
+{
+    off_t   offset, end;
+    char   *base, *src;
+    size_t  maplen, n;
+    int     retval;
+
+    if ( -1 == map_bounds(in_fd, *remaining, &offset, &end) )
+        return -1;
+    while ( offset < end ) {
+        n = next_chunk(end - offset, MMAP_WINDOW);
+        if ( NULL == (src = map_range(in_fd, offset, n, PROT_READ, &base,
+                                      &maplen)) )
+            return -1;
+        retval = write_all(out_fd, src, n);
+        munmap(base, maplen);
+        if ( retval == -1 )
+            return -1;
+        offset += n;
+        account(remaining, copied, n);
+        if ( -1 == lseek(in_fd, offset, SEEK_SET) )
+            return -1;
+    }
+    return 0;
+}
+
+static int mmap_both_copy( int in_fd, int out_fd, off_t *remaining,
+                           off_t *copied, size_t bufsize )
+{
+    struct stat sb;
+    off_t   offset, end, out_offset;
+    char   *in_base, *out_base, *src, *dst;
+    size_t  in_len, out_len, n;
+
+    if ( -1 == map_bounds(in_fd, *remaining, &offset, &end) ||
+         -1 == fstat(out_fd, &sb) ||
+         -1 == (out_offset = lseek(out_fd, 0, SEEK_CUR)) )
+        return -1;
+    /* Pages can only be mapped within the file, so extend it first. */
+    if ( sb.st_size < out_offset + (end - offset) &&
+         -1 == ftruncate(out_fd, out_offset + (end - offset)) )
+        return -1;
+    while ( offset < end ) {
+        n = next_chunk(end - offset, MMAP_WINDOW);
+        if ( NULL == (src = map_range(in_fd, offset, n, PROT_READ, &in_base,
+                                      &in_len)) )
+            return -1;
+        if ( NULL == (dst = map_range(out_fd, out_offset, n,
+                                      PROT_READ | PROT_WRITE, &out_base,
+                                      &out_len)) ) {
+            munmap(in_base, in_len);
+            return -1;
+        }
+        memcpy(dst, src, n);
+        munmap(in_base, in_len);
+        munmap(out_base, out_len);
+        offset     += n;
+        out_offset += n;
+        account(remaining, copied, n);
+        if ( -1 == lseek(in_fd, offset, SEEK_SET) ||
+             -1 == lseek(out_fd, out_offset, SEEK_SET) )
+            return -1;
+    }
+    return 0;
+}
+
+static engine_func engines[NUM_COPY_ENGINES] = {
+    NULL, range_copy, sendfile_copy, splice_copy, buffered_copy, mmap_copy,
+    mmap_both_copy
+};
+
+off_t copy_fd( int in_fd, int out_fd, off_t count, copy_engine engine,
+               size_t bufsize, copy_engine *used )
+{
+    off_t        remaining = count;
+    off_t        copied = 0;
+    copy_engine  first, last;
+
+    if ( bufsize == 0 )
+        bufsize = DEFAULT_COPY_BUFSIZE;
+    first = ( engine == COPY_AUTO ) ? COPY_RANGE : engine;
+    last  = ( engine == COPY_AUTO ) ? COPY_BUFFERED : engine;
+
+    for ( copy_engine e = first; e <= last; e++ ) {
+        if ( 0 == engines[e](in_fd, out_fd, &remaining, &copied, bufsize) ) {
+            if ( used != NULL )
+                *used = e;
+            return copied;
+        }
+        if ( !unsupported(errno) )
+            return -1;
+    }
+    return -1;
+}
+
+int parse_sparse_mode( const char *name )
+{
+    for ( int i = 0; i < NUM_SPARSE_MODES; i++ )
+        if ( strcmp(name, sparse_names[i]) == 0 )
+            return i;
+    return -1;
+}
+
+/* Makes the len bytes of fd at offset a hole. Only the part below
+   old_size, the size of fd before the copy began, can hold data; beyond
+   it the file is already a hole. Returns 0, or -1 on error.             */
+static int make_hole( int fd, off_t offset, off_t len, off_t old_size )
+{
+    static const char zeros[DRAIN_BUFSIZE];
+    size_t n;
+
+    if ( offset >= old_size )
+        return 0;
+    if ( offset + len > old_size )
+        len = old_size - offset;
+    if ( 0 == fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                        offset, len) )
+        return 0;
+    if ( !unsupported(errno) )
+        return -1;
+    while ( len > 0 ) {
+        n = ( len < (off_t) sizeof(zeros) ) ? len : sizeof(zeros);
+        if ( (ssize_t) n != pwrite(fd, zeros, n, offset) )
+            return -1;
+        offset += n;
+        len    -= n;
+    }
+    return 0;
+}
+
+/* Returns TRUE if the n bytes in buf are all zero. Comparing the buffer
+   with itself shifted by one byte lets memcmp() do the work.            */
+static BOOL all_zeros( const char *buf, size_t n )
+{
+    return n == 0 || ( buf[0] == 0 && memcmp(buf, buf + 1, n - 1) == 0 );
+}
+
+/* Copies count bytes from offset of in_fd to the same offset of out_fd
+   through a buffer, making a hole of every buffer of zeros. Returns the
+   number of bytes written, or -1 on error.                              */
+static off_t copy_nonzero( int in_fd, int out_fd, off_t offset, off_t count,
+                           size_t bufsize, off_t old_size )
+{
+    char   *buf;
+    ssize_t n;
+    off_t   written = 0;
+
+    if ( NULL == (buf = malloc(bufsize)) )
+        return -1;
+    while ( count > 0 ) {
+        n = pread(in_fd, buf, next_chunk(count, bufsize), offset);
+        if ( n == -1 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            break;
+        if ( all_zeros(buf, n) ) {
+            if ( -1 == make_hole(out_fd, offset, n, old_size) )
+                break;
+        }
+        else {
+            if ( n != pwrite(out_fd, buf, n, offset) )
+                break;
+            written += n;
+        }
+        offset += n;
+        count  -= n;
+    }
+    free(buf);
+    return ( count > 0 && n != 0 ) ? -1 : written;
+}
+
+off_t copy_sparse_range( int in_fd, int out_fd, off_t offset, off_t count,
+                         sparse_mode mode, copy_engine engine, size_t bufsize,
+                         copy_engine *used )
+{
+    struct stat in_sb, out_sb;
+    off_t  pos = offset, end, data, hole, n;
+    off_t  written = 0;
+
+    if ( bufsize == 0 )
+        bufsize = DEFAULT_COPY_BUFSIZE;
+    if ( -1 == fstat(in_fd, &in_sb) || -1 == fstat(out_fd, &out_sb) )
+        return -1;
+    end = in_sb.st_size;
+    if ( count != COPY_TO_EOF && offset + count < end )
+        end = offset + count;
+
+    if ( used != NULL )
+        *used = ( mode == SPARSE_ALWAYS ) ? COPY_BUFFERED : engine;
+    while ( pos < end ) {
+        /* Find the next data region, [data, hole). */
+        if ( mode == SPARSE_NEVER )
+            data = pos;
+        else if ( -1 == (data = lseek(in_fd, pos, SEEK_DATA)) ) {
+            if ( errno == ENXIO )        /* Only a hole remains. */
+                data = end;
+            else if ( unsupported(errno) )
+                data = pos;              /* The file system has no holes. */
+            else
+                return -1;
+        }
+        if ( data >= end )
+            hole = data = end;
+        else if ( mode == SPARSE_NEVER ||
+                  -1 == (hole = lseek(in_fd, data, SEEK_HOLE)) || hole > end )
+            hole = end;
+
+        if ( -1 == make_hole(out_fd, pos, data - pos, out_sb.st_size) )
+            return -1;
+        if ( data == hole )
+            break;
+
+        if ( mode == SPARSE_ALWAYS )
+            n = copy_nonzero(in_fd, out_fd, data, hole - data, bufsize,
+                             out_sb.st_size);
+        else if ( -1 == lseek(in_fd, data, SEEK_SET) ||
+                  -1 == lseek(out_fd, data, SEEK_SET) )
+            return -1;
+        else
+            n = copy_fd(in_fd, out_fd, hole - data, engine, bufsize, used);
+        if ( n == -1 )
+            return -1;
+        written += n;
+        pos = hole;
+    }
+    return written;
+}
+
+off_t copy_sparse( int in_fd, int out_fd, sparse_mode mode, copy_engine engine,
+                   size_t bufsize, copy_engine *used )
+{
+    struct stat in_sb, out_sb;
+    off_t  written;
+
+    if ( -1 == fstat(in_fd, &in_sb) || -1 == fstat(out_fd, &out_sb) )
+        return -1;
+    /* A pipe, terminal or device cannot seek, hold holes or be truncated,
+       so it is written from the current offset, as by write().          */
+    if ( !S_ISREG(out_sb.st_mode) )
+        return copy_fd(in_fd, out_fd, COPY_TO_EOF, engine, bufsize, used);
+    if ( -1 == lseek(out_fd, 0, SEEK_SET) )
+        return -1;
+
+    /* A pipe or terminal cannot seek either, so it is read from where it
+       is, and a file in /proc has data although its size is 0, and no
+       holes.                                                            */
+    if ( mode == SPARSE_NEVER || !S_ISREG(in_sb.st_mode) ||
+         in_sb.st_size == 0 ) {
+        if ( S_ISREG(in_sb.st_mode) && -1 == lseek(in_fd, 0, SEEK_SET) )
+            return -1;
+        if ( -1 == (written = copy_fd(in_fd, out_fd, COPY_TO_EOF, engine,
+                                      bufsize, used)) )
+            return -1;
+        if ( -1 == ftruncate(out_fd, written) )
+            return -1;
+        return written;
+    }
+    if ( -1 == (written = copy_sparse_range(in_fd, out_fd, 0, COPY_TO_EOF,
+                                            mode, engine, bufsize, used)) ||
+         -1 == ftruncate(out_fd, in_sb.st_size) )
+        return -1;
+    return written;
+}
@@ -0,0 +1,192 @@
+/*****************************************************************************
+  Title          : dir_stream.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Reading and sorting directories with millions of entries
+
+  Notes:
+  name_list_sort() sorts the entries with collate_sort() (see collate.h),
+  which computes the collation key of each name once, and then permutes
+  the offsets. If there is no memory for the keys, it sorts the offsets
+  with qsort_r(), comparing the names with strcoll() and passing the
+  buffer of names to the comparison, so that no global variable is needed.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#define _GNU_SOURCE
+#include "common_hdrs.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include "collate.h"
+#include "dir_stream.h"
+
+#define INITIAL_NAMES    (64*1024)   /* Initial bytes for names    */
+#define INITIAL_ENTRIES  1024        /* Initial number of offsets  */
+
+void dir_stream_init( dir_stream *ds, size_t size )
+{
+    ds->fd   = -1;
+    ds->buf  = NULL;
+    ds->size = ( size > 0 ) ? size : DIR_STREAM_BUFSIZE;
+    ds->pos  = ds->end = 0;
+}
+
+int dir_stream_open( dir_stream *ds, int dirfd, const char *path )
+{
+    dir_stream_close(ds);
+    if ( ds->buf == NULL && NULL == (ds->buf = malloc(ds->size)) )
+        return -1;
+    ds->fd = openat(dirfd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    ds->pos = ds->end = 0;
+    return ( ds->fd == -1 ) ? -1 : 0;
+}
+
+const char *dir_stream_read( dir_stream *ds, unsigned char *type )
+{
+    struct dirent64 *e;
+    ssize_t          n;
+
+    if ( ds->pos >= ds->end ) {
+        if ( -1 == (n = getdents64(ds->fd, ds->buf, ds->size)) || n == 0 )
+            return NULL;
+        ds->pos = 0;
+        ds->end = n;
+    }
+    e = (struct dirent64*) (ds->buf + ds->pos);
+    ds->pos += e->d_reclen;
+    *type = e->d_type;
+    return e->d_name;
+}
+
+int dir_stream_fd( const dir_stream *ds )
+{
+    return ds->fd;
+}
+
+void dir_stream_close( dir_stream *ds )
+{
+    if ( ds->fd != -1 )
+        close(ds->fd);
+    ds->fd = -1;
+}
+
+void dir_stream_free( dir_stream *ds )
+{
+    dir_stream_close(ds);
+    free(ds->buf);
+    ds->buf = NULL;
+}
+
+void name_list_init( name_list *nl )
+{
+    memset(nl, 0, sizeof(name_list));
+}
+
+int name_list_add( name_list *nl, const char *name, unsigned char type )
+{
+    size_t  len = strlen(name) + 2;      /* The type, name and null byte */
+    size_t  size;
+    void   *p;
+
+    if ( nl->used + len > nl->size ) {
+        size = ( nl->size > 0 ) ? 2 * nl->size : INITIAL_NAMES;
+        while ( size < nl->used + len )
+            size *= 2;
+        if ( NULL == (p = realloc(nl->names, size)) )
+            return -1;
+        nl->names = p;
+        nl->size  = size;
+    }
+    if ( nl->count == nl->max ) {
+        size = ( nl->max > 0 ) ? 2 * nl->max : INITIAL_ENTRIES;
+        if ( NULL == (p = realloc(nl->offsets, size * sizeof(size_t))) )
+            return -1;
+        nl->offsets = p;
+        nl->max     = size;
+    }
+    nl->offsets[nl->count++] = nl->used;
+    nl->names[nl->used] = type;
+    memcpy(nl->names + nl->used + 1, name, len - 1);
+    nl->used += len;
+    return 0;
+}
+
+/* Compares the entries at the offsets a and b in names by name, with
+   strcoll(), as alphasort() does.                                     */
+static int by_name( const void *a, const void *b, void *names )
+{
+    return strcoll((char*) names + *(const size_t*) a + 1,
+                   (char*) names + *(const size_t*) b + 1);
+}
+
+/* Compares the entries at the offsets a and b in names, putting
+   directories before everything else.                                 */
+static int dirs_then_names( const void *a, const void *b, void *names )
+{
+    BOOL  a_dir = ( ((char*) names)[*(const size_t*) a] == DT_DIR );
+    BOOL  b_dir = ( ((char*) names)[*(const size_t*) b] == DT_DIR );
+
+    if ( a_dir != b_dir )
+        return a_dir ? -1 : 1;
+    return by_name(a, b, names);
+}
+
+/* Returns the name of entry i of the name_list arg. */
+static const char *entry_name( size_t i, void *arg, int *group )
+{
+    return NAME_LIST_NAME((name_list*) arg, i);
+}
+
+/* Returns the name of entry i of the name_list arg, putting it in group
+   1 if it is not a directory.                                         */
+static const char *entry_name_dirs_first( size_t i, void *arg, int *group )
+{
+    if ( NAME_LIST_TYPE((name_list*) arg, i) != DT_DIR )
+        *group = 1;
+    return NAME_LIST_NAME((name_list*) arg, i);
+}
+
+void name_list_sort( name_list *nl, BOOL dirs_first )
+{
+    size_t  *order, *sorted;
+    size_t   i;
+
+    if ( nl->count < 2 )
+        return;
+    order  = malloc(nl->count * sizeof(size_t));
+    sorted = malloc(nl->count * sizeof(size_t));
+    if ( order != NULL && sorted != NULL
+         && 0 == collate_sort(nl->count, dirs_first ? entry_name_dirs_first
+                              : entry_name, nl, 0, order) ) {
+        for ( i = 0; i < nl->count; i++ )
+            sorted[i] = nl->offsets[order[i]];
+        memcpy(nl->offsets, sorted, nl->count * sizeof(size_t));
+    }
+    else    /* Without the memory for the keys, sort the slow way. */
+        qsort_r(nl->offsets, nl->count, sizeof(size_t),
+                dirs_first ? dirs_then_names : by_name, nl->names);
+    free(order);
+    free(sorted);
+}
+
+void name_list_clear( name_list *nl )
+{
+    nl->used  = 0;
+    nl->count = 0;
+}
+
+void name_list_free( name_list *nl )
+{
+    free(nl->names);
+    free(nl->offsets);
+    name_list_init(nl);
+}
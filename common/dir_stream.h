@@ -0,0 +1,122 @@
+/*****************************************************************************
+  Title          : dir_stream.h
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Reading and sorting directories with millions of entries
+
+  Notes:
+  scandir() allocates a dirent for every entry with malloc() and returns
+  only when it has read the whole directory, so listing a directory of
+  millions of files takes gigabytes of heap and prints nothing until the
+  end. A dir_stream reads a directory with getdents64() into one large
+  buffer, which is reused for every call and for every directory that the
+  stream opens, and hands out the entries one at a time, so a program that
+  does not sort can print each entry as soon as it is read.
+
+  A name_list holds the entries of a directory for sorting. Each entry's
+  type and name are appended to a single buffer, and an array holds the
+  offset of each entry in the buffer, so the list costs two allocations
+  that grow by doubling, however many entries it holds, and it can be
+  cleared and refilled without freeing them. Sorting permutes only the
+  offsets.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#ifndef DIR_STREAM_H
+#define DIR_STREAM_H
+
+#include "common_hdrs.h"
+#include <dirent.h>
+
+#define DIR_STREAM_BUFSIZE  (1024*1024)  /* Bytes read by each getdents64() */
+
+/* A directory being read */
+typedef struct
+{
+    int      fd;          /* -1 if no directory is open */
+    char    *buf;
+    size_t   size;
+    long     pos;         /* Offset in buf of the next entry */
+    long     end;         /* Bytes in buf                    */
+} dir_stream;
+
+/* The entries of a directory */
+typedef struct
+{
+    char     *names;      /* Each entry's d_type, then its name   */
+    size_t    used;
+    size_t    size;
+    size_t   *offsets;    /* Of each entry in names               */
+    size_t    count;
+    size_t    max;
+} name_list;
+
+/* The name and d_type of the entry at index i of the name_list nl */
+#define NAME_LIST_NAME(nl, i)  ((nl)->names + (nl)->offsets[i] + 1)
+#define NAME_LIST_TYPE(nl, i)  ((unsigned char) (nl)->names[(nl)->offsets[i]])
+
+
+/** dir_stream_init(&ds, size) prepares ds to read directories with a
+    buffer of size bytes, or DIR_STREAM_BUFSIZE if size is 0. The buffer
+    is allocated when the first directory is opened.
+*/
+void dir_stream_init( dir_stream *ds, size_t size );
+
+/** dir_stream_open(&ds, dirfd, path) opens the directory at path, relative
+    to dirfd as with openat(), closing any directory that ds had open. It
+    returns 0, or -1 with errno set.
+*/
+int dir_stream_open( dir_stream *ds, int dirfd, const char *path );
+
+/** dir_stream_read(&ds, &type) returns the name of the next entry of the
+    open directory, including "." and "..", and stores its d_type in type.
+    The name is valid until the next call. It returns NULL, with errno
+    unchanged, at the end of the directory, and NULL with errno set if the
+    directory cannot be read.
+*/
+const char *dir_stream_read( dir_stream *ds, unsigned char *type );
+
+/** dir_stream_fd(&ds) returns the descriptor of the open directory.
+*/
+int dir_stream_fd( const dir_stream *ds );
+
+/** dir_stream_close(&ds) closes the directory, keeping the buffer for the
+    next one.
+*/
+void dir_stream_close( dir_stream *ds );
+
+/** dir_stream_free(&ds) closes the directory and frees the buffer.
+*/
+void dir_stream_free( dir_stream *ds );
+
+/** name_list_init(&nl) makes nl an empty list.
+*/
+void name_list_init( name_list *nl );
+
+/** name_list_add(&nl, name, type) appends an entry to nl. It returns 0, or
+    -1 with errno set if there is no memory.
+*/
+int name_list_add( name_list *nl, const char *name, unsigned char type );
+
+/** name_list_sort(&nl, dirs_first) sorts nl into the order of alphasort(),
+    or, if dirs_first is TRUE, into that of dirsfirstsort() in dir_utils.h.
+*/
+void name_list_sort( name_list *nl, BOOL dirs_first );
+
+/** name_list_clear(&nl) empties nl, keeping its memory.
+*/
+void name_list_clear( name_list *nl );
+
+/** name_list_free(&nl) frees the memory of nl and empties it.
+*/
+void name_list_free( name_list *nl );
+
+#endif /* DIR_STREAM_H */
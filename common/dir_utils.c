@@ -11,6 +11,8 @@
 *****************************************************************************/
 #include "common_hdrs.h"
 #include <dirent.h>
+#include "collate.h"
+#include "dir_utils.h"
 
 BOOL isdir(  const struct dirent *direntp)
 {
@@ -37,3 +39,46 @@ int dirsfirstsort(const struct dirent **a, const struct dirent **b)
         else
             return (alphasort(a,b));
 }
+
+/* The array that sortdirents() sorts */
+typedef struct
+{
+    struct dirent **namelist;
+    BOOL            dirs_first;
+} dirent_array;
+
+/* Returns the name of entry i of the dirent_array arg, and puts it in
+   group 1 if directories go first and it is not one.                 */
+static const char *entry_name( size_t i, void *arg, int *group )
+{
+    dirent_array *a = arg;
+
+    if ( a->dirs_first && !isdir(a->namelist[i]) )
+        *group = 1;
+    return a->namelist[i]->d_name;
+}
+
+void sortdirents(struct dirent **namelist, int n, BOOL dirs_first)
+{
+    dirent_array     a = { namelist, dirs_first };
+    size_t          *order;
+    struct dirent  **sorted;
+    int              i;
+
+    if ( n < 2 )
+        return;
+    order  = malloc(n * sizeof(size_t));
+    sorted = malloc(n * sizeof(struct dirent*));
+    if ( order != NULL && sorted != NULL
+         && 0 == collate_sort(n, entry_name, &a, 0, order) ) {
+        for ( i = 0; i < n; i++ )
+            sorted[i] = namelist[order[i]];
+        memcpy(namelist, sorted, n * sizeof(struct dirent*));
+    }
+    else    /* Without the memory for the keys, sort the slow way. */
+        qsort(namelist, n, sizeof(struct dirent*),
+              (int (*)(const void*, const void*))
+              (dirs_first ? dirsfirstsort : alphasort));
+    free(order);
+    free(sorted);
+}
@@ -37,4 +37,13 @@ BOOL isdir( const struct dirent *direntp);
 */
 int dirsfirstsort(const struct dirent **a, const struct dirent **b);
 
+/** sortdirents(namelist, n, dirs_first) sorts the n entries in namelist,
+*   as returned by scandir() with no comparison function, into the order
+*   that alphasort() gives them, or dirsfirstsort() if dirs_first is TRUE.
+*   It computes the collation key of each name only once (see collate.h),
+*   so it is much faster than passing either function to scandir() when
+*   the directory is large and the locale is not "C".
+*/
+void sortdirents(struct dirent **namelist, int n, BOOL dirs_first);
+
 #endif /* DIR_UTILS_H */
@@ -0,0 +1,478 @@
+/*****************************************************************************
+  Title          : du_index.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : A file that remembers the contents of directories between
+                   walks of a hierarchy
+
+  Notes:
+  Numbers are stored in the byte order of the machine, so an index cannot
+  be moved to a machine of the other order; its header would still match,
+  but no record would. Every record and every entry starts at a multiple
+  of 8 bytes, so that the fields of a record can be read in place from the
+  mapped file.
+
+  A file is compacted by writing its current records to a new file, which
+  is locked before it is renamed over the old one. A process that was
+  waiting for the lock of the old file then finds, once it has the lock,
+  that the file it opened is no longer the one with that name, and opens
+  the name again.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#define _GNU_SOURCE
+#include "common_hdrs.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include "du_index.h"
+
+#define INDEX_MAGIC     "SPLDUIX1"
+#define INDEX_VERSION   1
+#define FLUSH_SIZE      (1024*1024)   /* Bytes buffered before writing   */
+#define MIN_COMPACT     (1024*1024)   /* Smallest file worth compacting  */
+#define ALIGN8(n)       (((n) + 7) & ~(size_t) 7)
+
+typedef struct
+{
+    char      magic[8];
+    uint32_t  version;
+    uint32_t  unused;
+} index_header;
+
+/* The record of one directory, which is followed by its entries */
+struct du_index_rec_tag
+{
+    uint32_t  size;           /* Bytes in the record and its entries     */
+    uint32_t  num_entries;
+    uint64_t  dev;
+    uint64_t  ino;
+    int64_t   mtime_sec;
+    int64_t   ctime_sec;
+    uint32_t  mtime_nsec;
+    uint32_t  ctime_nsec;
+};
+
+/* One entry, padded to a multiple of 8 bytes */
+typedef struct
+{
+    uint64_t  usage;
+    uint64_t  ino;
+    uint16_t  len;            /* Length of name                          */
+    uint8_t   kind;
+    uint8_t   linked;
+    char      name[];
+} rec_entry;
+
+#define ENTRY_SIZE(len)  ALIGN8(offsetof(rec_entry, name) + (len))
+
+/* A slot of the hash table; offset 0 means that it is empty, since the
+   header is at offset 0.                                               */
+typedef struct
+{
+    uint64_t  dev;
+    uint64_t  ino;
+    uint64_t  offset;
+} slot;
+
+struct du_index_tag
+{
+    char     *file;
+    int       fd;
+    char     *map;            /* The file, as it was when opened         */
+    size_t    map_size;
+    size_t    end;            /* End of the last valid record            */
+    size_t    live;           /* Bytes in records not superseded         */
+    slot     *table;
+    size_t    table_size;     /* A power of 2                            */
+    char     *buf;            /* Records waiting to be written           */
+    size_t    buf_used;
+    size_t    buf_size;
+};
+
+/*----------------------------------------------------------------------------
+                              Reading the file
+----------------------------------------------------------------------------*/
+
+static size_t hash_key( uint64_t dev, uint64_t ino, size_t table_size )
+{
+    uint64_t h = (ino ^ (dev << 32) ^ (dev >> 32)) * 0x9E3779B97F4A7C15ULL;
+    return (size_t) (h >> 17) & (table_size - 1);
+}
+
+/* Returns the slot for dev and ino, which is empty if there is no record
+   for them.                                                            */
+static slot *find_slot( const du_index *idx, uint64_t dev, uint64_t ino )
+{
+    size_t i = hash_key(dev, ino, idx->table_size);
+
+    while ( idx->table[i].offset != 0 &&
+            (idx->table[i].dev != dev || idx->table[i].ino != ino) )
+        i = (i + 1) & (idx->table_size - 1);
+    return &idx->table[i];
+}
+
+/* Returns the size of the record at offset in the map, or 0 if it is not
+   a complete and well-formed record.                                   */
+static size_t check_record( const du_index *idx, size_t offset )
+{
+    const du_index_rec *rec = (const du_index_rec*) (idx->map + offset);
+    const rec_entry    *e;
+    size_t              pos;
+
+    if ( idx->map_size - offset < sizeof(du_index_rec) ||
+         rec->size < sizeof(du_index_rec) || rec->size % 8 != 0 ||
+         rec->size > idx->map_size - offset )
+        return 0;
+    pos = sizeof(du_index_rec);
+    for ( uint32_t i = 0; i < rec->num_entries; i++ ) {
+        if ( rec->size - pos < offsetof(rec_entry, name) )
+            return 0;
+        e = (const rec_entry*) ((const char*) rec + pos);
+        if ( rec->size - pos < ENTRY_SIZE(e->len) )
+            return 0;
+        pos += ENTRY_SIZE(e->len);
+    }
+    return ( pos == rec->size ) ? pos : 0;
+}
+
+/* Writes a new header to the empty file of idx. */
+static int write_header( int fd )
+{
+    index_header h;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+    h.version = INDEX_VERSION;
+    if ( -1 == ftruncate(fd, 0) )
+        return -1;
+    if ( sizeof(h) != pwrite(fd, &h, sizeof(h), 0) )
+        return -1;
+    return 0;
+}
+
+/* Maps the file of idx, checks its records, and builds the hash table. */
+static int load( du_index *idx )
+{
+    struct stat          sb;
+    const index_header  *h;
+    const du_index_rec  *rec;
+    size_t               offset, size, count = 0;
+    slot                *s;
+
+    if ( -1 == fstat(idx->fd, &sb) )
+        return -1;
+    idx->map_size = sb.st_size;
+    idx->map      = NULL;
+    if ( idx->map_size >= sizeof(index_header) ) {
+        idx->map = mmap(NULL, idx->map_size, PROT_READ, MAP_SHARED,
+                        idx->fd, 0);
+        if ( idx->map == MAP_FAILED )
+            return -1;
+    }
+    h = (const index_header*) idx->map;
+    if ( h == NULL || 0 != memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) ||
+         h->version != INDEX_VERSION ) {
+        if ( idx->map != NULL )
+            munmap(idx->map, idx->map_size);
+        idx->map      = NULL;
+        idx->map_size = 0;
+        if ( -1 == write_header(idx->fd) )
+            return -1;
+    }
+
+    /* Count the valid records to size the table. */
+    offset = sizeof(index_header);
+    while ( idx->map != NULL && 0 != (size = check_record(idx, offset)) ) {
+        offset += size;
+        count++;
+    }
+    idx->end = offset;
+    for ( idx->table_size = 1024; idx->table_size < 2 * count; )
+        idx->table_size *= 2;
+    if ( NULL == (idx->table = calloc(idx->table_size, sizeof(slot))) )
+        return -1;
+
+    idx->live = 0;
+    for ( offset = sizeof(index_header); offset < idx->end;
+          offset += rec->size ) {
+        rec = (const du_index_rec*) (idx->map + offset);
+        s   = find_slot(idx, rec->dev, rec->ino);
+        if ( s->offset != 0 )
+            idx->live -= ((const du_index_rec*) (idx->map + s->offset))->size;
+        s->dev    = rec->dev;
+        s->ino    = rec->ino;
+        s->offset = offset;
+        idx->live += rec->size;
+    }
+    return 0;
+}
+
+/* Releases the map and table of idx. */
+static void unload( du_index *idx )
+{
+    if ( idx->map != NULL )
+        munmap(idx->map, idx->map_size);
+    free(idx->table);
+    idx->map   = NULL;
+    idx->table = NULL;
+}
+
+static int write_all( int fd, const char *buf, size_t len, off_t offset )
+{
+    ssize_t n;
+
+    while ( len > 0 ) {
+        if ( -1 == (n = pwrite(fd, buf, len, offset)) ) {
+            if ( errno == EINTR )
+                continue;
+            return -1;
+        }
+        buf    += n;
+        len    -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* Replaces the file of idx by one with only its current records, and
+   loads that file instead.                                           */
+static int compact( du_index *idx )
+{
+    char    *tmpname;
+    int      fd;
+    off_t    offset = sizeof(index_header);
+    const du_index_rec *rec;
+
+    if ( -1 == asprintf(&tmpname, "%s.tmp", idx->file) )
+        return -1;
+    fd = open(tmpname, O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+    if ( fd == -1 || -1 == flock(fd, LOCK_EX) || -1 == write_header(fd) ) {
+        if ( fd != -1 )
+            close(fd);
+        free(tmpname);
+        return -1;
+    }
+    for ( size_t i = 0; i < idx->table_size; i++ ) {
+        if ( idx->table[i].offset == 0 )
+            continue;
+        rec = (const du_index_rec*) (idx->map + idx->table[i].offset);
+        if ( -1 == write_all(fd, (const char*) rec, rec->size, offset) )
+            break;
+        offset += rec->size;
+    }
+    if ( offset != (off_t) (sizeof(index_header) + idx->live) ||
+         -1 == rename(tmpname, idx->file) ) {
+        unlink(tmpname);
+        close(fd);
+        free(tmpname);
+        return -1;
+    }
+    free(tmpname);
+    unload(idx);
+    close(idx->fd);
+    idx->fd = fd;
+    return load(idx);
+}
+
+du_index *du_index_open( const char *file )
+{
+    du_index    *idx;
+    struct stat  sb_fd, sb_name;
+    int          err;
+
+    if ( NULL == (idx = calloc(1, sizeof(du_index))) )
+        return NULL;
+    if ( NULL == (idx->file = strdup(file)) ) {
+        free(idx);
+        return NULL;
+    }
+    /* Open and lock the file, again if it was replaced while waiting. */
+    while ( TRUE ) {
+        idx->fd = open(file, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+        if ( idx->fd == -1 || -1 == flock(idx->fd, LOCK_EX) ||
+             -1 == fstat(idx->fd, &sb_fd) )
+            break;
+        if ( 0 == stat(file, &sb_name) && sb_name.st_ino == sb_fd.st_ino &&
+             sb_name.st_dev == sb_fd.st_dev )
+            break;
+        close(idx->fd);
+    }
+    if ( idx->fd != -1 && 0 == load(idx) ) {
+        /* Compacting is only worth doing if most of the file is dead. */
+        if ( idx->end > MIN_COMPACT &&
+             idx->live < (idx->end - sizeof(index_header)) / 2 )
+            compact(idx);
+        if ( idx->table != NULL )
+            return idx;
+    }
+    err = errno;
+    du_index_close(idx);
+    errno = err;
+    return NULL;
+}
+
+const du_index_rec *du_index_find( const du_index *idx, dev_t dev, ino_t ino,
+                                   const struct timespec *mtime,
+                                   const struct timespec *ctime )
+{
+    const slot          *s = find_slot(idx, dev, ino);
+    const du_index_rec  *rec;
+
+    if ( s->offset == 0 )
+        return NULL;
+    rec = (const du_index_rec*) (idx->map + s->offset);
+    if ( rec->mtime_sec != mtime->tv_sec || rec->mtime_nsec != mtime->tv_nsec
+         || rec->ctime_sec != ctime->tv_sec
+         || rec->ctime_nsec != ctime->tv_nsec )
+        return NULL;
+    return rec;
+}
+
+const void *du_index_next( const du_index_rec *rec, const void *pos,
+                           du_index_entry *entry )
+{
+    const rec_entry *e;
+
+    if ( pos == NULL )
+        pos = (const char*) rec + sizeof(du_index_rec);
+    if ( (const char*) pos >= (const char*) rec + rec->size )
+        return NULL;
+    e = pos;
+    entry->name   = e->name;
+    entry->len    = e->len;
+    entry->usage  = e->usage;
+    entry->ino    = e->ino;
+    entry->kind   = e->kind;
+    entry->linked = e->linked;
+    return (const char*) pos + ENTRY_SIZE(e->len);
+}
+
+/*----------------------------------------------------------------------------
+                              Writing the file
+----------------------------------------------------------------------------*/
+
+/* Makes room for len more bytes in the buffer of idx. */
+static int reserve( du_index *idx, size_t len )
+{
+    char   *buf;
+    size_t  size = idx->buf_size > 0 ? idx->buf_size : FLUSH_SIZE;
+
+    while ( size - idx->buf_used < len )
+        size *= 2;
+    if ( size != idx->buf_size ) {
+        if ( NULL == (buf = realloc(idx->buf, size)) )
+            return -1;
+        idx->buf      = buf;
+        idx->buf_size = size;
+    }
+    return 0;
+}
+
+/* Writes the buffered records at the end of the file. */
+static int flush( du_index *idx )
+{
+    if ( -1 == write_all(idx->fd, idx->buf, idx->buf_used, idx->end) )
+        return -1;
+    idx->end     += idx->buf_used;
+    idx->buf_used = 0;
+    return 0;
+}
+
+/* Adds the record of the directory d to the buffer of idx. */
+static int add_record( du_index *idx, const du_dir *d )
+{
+    du_index_rec   rec;
+    rec_entry     *e;
+    const du_node *n;
+    size_t         start = idx->buf_used;
+    size_t         len;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.dev        = d->dev;
+    rec.ino        = d->node.ino;
+    rec.mtime_sec  = d->mtime.tv_sec;
+    rec.mtime_nsec = d->mtime.tv_nsec;
+    rec.ctime_sec  = d->ctime.tv_sec;
+    rec.ctime_nsec = d->ctime.tv_nsec;
+    if ( -1 == reserve(idx, sizeof(rec)) )
+        return -1;
+    idx->buf_used += sizeof(rec);
+
+    for ( n = d->children; n != NULL; n = n->next ) {
+        len = strlen(n->name);
+        if ( -1 == reserve(idx, ENTRY_SIZE(len)) )
+            return -1;
+        e = (rec_entry*) (idx->buf + idx->buf_used);
+        memset(e, 0, ENTRY_SIZE(len));
+        e->ino    = n->ino;
+        e->len    = len;
+        e->linked = n->linked;
+        /* Directories are read again, or found in their own records. */
+        if ( DU_IS_DIR(n) || n->kind == DU_MOUNT )
+            e->kind = DU_DIR;
+        else {
+            e->kind  = n->kind;
+            e->usage = n->usage;
+        }
+        memcpy(e->name, n->name, len);
+        idx->buf_used += ENTRY_SIZE(len);
+        rec.num_entries++;
+    }
+    rec.size = idx->buf_used - start;
+    memcpy(idx->buf + start, &rec, sizeof(rec));
+    if ( idx->buf_used >= FLUSH_SIZE )
+        return flush(idx);
+    return 0;
+}
+
+/* Adds the records of the directories in the tree at d that need them. */
+static int save_dir( du_index *idx, const du_dir *d, time_t started )
+{
+    const du_node *n;
+
+    if ( d->node.kind != DU_DIR )
+        return 0;
+    if ( !d->from_index && d->err == 0 && d->ctime.tv_sec < started - 1 &&
+         -1 == add_record(idx, d) )
+        return -1;
+    for ( n = d->children; n != NULL; n = n->next )
+        if ( n->kind == DU_DIR && -1 == save_dir(idx, (du_dir*) n, started) )
+            return -1;
+    return 0;
+}
+
+int du_index_save( du_index *idx, const du_tree *tree, time_t started )
+{
+    struct stat sb;
+
+    if ( tree->root == NULL || !DU_IS_DIR(tree->root) )
+        return 0;
+    /* Drop anything after the last good record before appending. */
+    if ( -1 == fstat(idx->fd, &sb) )
+        return -1;
+    if ( (size_t) sb.st_size > idx->end && -1 == ftruncate(idx->fd, idx->end) )
+        return -1;
+    if ( -1 == save_dir(idx, (du_dir*) tree->root, started) )
+        return -1;
+    return flush(idx);
+}
+
+void du_index_close( du_index *idx )
+{
+    unload(idx);
+    if ( idx->fd != -1 )
+        close(idx->fd);
+    free(idx->buf);
+    free(idx->file);
+    free(idx);
+}
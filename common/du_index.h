@@ -0,0 +1,106 @@
+/*****************************************************************************
+  Title          : du_index.h
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : A file that remembers the contents of directories between
+                   walks of a hierarchy
+
+  Notes:
+  A du_index lets du_walk() skip reading a directory that has not changed
+  since the last walk. For each directory that it read, the index records
+  every entry's name, kind, inode number and disk usage, under the
+  directory's device and inode number and its modification and change
+  times. When du_walk() comes to a directory whose times still match its
+  record, it builds the directory's nodes from the record instead of
+  reading the directory and examining each of its files. It still opens
+  and examines each subdirectory, to see whether the subdirectory has
+  changed, so a walk of an unchanged tree costs about one open() and one
+  statx() per directory instead of one statx() per file.
+
+  A directory's times change when a name in it is added, removed or
+  renamed, but not when one of its files is written to. A file that grows
+  or shrinks in place is therefore not noticed until something changes
+  the directory that contains it. The index suits hierarchies, such as
+  archives and spools, whose files are written once and then left alone.
+
+  The file begins with a header, which is followed by a record for each
+  directory. A walk appends the records of the directories it read; a
+  record supersedes every earlier one for the same directory. When more
+  than half of the file has been superseded, du_index_open() rewrites it
+  with only the current records. The file is mapped into memory, and
+  records are found through a hash table built when it is opened.
+
+  A directory whose change time is not at least two seconds before the
+  start of the walk is not recorded, because on a file system whose times
+  have a resolution of a second or two, it might change again without its
+  times changing.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#ifndef DU_INDEX_H
+#define DU_INDEX_H
+
+#include "common_hdrs.h"
+#include <stdint.h>
+#include "du_tree.h"
+
+typedef struct du_index_rec_tag du_index_rec;
+
+/* One entry of a directory, as recorded in an index */
+typedef struct
+{
+    const char  *name;        /* Not null-terminated */
+    size_t       len;
+    uintmax_t    usage;
+    ino_t        ino;
+    du_kind      kind;        /* DU_FILE, DU_SYMLINK, DU_DIR or DU_NS */
+    BOOL         linked;
+} du_index_entry;
+
+
+/** du_index_open(file) opens the index in file, creating it if it does not
+    exist, and locks it against use by other processes until it is closed.
+    A file that is not an index, or whose end is damaged, is treated as
+    empty from the first bad record on. It returns the index, or NULL with
+    errno set if file could not be opened, read or created.
+*/
+du_index *du_index_open( const char *file );
+
+/** du_index_find(idx, dev, ino, &mtime, &ctime) returns the record of the
+    directory with device dev and inode number ino, or NULL if there is
+    none or if its times are not mtime and ctime.
+*/
+const du_index_rec *du_index_find( const du_index *idx, dev_t dev, ino_t ino,
+                                   const struct timespec *mtime,
+                                   const struct timespec *ctime );
+
+/** du_index_next(rec, pos, &entry) stores in entry the entry of rec at pos,
+    where pos is NULL for the first entry and otherwise the value returned
+    by the previous call, and returns the position of the next entry. It
+    returns NULL, without changing entry, when there are no more entries.
+*/
+const void *du_index_next( const du_index_rec *rec, const void *pos,
+                           du_index_entry *entry );
+
+/** du_index_save(idx, &tree, started) adds to the file of idx a record for
+    each directory in tree that du_walk() read rather than found in idx,
+    except those whose change time is not at least two seconds before
+    started, the time at which the walk began. It returns 0, or -1 with
+    errno set if the file could not be written.
+*/
+int du_index_save( du_index *idx, const du_tree *tree, time_t started );
+
+/** du_index_close(idx) unmaps, unlocks and closes the file of idx and frees
+    idx.
+*/
+void du_index_close( du_index *idx );
+
+#endif /* DU_INDEX_H */
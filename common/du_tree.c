@@ -0,0 +1,591 @@
+/*****************************************************************************
+  Title          : du_tree.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : A parallel walk of a file hierarchy that sums disk usage
+
+  Notes:
+  A directory stays open while any of its subdirectories has not yet been
+  opened, because they are opened relative to it; refs counts the threads
+  that still need it. This keeps about one descriptor open for each
+  directory in the queues, so du_walk() raises the limit on open files to
+  its maximum.
+
+  outstanding counts the directories that are queued or being read. A
+  thread increments it before queueing a directory and decrements it after
+  reading one, so it is 0 only when there is nothing left to do, and idle
+  threads stop when they see it reach 0.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#define _GNU_SOURCE
+#include "common_hdrs.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/sysmacros.h>
+#include "du_tree.h"
+#include "du_index.h"
+
+#define DENTS_BUFSIZE   (256*1024)   /* Bytes read by each getdents64()   */
+#define INITIAL_QUEUE   1024         /* Initial capacity of each queue    */
+#define IDLE_SPINS      64           /* Yields before an idle thread naps */
+#define IDLE_NSECS      100000       /* Length of the nap                 */
+#define CACHE_LINE      64
+
+/* The fields of struct statx that the walk uses; stx_dev_major and
+   stx_dev_minor are always filled in. The times are needed only to find
+   directories in an index.                                            */
+#define DU_STATX_MASK   (STATX_TYPE | STATX_INO | STATX_NLINK | STATX_BLOCKS)
+#define DU_TIMES_MASK   (STATX_MTIME | STATX_CTIME)
+
+/* A double-ended queue of directories. items[head] is the front and
+   items[tail-1] the back, with indices taken modulo cap.              */
+typedef struct
+{
+    du_dir          **items;
+    long              head;
+    long              tail;
+    long              cap;
+    pthread_mutex_t   lock;
+} __attribute__((aligned(CACHE_LINE))) dir_queue;
+
+typedef struct walk_state_tag walk_state;
+
+/* One thread of the walk */
+typedef struct
+{
+    walk_state   *walk;
+    int           id;
+    dir_queue     queue;
+    arena        *arena;
+    char         *buf;          /* For getdents64()                      */
+    unsigned int  seed;         /* For choosing whom to steal from       */
+    pthread_t     thread;
+} worker;
+
+struct walk_state_tag
+{
+    const char   *path;
+    int           flags;        /* As passed to du_walk()                */
+    dev_t         dev;          /* Device of the root                    */
+    du_index     *index;        /* Or NULL                               */
+    unsigned int  mask;         /* Fields asked of statx()               */
+    worker       *workers;
+    int           num_workers;
+    long          outstanding;  /* Directories queued or being read      */
+    int           error;        /* errno of a failure to get memory      */
+};
+
+/*----------------------------------------------------------------------------
+                                  Queues
+----------------------------------------------------------------------------*/
+
+static int queue_init( dir_queue *q )
+{
+    if ( NULL == (q->items = malloc(INITIAL_QUEUE * sizeof(du_dir*))) )
+        return -1;
+    q->head = q->tail = 0;
+    q->cap  = INITIAL_QUEUE;
+    pthread_mutex_init(&q->lock, NULL);
+    return 0;
+}
+
+/* Adds d to the back of q, doubling q if it is full. */
+static int queue_push( dir_queue *q, du_dir *d )
+{
+    du_dir **items;
+    long     n;
+
+    pthread_mutex_lock(&q->lock);
+    n = q->tail - q->head;
+    if ( n == q->cap ) {
+        if ( NULL == (items = malloc(2 * q->cap * sizeof(du_dir*))) ) {
+            pthread_mutex_unlock(&q->lock);
+            return -1;
+        }
+        for ( long i = 0; i < n; i++ )
+            items[i] = q->items[(q->head + i) % q->cap];
+        free(q->items);
+        q->items = items;
+        q->head  = 0;
+        q->tail  = n;
+        q->cap  *= 2;
+    }
+    q->items[q->tail++ % q->cap] = d;
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+/* Removes and returns the directory at the back of q, or at the front if
+   from_front is TRUE, or returns NULL if q is empty.                    */
+static du_dir *queue_pop( dir_queue *q, BOOL from_front )
+{
+    du_dir *d = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    if ( q->tail > q->head )
+        d = from_front ? q->items[q->head++ % q->cap]
+                       : q->items[--q->tail % q->cap];
+    pthread_mutex_unlock(&q->lock);
+    return d;
+}
+
+/*----------------------------------------------------------------------------
+                                  The walk
+----------------------------------------------------------------------------*/
+
+/* Gives up one claim on the descriptor of d, closing it after the last. */
+static void release_fd( du_dir *d )
+{
+    if ( 0 == __atomic_sub_fetch(&d->refs, 1, __ATOMIC_ACQ_REL) )
+        close(d->fd);
+}
+
+/* Records that d no longer waits for one of its subdirectories, or for
+   itself to be read, and passes the total of every directory that is
+   thereby complete up to its parent. d can also be an entry that was
+   queued as a directory but turned out not to be one when opened.    */
+static void finish_dir( du_dir *d )
+{
+    du_dir *parent;
+
+    while ( d != NULL &&
+            0 == __atomic_sub_fetch(&d->pending, 1, __ATOMIC_ACQ_REL) ) {
+        parent = d->parent;
+        if ( parent != NULL && !d->node.linked )
+            __atomic_add_fetch(&parent->node.usage,
+                               __atomic_load_n(&d->node.usage,
+                                               __ATOMIC_RELAXED),
+                               __ATOMIC_RELAXED);
+        d = parent;
+    }
+}
+
+/* Returns a new node in w's arena for the entry name, which is a
+   directory if is_dir is TRUE, or NULL if there is no memory.         */
+static du_node *new_node( worker *w, const char *name, size_t len,
+                          BOOL is_dir )
+{
+    du_node *n;
+
+    n = arena_alloc(w->arena, is_dir ? sizeof(du_dir) : sizeof(du_node));
+    if ( n == NULL )
+        return NULL;
+    memset(n, 0, is_dir ? sizeof(du_dir) : sizeof(du_node));
+    if ( NULL == (n->name = arena_strndup(w->arena, name, len)) )
+        return NULL;
+    if ( is_dir ) {
+        ((du_dir*) n)->fd      = -1;
+        ((du_dir*) n)->pending = 1;     /* For the directory itself */
+    }
+    return n;
+}
+
+/* Gets the status of name relative to dirfd, or of dirfd itself if name
+   is "", asking only for the fields in mask.                          */
+static int get_status( int dirfd, const char *name, unsigned int mask,
+                       struct statx *sx )
+{
+    int flags = AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC;
+
+    if ( *name == '\0' )
+        flags |= AT_EMPTY_PATH;
+    return statx(dirfd, name, flags, mask, sx);
+}
+
+/* Fills in the node n of a file from its status sx. */
+static void set_node( du_node *n, const struct statx *sx )
+{
+    du_dir *d = (du_dir*) n;
+
+    n->ino   = sx->stx_ino;
+    n->usage = sx->stx_blocks / 2;
+    if ( S_ISDIR(sx->stx_mode) ) {
+        n->kind          = DU_DIR;
+        d->dev           = makedev(sx->stx_dev_major, sx->stx_dev_minor);
+        d->have_status   = TRUE;
+        d->mtime.tv_sec  = sx->stx_mtime.tv_sec;
+        d->mtime.tv_nsec = sx->stx_mtime.tv_nsec;
+        d->ctime.tv_sec  = sx->stx_ctime.tv_sec;
+        d->ctime.tv_nsec = sx->stx_ctime.tv_nsec;
+    }
+    else {
+        n->kind   = S_ISLNK(sx->stx_mode) ? DU_SYMLINK : DU_FILE;
+        n->linked = ( sx->stx_nlink > 1 );
+    }
+}
+
+/* Returns TRUE if the file whose status is sx is to be left out because
+   it is not on the file system of the root and the walk must not leave
+   that file system.                                                    */
+static BOOL other_fs( walk_state *walk, const struct statx *sx )
+{
+    return ( walk->flags & DU_XDEV ) &&
+           makedev(sx->stx_dev_major, sx->stx_dev_minor) != walk->dev;
+}
+
+/* Makes sub a subdirectory of d and queues it. It returns the KB to add to
+   the total of d, which is 0 unless sub could not be queued.          */
+static uintmax_t queue_dir( worker *w, du_dir *d, du_dir *sub )
+{
+    sub->node.kind = DU_DIR;
+    sub->parent    = d;
+    __atomic_add_fetch(&d->refs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&d->pending, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&w->walk->outstanding, 1, __ATOMIC_RELAXED);
+    if ( -1 == queue_push(&w->queue, sub) ) {
+        w->walk->error = ENOMEM;
+        sub->node.kind = DU_DNR;
+        sub->err       = ENOMEM;
+        release_fd(d);
+        __atomic_sub_fetch(&d->pending, 1, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&w->walk->outstanding, 1, __ATOMIC_RELAXED);
+        return sub->node.usage;
+    }
+    return 0;
+}
+
+/* Fills in n, an entry of the directory d, from sx, and queues it if it
+   is a directory. It returns the KB to add to the total of d.          */
+static uintmax_t add_entry( worker *w, du_dir *d, du_node *n,
+                            const struct statx *sx )
+{
+    if ( other_fs(w->walk, sx) ) {
+        n->kind = DU_MOUNT;
+        return 0;
+    }
+    set_node(n, sx);
+    if ( n->kind == DU_DIR )
+        return queue_dir(w, d, (du_dir*) n);
+    return n->linked ? 0 : n->usage;
+}
+
+/* Opens the subdirectory d relative to its parent and, if the parent did
+   not get its status, gets it from the new descriptor. It returns the
+   descriptor, or -1 if d is not to be read, with d's kind saying why.  */
+static int open_subdir( walk_state *walk, du_dir *d )
+{
+    int          pfd = d->parent->fd;
+    int          fd, retval;
+    struct statx sx;
+
+    fd = openat(pfd, d->node.name, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+    d->err = ( fd == -1 ) ? errno : 0;
+    if ( !d->have_status ) {
+        if ( fd != -1 )
+            retval = get_status(fd, "", walk->mask, &sx);
+        else
+            retval = get_status(pfd, d->node.name, walk->mask, &sx);
+        if ( retval == -1 )
+            d->node.kind = DU_NS;
+        else if ( other_fs(walk, &sx) )
+            d->node.kind = DU_MOUNT;
+        else
+            set_node(&d->node, &sx);
+    }
+    release_fd(d->parent);
+
+    if ( d->node.kind == DU_DIR && fd == -1 )
+        d->node.kind = DU_DNR;
+    if ( d->node.kind != DU_DIR && fd != -1 ) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/* Creates the nodes of the entries of the directory d from its record rec
+   in the index, instead of reading it. It returns FALSE if there was not
+   enough memory.                                                      */
+static BOOL fill_from_index( worker *w, du_dir *d, const du_index_rec *rec )
+{
+    du_node      **last = &d->children;
+    du_node       *n;
+    du_index_entry e;
+    const void    *pos = NULL;
+    uintmax_t      sum = 0;
+
+    while ( NULL != (pos = du_index_next(rec, pos, &e)) ) {
+        if ( NULL == (n = new_node(w, e.name, e.len, e.kind == DU_DIR)) )
+            return FALSE;
+        if ( e.kind == DU_DIR )
+            sum += queue_dir(w, d, (du_dir*) n);
+        else {
+            n->kind   = e.kind;
+            n->usage  = e.usage;
+            n->ino    = e.ino;
+            n->linked = e.linked;
+            if ( !n->linked )
+                sum += n->usage;
+        }
+        *last = n;
+        last  = &n->next;
+    }
+    d->from_index = TRUE;
+    __atomic_add_fetch(&d->node.usage, sum, __ATOMIC_RELAXED);
+    return TRUE;
+}
+
+/* Reads the directory d and creates a node for each of its entries. */
+static void read_dir( worker *w, du_dir *d )
+{
+    du_node      **last = &d->children;
+    du_node       *n;
+    struct dirent64 *ent;
+    struct statx   sx;
+    uintmax_t      sum = 0;
+    ssize_t        nread;
+    size_t         len;
+    BOOL           nomem = FALSE;
+    int            fd;
+    const du_index_rec *rec;
+
+    if ( d->parent == NULL ) {
+        fd = open(w->walk->path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if ( fd == -1 ) {
+            d->node.kind = DU_DNR;
+            d->err       = errno;
+        }
+    }
+    else
+        fd = open_subdir(w->walk, d);
+    if ( fd == -1 ) {
+        finish_dir(d);
+        return;
+    }
+    d->fd   = fd;
+    d->refs = 1;
+
+    if ( w->walk->index != NULL &&
+         NULL != (rec = du_index_find(w->walk->index, d->dev, d->node.ino,
+                                      &d->mtime, &d->ctime)) ) {
+        if ( !fill_from_index(w, d, rec) )
+            w->walk->error = ENOMEM;
+        release_fd(d);
+        finish_dir(d);
+        return;
+    }
+
+    while ( !nomem && 0 < (nread = getdents64(fd, w->buf, DENTS_BUFSIZE)) ) {
+        for ( long pos = 0; pos < nread && !nomem; pos += ent->d_reclen ) {
+            ent = (struct dirent64*) (w->buf + pos);
+            if ( 0 == strcmp(ent->d_name, ".") ||
+                 0 == strcmp(ent->d_name, "..") )
+                continue;
+            len = strlen(ent->d_name);
+            if ( ent->d_type == DT_DIR ) {
+                /* Its status is found when it is opened. */
+                if ( NULL == (n = new_node(w, ent->d_name, len, TRUE)) )
+                    nomem = TRUE;
+                else
+                    sum += queue_dir(w, d, (du_dir*) n);
+            }
+            else if ( -1 == get_status(fd, ent->d_name,
+                                       ent->d_type == DT_UNKNOWN ?
+                                       w->walk->mask : DU_STATX_MASK, &sx) ) {
+                if ( NULL == (n = new_node(w, ent->d_name, len, FALSE)) )
+                    nomem = TRUE;
+                else
+                    n->kind = DU_NS;
+            }
+            else {
+                n = new_node(w, ent->d_name, len, S_ISDIR(sx.stx_mode));
+                if ( n == NULL )
+                    nomem = TRUE;
+                else
+                    sum += add_entry(w, d, n, &sx);
+            }
+            if ( n != NULL ) {
+                *last = n;
+                last  = &n->next;
+            }
+        }
+    }
+    if ( nomem )
+        w->walk->error = ENOMEM;
+    if ( nread == -1 )
+        d->err = errno;
+    __atomic_add_fetch(&d->node.usage, sum, __ATOMIC_RELAXED);
+    release_fd(d);
+    finish_dir(d);
+}
+
+/* Returns a directory taken from the front of another thread's queue,
+   or NULL if all of them are empty.                                   */
+static du_dir *steal( worker *w )
+{
+    walk_state *walk = w->walk;
+    int         n = walk->num_workers;
+    int         start = rand_r(&w->seed) % n;
+    du_dir     *d;
+
+    for ( int i = 0; i < n; i++ ) {
+        if ( (start + i) % n == w->id )
+            continue;
+        d = queue_pop(&walk->workers[(start + i) % n].queue, TRUE);
+        if ( d != NULL )
+            return d;
+    }
+    return NULL;
+}
+
+/* The work of each thread: read directories until there are none left. */
+static void *walk_dirs( void *arg )
+{
+    worker          *w = arg;
+    du_dir          *d;
+    int              idle = 0;
+    struct timespec  pause = { 0, IDLE_NSECS };
+
+    while ( TRUE ) {
+        d = queue_pop(&w->queue, FALSE);
+        if ( d == NULL )
+            d = steal(w);
+        if ( d == NULL ) {
+            if ( 0 == __atomic_load_n(&w->walk->outstanding,
+                                      __ATOMIC_ACQUIRE) )
+                break;
+            if ( ++idle < IDLE_SPINS )
+                sched_yield();
+            else
+                nanosleep(&pause, NULL);
+            continue;
+        }
+        idle = 0;
+        read_dir(w, d);
+        __atomic_sub_fetch(&w->walk->outstanding, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* Raises the soft limit on open files to the hard limit. */
+static void raise_fd_limit( void )
+{
+    struct rlimit rl;
+
+    if ( 0 == getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < rl.rlim_max ) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+/* Frees the queues and buffers of the walk. */
+static void free_walk( walk_state *walk )
+{
+    if ( walk->workers == NULL )
+        return;
+    for ( int i = 0; i < walk->num_workers; i++ ) {
+        free(walk->workers[i].queue.items);
+        free(walk->workers[i].buf);
+        pthread_mutex_destroy(&walk->workers[i].queue.lock);
+    }
+    free(walk->workers);
+}
+
+/* Creates the queues and buffers of a walk of path with num_threads
+   threads that allocate nodes in the arenas of tree.                  */
+static int init_walk( walk_state *walk, const char *path, int num_threads,
+                      int flags, du_index *index, du_tree *tree )
+{
+    worker *w;
+
+    memset(walk, 0, sizeof(walk_state));
+    walk->path        = path;
+    walk->flags       = flags;
+    walk->dev         = tree->dev;
+    walk->index       = index;
+    walk->mask        = DU_STATX_MASK | ( index != NULL ? DU_TIMES_MASK : 0 );
+    walk->num_workers = num_threads;
+    if ( NULL == (walk->workers = calloc(num_threads, sizeof(worker))) )
+        return -1;
+    for ( int i = 0; i < num_threads; i++ ) {
+        w        = &walk->workers[i];
+        w->walk  = walk;
+        w->id    = i;
+        w->arena = &tree->arenas[i];
+        w->seed  = i + 1;
+        if ( -1 == queue_init(&w->queue) ||
+             NULL == (w->buf = malloc(DENTS_BUFSIZE)) )
+            return -1;
+    }
+    return 0;
+}
+
+int du_walk( const char *path, int num_threads, int flags, du_index *index,
+             du_tree *tree )
+{
+    walk_state   walk;
+    struct statx sx;
+    du_node     *root = NULL;
+    int          started, err;
+
+    if ( num_threads < 1 )
+        num_threads = 1;
+    memset(tree, 0, sizeof(du_tree));
+    if ( *path == '\0' ) {
+        errno = ENOENT;
+        return -1;
+    }
+    if ( -1 == get_status(AT_FDCWD, path, DU_STATX_MASK | DU_TIMES_MASK,
+                          &sx) )
+        return -1;
+    tree->dev = makedev(sx.stx_dev_major, sx.stx_dev_minor);
+    if ( NULL == (tree->arenas = calloc(num_threads, sizeof(arena))) )
+        return -1;
+    tree->num_arenas = num_threads;
+    for ( int i = 0; i < num_threads; i++ )
+        arena_init(&tree->arenas[i], 0);
+
+    if ( 0 == init_walk(&walk, path, num_threads, flags, index, tree) )
+        root = new_node(&walk.workers[0], path, strlen(path),
+                        S_ISDIR(sx.stx_mode));
+    if ( root == NULL ) {
+        err = errno;
+        free_walk(&walk);
+        du_free(tree);
+        errno = err;
+        return -1;
+    }
+    tree->root = root;
+    set_node(root, &sx);
+
+    if ( root->kind == DU_DIR ) {
+        raise_fd_limit();
+        walk.outstanding = 1;
+        queue_push(&walk.workers[0].queue, (du_dir*) root);
+        /* If a thread cannot be created, the others do its share. */
+        for ( started = 1; started < num_threads; started++ )
+            if ( 0 != pthread_create(&walk.workers[started].thread, NULL,
+                                     walk_dirs, &walk.workers[started]) )
+                break;
+        walk_dirs(&walk.workers[0]);
+        for ( int i = 1; i < started; i++ )
+            pthread_join(walk.workers[i].thread, NULL);
+    }
+    free_walk(&walk);
+    if ( walk.error != 0 ) {
+        du_free(tree);
+        errno = walk.error;
+        return -1;
+    }
+    return 0;
+}
+
+void du_free( du_tree *tree )
+{
+    for ( int i = 0; i < tree->num_arenas; i++ )
+        arena_free(&tree->arenas[i]);
+    free(tree->arenas);
+    memset(tree, 0, sizeof(du_tree));
+}
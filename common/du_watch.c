@@ -0,0 +1,1162 @@
+/*****************************************************************************
+  Title          : du_watch.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Keeping the totals of a du_walk() tree up to date from
+                   file system events
+
+  Notes:
+  Each directory of the tree gets a wdir, reached through its data field,
+  that holds what the watch needs to know about it: the KB used by the
+  directory itself, which du_walk() folds into its total, its inotify
+  watch or file handle, and how many of its children are DU_GONE.
+
+  Four hash maps are kept. names finds the node of an entry from its
+  directory and name. inodes holds every name of each file with more than
+  one link; the one at which the file is counted has its counted flag set.
+  watches finds a directory from an inotify watch descriptor or a file
+  handle. pending holds the entries named by events since the last update.
+
+  Removing a link changes the link count of the file's other names, but
+  no event names them, so when the name at which a file is counted is
+  removed, the file is counted at one of its other names instead, found
+  in inodes. The files to be counted again are collected as orphans while
+  a subtree is forgotten, and counted only when it is all gone, so that
+  none of them is counted at a name that is about to be removed too.
+
+  A wdir is not freed when its directory is removed, since pending entries
+  and the list of changed directories may still point to it. It is marked
+  gone, and put back into use once both are empty.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#define _GNU_SOURCE
+#include "common_hdrs.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+#include "du_watch.h"
+
+#define EVENT_BUFSIZE  (64*1024)
+#define INITIAL_MAP    1024      /* Initial number of buckets of each map */
+#define MIN_SWEEP      64        /* Fewest DU_GONE children worth removing */
+#define HANDLE_KEY_MAX (sizeof(fsid_t) + sizeof(int) + MAX_HANDLE_SZ)
+
+#define WATCH_MASK      (STATX_TYPE | STATX_INO | STATX_NLINK | STATX_BLOCKS)
+#define STATX_FLAGS     (AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC)
+#define INOTIFY_EVENTS  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                         IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_ONLYDIR | \
+                         IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+#define FANOTIFY_EVENTS (FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | \
+                         FAN_MOVED_TO | FAN_MODIFY | FAN_ATTRIB | FAN_ONDIR)
+
+/* An item in a chain of a map */
+typedef struct slot_tag
+{
+    struct slot_tag  *next;
+    uint64_t          key;
+    void             *owner;      /* The wdir to which item belongs   */
+    void             *item;
+} slot;
+
+typedef struct
+{
+    slot    **buckets;
+    size_t    size;               /* A power of 2                     */
+    size_t    count;
+    arena    *arena;              /* From which slots are allocated   */
+    slot     *free;               /* Slots that have been removed     */
+} map;
+
+/* What the watch keeps for a directory */
+typedef struct wdir_tag
+{
+    du_dir            *dir;
+    struct wdir_tag   *next;      /* In the changed or the free list  */
+    struct wdir_tag   *retired;   /* In the list of retired wdirs     */
+    uintmax_t          own;       /* KB used by the directory itself  */
+    slot              *watch;     /* Its entry in watches, or NULL    */
+    int                wd;        /* Its inotify watch descriptor     */
+    long               removed;   /* Children that are DU_GONE        */
+    long               sweep_at;
+    BOOL               changed;
+    BOOL               gone;
+} wdir;
+
+/* A file handle as a key: the fsid, the handle type and the handle */
+typedef struct
+{
+    size_t          len;
+    unsigned char   bytes[];
+} handle_key;
+
+/* A file with more than one link whose counted name has been removed */
+typedef struct
+{
+    dev_t       dev;
+    ino_t       ino;
+    uintmax_t   usage;
+} orphan;
+
+/* A file system in the tree */
+typedef struct
+{
+    dev_t    dev;
+    fsid_t   fsid;
+} fs_info;
+
+struct du_watch_tag
+{
+    du_tree    *tree;
+    int         flags;
+    int         fd;
+    BOOL        fanotify;
+    arena       arena;            /* wdirs, slots and handle keys     */
+    arena       scratch;          /* Pending slots and names          */
+    map         names;
+    map         inodes;
+    map         watches;
+    map         pending;
+    fs_info    *fs;
+    int         num_fs;
+    wdir       *changed;          /* Oldest first                     */
+    wdir       *last_changed;
+    wdir       *retired;          /* Gone, not yet reusable           */
+    wdir       *free;
+    orphan     *orphans;          /* To be counted at another name    */
+    size_t      num_orphans;
+    size_t      max_orphans;
+    char       *path;             /* For du_watch_path()              */
+    size_t      path_size;
+    char       *entry;            /* For the path of an entry         */
+    size_t      entry_size;
+    char       *buf;              /* For events                       */
+};
+
+
+/* Scrambles the bits of x. */
+static uint64_t mix( uint64_t x )
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* Adds the len bytes at p to the FNV-1a hash h. */
+static uint64_t hash_bytes( const void *p, size_t len, uint64_t h )
+{
+    const unsigned char *s = p;
+
+    while ( len-- > 0 )
+        h = (h ^ *s++) * 0x100000001b3ULL;
+    return h;
+}
+
+static uint64_t name_key( const wdir *wd, const char *name )
+{
+    return hash_bytes(name, strlen(name), mix((uintptr_t) wd));
+}
+
+static uint64_t inode_key( dev_t dev, ino_t ino )
+{
+    return mix(ino ^ mix(dev));
+}
+
+static int map_init( map *m, arena *a )
+{
+    m->size    = INITIAL_MAP;
+    m->count   = 0;
+    m->arena   = a;
+    m->free    = NULL;
+    m->buckets = calloc(m->size, sizeof(slot*));
+    return ( m->buckets == NULL ) ? -1 : 0;
+}
+
+/* Adds an item to m and returns its slot, or NULL if there is no memory. */
+static slot *map_add( map *m, uint64_t key, void *owner, void *item )
+{
+    slot   **buckets, *l, *next;
+    size_t   i;
+
+    if ( m->count >= m->size &&
+         NULL != (buckets = calloc(2 * m->size, sizeof(slot*))) ) {
+        for ( i = 0; i < m->size; i++ )
+            for ( l = m->buckets[i]; l != NULL; l = next ) {
+                next = l->next;
+                l->next = buckets[l->key & (2 * m->size - 1)];
+                buckets[l->key & (2 * m->size - 1)] = l;
+            }
+        free(m->buckets);
+        m->buckets = buckets;
+        m->size   *= 2;
+    }
+    if ( m->free != NULL ) {
+        l = m->free;
+        m->free = l->next;
+    }
+    else if ( NULL == (l = arena_alloc(m->arena, sizeof(slot))) )
+        return NULL;
+    l->key   = key;
+    l->owner = owner;
+    l->item  = item;
+    l->next  = m->buckets[key & (m->size - 1)];
+    m->buckets[key & (m->size - 1)] = l;
+    m->count++;
+    return l;
+}
+
+/* Returns the first slot after l, or the first in m if l is NULL, whose
+   key is key, or NULL if there is none.                               */
+static slot *map_next( const map *m, uint64_t key, slot *l )
+{
+    l = ( l == NULL ) ? m->buckets[key & (m->size - 1)] : l->next;
+    while ( l != NULL && l->key != key )
+        l = l->next;
+    return l;
+}
+
+static void map_remove( map *m, slot *l )
+{
+    slot **p = &m->buckets[l->key & (m->size - 1)];
+
+    while ( *p != l )
+        p = &(*p)->next;
+    *p = l->next;
+    l->next = m->free;
+    m->free = l;
+    m->count--;
+}
+
+/* Empties m, whose slots are in an arena that is about to be freed. */
+static void map_clear( map *m )
+{
+    memset(m->buckets, 0, m->size * sizeof(slot*));
+    m->count = 0;
+    m->free  = NULL;
+}
+
+/* Returns the slot in names of the entry name of wd, or NULL. */
+static slot *find_name( du_watch *w, wdir *wd, const char *name )
+{
+    uint64_t  key = name_key(wd, name);
+    slot     *l = NULL;
+
+    while ( NULL != (l = map_next(&w->names, key, l)) )
+        if ( l->owner == wd && 0 == strcmp(((du_node*) l->item)->name, name) )
+            return l;
+    return NULL;
+}
+
+/* Returns the first slot after l, or the first if l is NULL, of a name in
+   inodes of the file with more than one link whose inode is ino on dev,
+   or NULL if there are no more.                                       */
+static slot *next_link( du_watch *w, dev_t dev, ino_t ino, slot *l )
+{
+    uint64_t  key = inode_key(dev, ino);
+
+    while ( NULL != (l = map_next(&w->inodes, key, l)) )
+        if ( ((du_node*) l->item)->ino == ino &&
+             ((wdir*) l->owner)->dir->dev == dev )
+            return l;
+    return NULL;
+}
+
+/* Returns the slot in inodes of the name n of the file with more than one
+   link whose inode is ino on dev, or, if n is NULL, of the name at which
+   it is counted, or NULL if there is none.                            */
+static slot *find_inode( du_watch *w, dev_t dev, ino_t ino, const du_node *n )
+{
+    slot *l = NULL;
+
+    while ( NULL != (l = next_link(w, dev, ino, l)) )
+        if ( n == NULL ? ((du_node*) l->item)->counted : l->item == n )
+            return l;
+    return NULL;
+}
+
+/* Puts the name n of wd, a file with more than one link, into inodes, and
+   counts the file at n if it is not counted at another name. It returns
+   -1 if there is no memory.                                          */
+static int add_link( du_watch *w, wdir *wd, du_node *n )
+{
+    n->counted = ( NULL == find_inode(w, wd->dir->dev, n->ino, NULL) );
+    if ( NULL == map_add(&w->inodes, inode_key(wd->dir->dev, n->ino), wd,
+                         n) )
+        return -1;
+    return 0;
+}
+
+/* Returns the KB of the entry n that are in its directory's total. */
+static uintmax_t counted( const du_node *n )
+{
+    if ( DU_IS_DIR(n) || !n->linked || n->counted )
+        return n->usage;
+    return 0;
+}
+
+/* Gives the directory d a wdir, or returns NULL if there is no memory. */
+static wdir *new_wdir( du_watch *w, du_dir *d, uintmax_t own )
+{
+    wdir *wd = w->free;
+
+    if ( wd != NULL )
+        w->free = wd->next;
+    else if ( NULL == (wd = arena_alloc(&w->arena, sizeof(wdir))) )
+        return NULL;
+    memset(wd, 0, sizeof(wdir));
+    wd->dir      = d;
+    wd->own      = own;
+    wd->wd       = -1;
+    wd->sweep_at = MIN_SWEEP;
+    d->data      = wd;
+    return wd;
+}
+
+static void mark_changed( du_watch *w, wdir *wd )
+{
+    if ( wd->changed )
+        return;
+    wd->changed = TRUE;
+    wd->next    = NULL;
+    if ( w->changed == NULL )
+        w->changed = wd;
+    else
+        w->last_changed->next = wd;
+    w->last_changed = wd;
+}
+
+/* Adds delta KB to the totals of wd and the directories above it. */
+static void add_delta( du_watch *w, wdir *wd, intmax_t delta )
+{
+    du_dir *d;
+
+    if ( delta == 0 )
+        return;
+    for ( d = wd->dir; d != NULL; d = d->parent ) {
+        d->node.usage += delta;
+        mark_changed(w, d->data);
+    }
+}
+
+/* Makes the path of the entry name of wd in w->entry, and returns it, or
+   NULL if there is no memory.                                          */
+static char *entry_path( du_watch *w, wdir *wd, const char *name )
+{
+    const char *dir = du_watch_path(w, wd->dir);
+    size_t      len;
+
+    if ( dir == NULL )
+        return NULL;
+    len = strlen(dir) + strlen(name) + 2;
+    if ( len > w->entry_size ) {
+        free(w->entry);
+        w->entry_size = 2 * len;
+        if ( NULL == (w->entry = malloc(w->entry_size)) ) {
+            w->entry_size = 0;
+            return NULL;
+        }
+    }
+    sprintf(w->entry, "%s/%s", strcmp(dir, "/") ? dir : "", name);
+    return w->entry;
+}
+
+
+/*---------------------------------------------------------------------------
+                          Watches and file handles
+---------------------------------------------------------------------------*/
+
+/* Returns the file system dev, at path, marking it for fanotify if it is
+   new, or NULL if it cannot be marked.                                 */
+static fs_info *get_fs( du_watch *w, dev_t dev, const char *path )
+{
+    struct statfs  sfs;
+    fs_info       *fs;
+
+    for ( int i = 0; i < w->num_fs; i++ )
+        if ( w->fs[i].dev == dev )
+            return &w->fs[i];
+    if ( -1 == statfs(path, &sfs) )
+        return NULL;
+    if ( -1 == fanotify_mark(w->fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                             FANOTIFY_EVENTS, AT_FDCWD, path) )
+        return NULL;
+    if ( NULL == (fs = realloc(w->fs, (w->num_fs + 1) * sizeof(fs_info))) )
+        return NULL;
+    w->fs = fs;
+    fs = &w->fs[w->num_fs++];
+    fs->dev = dev;
+    memcpy(&fs->fsid, &sfs.f_fsid, sizeof(fsid_t));
+    return fs;
+}
+
+/* Stores in key the key of the file handle fh on the file system fsid,
+   and returns its length.                                             */
+static size_t make_handle_key( unsigned char *key, const void *fsid,
+                               const struct file_handle *fh )
+{
+    memcpy(key, fsid, sizeof(fsid_t));
+    memcpy(key + sizeof(fsid_t), &fh->handle_type, sizeof(int));
+    memcpy(key + sizeof(fsid_t) + sizeof(int), fh->f_handle,
+           fh->handle_bytes);
+    return sizeof(fsid_t) + sizeof(int) + fh->handle_bytes;
+}
+
+/* Returns the slot in watches of the key of len bytes, or NULL. */
+static slot *find_handle( du_watch *w, const unsigned char *key, size_t len )
+{
+    uint64_t    hash = hash_bytes(key, len, 0);
+    slot       *l = NULL;
+    handle_key *hk;
+
+    while ( NULL != (l = map_next(&w->watches, hash, l)) ) {
+        hk = l->item;
+        if ( hk->len == len && 0 == memcmp(hk->bytes, key, len) )
+            return l;
+    }
+    return NULL;
+}
+
+/* Returns the slot in watches of the inotify watch descriptor id, or NULL. */
+static slot *find_wd( du_watch *w, int id )
+{
+    slot *l = NULL;
+
+    while ( NULL != (l = map_next(&w->watches, mix(id), l)) )
+        if ( ((wdir*) l->owner)->wd == id )
+            return l;
+    return NULL;
+}
+
+/* Makes the watch l, if it exists, belong to wd, or else adds one with key
+   and item. A directory that has been moved keeps its inotify watch and
+   its file handle, and may be added again before its old node is removed.
+   It returns -1 if there is no memory.                                */
+static int claim( du_watch *w, wdir *wd, slot *l, uint64_t key, void *item )
+{
+    if ( l != NULL ) {
+        ((wdir*) l->owner)->watch = NULL;
+        l->owner = wd;
+    }
+    else if ( NULL == (l = map_add(&w->watches, key, wd, item)) )
+        return -1;
+    wd->watch = l;
+    return 0;
+}
+
+/* Watches the directory wd, whose path is path. It returns -1 if events
+   cannot be had for it, and 0 if they can or if it is not worth trying,
+   because the directory is gone or cannot be read.                     */
+static int watch_dir( du_watch *w, wdir *wd, const char *path )
+{
+    union {
+        struct file_handle  fh;
+        char                space[sizeof(struct file_handle) + MAX_HANDLE_SZ];
+    } h;
+    unsigned char  key[HANDLE_KEY_MAX];
+    size_t         len;
+    handle_key    *hk;
+    fs_info       *fs;
+    int            id, mount_id;
+
+    wd->watch = NULL;
+    if ( !w->fanotify ) {
+        if ( -1 == (id = inotify_add_watch(w->fd, path, INOTIFY_EVENTS)) )
+            return ( errno == ENOSPC || errno == ENOMEM ) ? -1 : 0;
+        wd->wd = id;
+        return claim(w, wd, find_wd(w, id), mix(id), NULL);
+    }
+    h.fh.handle_bytes = MAX_HANDLE_SZ;
+    if ( -1 == name_to_handle_at(AT_FDCWD, path, &h.fh, &mount_id, 0) )
+        return ( errno == ENOENT || errno == ENOTDIR ) ? 0 : -1;
+    if ( NULL == (fs = get_fs(w, wd->dir->dev, path)) )
+        return -1;
+    len = make_handle_key(key, &fs->fsid, &h.fh);
+    if ( NULL == (hk = arena_alloc(&w->arena, sizeof(handle_key) + len)) )
+        return -1;
+    hk->len = len;
+    memcpy(hk->bytes, key, len);
+    return claim(w, wd, find_handle(w, key, len), hash_bytes(key, len, 0),
+                 hk);
+}
+
+static void unwatch_dir( du_watch *w, wdir *wd )
+{
+    if ( wd->watch == NULL )
+        return;
+    if ( !w->fanotify )
+        inotify_rm_watch(w->fd, wd->wd);
+    map_remove(&w->watches, wd->watch);
+    wd->watch = NULL;
+}
+
+/* Watches d and the directories below it. */
+static int watch_tree( du_watch *w, du_dir *d )
+{
+    const char *path = du_watch_path(w, d);
+    du_node    *child;
+
+    if ( path == NULL || -1 == watch_dir(w, d->data, path) )
+        return -1;
+    for ( child = d->children; child != NULL; child = child->next )
+        if ( child->kind == DU_DIR && -1 == watch_tree(w, (du_dir*) child) )
+            return -1;
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------------
+                         Adding and removing entries
+---------------------------------------------------------------------------*/
+
+/* Sets up the directory d from the walk and everything below it: gives
+   each directory a wdir, puts each entry into names, and counts each file
+   with more than one link at the first of its names, in the order in which
+   nftw() would reach them, adding it to the totals of the directories
+   between it and d. It returns -1 if there is no memory.              */
+static int register_dir( du_watch *w, du_dir *d )
+{
+    uintmax_t  own = d->node.usage, before;
+    du_node   *child;
+    wdir      *wd;
+
+    for ( child = d->children; child != NULL; child = child->next )
+        if ( DU_IS_DIR(child) || !child->linked )
+            own -= child->usage;
+    if ( NULL == (wd = new_wdir(w, d, own)) )
+        return -1;
+    for ( child = d->children; child != NULL; child = child->next ) {
+        if ( NULL == map_add(&w->names, name_key(wd, child->name), wd,
+                             child) )
+            return -1;
+        if ( DU_IS_DIR(child) ) {
+            before = child->usage;
+            if ( -1 == register_dir(w, (du_dir*) child) )
+                return -1;
+            d->node.usage += child->usage - before;
+        }
+        else if ( child->linked ) {
+            if ( -1 == add_link(w, wd, child) )
+                return -1;
+            if ( child->counted )
+                d->node.usage += child->usage;
+        }
+    }
+    return 0;
+}
+
+/* Makes a node for the entry name of wd, whose status is sx and which is
+   at in the directory dirfd, links it into wd, and, if it is a directory,
+   watches it and adds everything in it, counting their usage in its
+   total. It returns the node, or NULL if there is no memory.          */
+static du_node *new_entry( du_watch *w, wdir *wd, int dirfd, const char *at,
+                           const char *name, const struct statx *sx )
+{
+    BOOL           is_dir = S_ISDIR(sx->stx_mode);
+    size_t         size = is_dir ? sizeof(du_dir) : sizeof(du_node);
+    dev_t          dev = makedev(sx->stx_dev_major, sx->stx_dev_minor);
+    du_node       *n, *child;
+    du_dir        *d = NULL;
+    wdir          *sub;
+    struct statx   csx;
+    struct dirent *e;
+    DIR           *dirp;
+    const char    *path;
+    int            fd;
+
+    if ( NULL == (n = malloc(size + strlen(name) + 1)) )
+        return NULL;
+    memset(n, 0, size);
+    n->name      = strcpy((char*) n + size, name);
+    n->ino       = sx->stx_ino;
+    n->allocated = TRUE;
+    if ( (w->flags & DU_XDEV) && dev != w->tree->dev )
+        n->kind = DU_MOUNT;
+    else if ( is_dir ) {
+        d = (du_dir*) n;
+        n->kind   = DU_DIR;
+        n->usage  = sx->stx_blocks / 2;
+        d->parent = wd->dir;
+        d->dev    = dev;
+        d->fd     = -1;
+    }
+    else {
+        n->kind   = S_ISLNK(sx->stx_mode) ? DU_SYMLINK : DU_FILE;
+        n->usage  = sx->stx_blocks / 2;
+        n->linked = ( sx->stx_nlink > 1 );
+    }
+
+    n->next = wd->dir->children;
+    wd->dir->children = n;
+    if ( NULL == map_add(&w->names, name_key(wd, name), wd, n) )
+        return NULL;
+    if ( n->linked && -1 == add_link(w, wd, n) )
+        return NULL;
+    if ( d == NULL )
+        return n;
+
+    /* Watch the directory before reading it, so that nothing added to it
+       while it is read goes unnoticed. If it cannot be watched, it is
+       still counted, but changes below it are missed.                  */
+    if ( NULL == (sub = new_wdir(w, d, n->usage)) ||
+         NULL == (path = du_watch_path(w, d)) ||
+         ( -1 == watch_dir(w, sub, path) && errno == ENOMEM ) )
+        return NULL;
+    fd = openat(dirfd, at, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if ( fd == -1 || NULL == (dirp = fdopendir(fd)) ) {
+        if ( fd != -1 )
+            close(fd);
+        n->kind = DU_DNR;
+        d->err  = errno;
+    }
+    else {
+        while ( NULL != (e = readdir(dirp)) ) {
+            if ( 0 == strcmp(e->d_name, ".") || 0 == strcmp(e->d_name, "..") )
+                continue;
+            /* An entry that has already gone is left for its event. */
+            if ( -1 == statx(fd, e->d_name, STATX_FLAGS, WATCH_MASK, &csx) )
+                continue;
+            if ( NULL == (child = new_entry(w, sub, fd, e->d_name, e->d_name,
+                                            &csx)) ) {
+                closedir(dirp);
+                return NULL;
+            }
+            n->usage += counted(child);
+        }
+        closedir(dirp);
+    }
+    mark_changed(w, sub);
+    return n;
+}
+
+/* Frees n, if it was allocated by new_entry(). */
+static void free_node( du_node *n )
+{
+    if ( n->allocated )
+        free(n);
+}
+
+/* Adds the file n of the directory on dev, whose counted name is being
+   removed, to the orphans. It returns -1 if there is no memory.       */
+static int add_orphan( du_watch *w, dev_t dev, const du_node *n )
+{
+    orphan *o;
+    size_t  max;
+
+    if ( w->num_orphans == w->max_orphans ) {
+        max = ( w->max_orphans > 0 ) ? 2 * w->max_orphans : 16;
+        if ( NULL == (o = realloc(w->orphans, max * sizeof(orphan))) )
+            return -1;
+        w->orphans     = o;
+        w->max_orphans = max;
+    }
+    o = &w->orphans[w->num_orphans++];
+    o->dev   = dev;
+    o->ino   = n->ino;
+    o->usage = n->usage;
+    return 0;
+}
+
+/* Forgets the entry n of wd, which has been removed, and everything below
+   it, freeing the nodes below it. Each file that was counted at a name
+   below it and has more than one link becomes an orphan. It returns -1 if
+   there is no memory for the orphans.                                 */
+static int forget( du_watch *w, wdir *wd, du_node *n )
+{
+    du_node *child, *next;
+    wdir    *sub;
+    slot    *l;
+    int      result = 0;
+
+    if ( DU_IS_DIR(n) ) {
+        sub = ((du_dir*) n)->data;
+        for ( child = ((du_dir*) n)->children; child != NULL; child = next ) {
+            next = child->next;
+            if ( child->kind != DU_GONE ) {
+                if ( NULL != (l = find_name(w, sub, child->name)) )
+                    map_remove(&w->names, l);
+                if ( -1 == forget(w, sub, child) )
+                    result = -1;
+            }
+            free_node(child);
+        }
+        ((du_dir*) n)->children = NULL;
+        unwatch_dir(w, sub);
+        sub->gone    = TRUE;
+        sub->retired = w->retired;
+        w->retired   = sub;
+    }
+    else if ( n->linked ) {
+        if ( NULL != (l = find_inode(w, wd->dir->dev, n->ino, n)) )
+            map_remove(&w->inodes, l);
+        if ( n->counted && -1 == add_orphan(w, wd->dir->dev, n) )
+            result = -1;
+    }
+    return result;
+}
+
+/* Counts each orphan at one of its remaining names, if it has any, adding
+   its usage to the totals of that name's directory, and empties the
+   orphans. A file that is left with one link is from then on counted as
+   a file with one link is.                                            */
+static void adopt_orphans( du_watch *w )
+{
+    orphan       *o;
+    slot         *l;
+    du_node      *m;
+    wdir         *wd;
+    const char   *path;
+    struct statx  sx;
+
+    for ( o = w->orphans; o < w->orphans + w->num_orphans; o++ ) {
+        if ( NULL == (l = next_link(w, o->dev, o->ino, NULL)) )
+            continue;
+        m  = l->item;
+        wd = l->owner;
+        m->counted = TRUE;
+        m->usage   = o->usage;
+        /* The link count has changed, but no event says so. */
+        path = entry_path(w, wd, m->name);
+        if ( path != NULL &&
+             0 == statx(AT_FDCWD, path, STATX_FLAGS, WATCH_MASK, &sx) &&
+             sx.stx_ino == o->ino ) {
+            m->usage = sx.stx_blocks / 2;
+            if ( sx.stx_nlink == 1 ) {
+                map_remove(&w->inodes, l);
+                m->linked = m->counted = FALSE;
+            }
+        }
+        add_delta(w, wd, m->usage);
+    }
+    w->num_orphans = 0;
+}
+
+/* Unlinks the DU_GONE children of wd and frees those that were allocated. */
+static void sweep( wdir *wd )
+{
+    du_node **p = &wd->dir->children, *n;
+    long      live = 0;
+
+    while ( NULL != (n = *p) ) {
+        if ( n->kind == DU_GONE ) {
+            *p = n->next;
+            free_node(n);
+        }
+        else {
+            live++;
+            p = &n->next;
+        }
+    }
+    wd->removed  = 0;
+    wd->sweep_at = ( live > MIN_SWEEP ) ? live : MIN_SWEEP;
+}
+
+/* Removes the entry of wd whose slot in names is l, counting the files
+   with more than one link that were counted below it at their other
+   names. It returns -1 if there is no memory.                         */
+static int remove_entry( du_watch *w, wdir *wd, slot *l )
+{
+    du_node   *n = l->item;
+    uintmax_t  usage = counted(n);
+    int        result;
+
+    map_remove(&w->names, l);
+    result = forget(w, wd, n);
+    n->kind = DU_GONE;
+    add_delta(w, wd, -(intmax_t) usage);
+    if ( ++wd->removed > wd->sweep_at )
+        sweep(wd);
+    adopt_orphans(w);
+    return result;
+}
+
+/* Brings the usage of n, a file of wd that has more than one link and
+   whose status is sx, up to date at the name where it is counted. If it
+   is counted at n and has only one link left, it is from then on counted
+   as a file with one link is.                                         */
+static void update_linked( du_watch *w, wdir *wd, du_node *n,
+                           const struct statx *sx )
+{
+    slot      *l = find_inode(w, wd->dir->dev, n->ino, NULL);
+    uintmax_t  usage = sx->stx_blocks / 2;
+    du_node   *m;
+
+    if ( l == NULL ) {
+        /* It is counted nowhere, so it is counted here from now on. */
+        n->counted = TRUE;
+        n->usage   = usage;
+        add_delta(w, wd, usage);
+        l = find_inode(w, wd->dir->dev, n->ino, n);
+    }
+    else {
+        m = l->item;
+        add_delta(w, l->owner, usage - m->usage);
+        m->usage = n->usage = usage;
+    }
+    if ( l != NULL && l->item == n && sx->stx_nlink == 1 ) {
+        map_remove(&w->inodes, l);
+        n->linked = n->counted = FALSE;
+    }
+}
+
+/* Brings the entry name of wd, or wd itself if name is "", up to date.
+   It returns -1 if there is no memory.                                */
+static int refresh( du_watch *w, wdir *wd, const char *name )
+{
+    struct statx  sx;
+    const char   *path;
+    du_node      *n = NULL;
+    wdir         *sub;
+    slot         *l = NULL;
+    uintmax_t     usage;
+
+    if ( *name != '\0' ) {
+        l    = find_name(w, wd, name);
+        n    = ( l != NULL ) ? l->item : NULL;
+        path = entry_path(w, wd, name);
+    }
+    else
+        path = du_watch_path(w, wd->dir);
+    if ( path == NULL )
+        return -1;
+    if ( -1 == statx(AT_FDCWD, path, STATX_FLAGS, WATCH_MASK, &sx) )
+        return ( n != NULL ) ? remove_entry(w, wd, l) : 0;
+    usage = sx.stx_blocks / 2;
+
+    if ( *name == '\0' ) {
+        add_delta(w, wd, usage - wd->own);
+        wd->own = usage;
+        return 0;
+    }
+    if ( n != NULL && n->kind == DU_MOUNT )
+        return 0;
+    if ( n != NULL && ( n->ino != sx.stx_ino || n->kind == DU_NS ||
+                        DU_IS_DIR(n) != S_ISDIR(sx.stx_mode) ) ) {
+        /* Counting orphans elsewhere can reuse the buffer of path. */
+        if ( -1 == remove_entry(w, wd, l) ||
+             NULL == (path = entry_path(w, wd, name)) )
+            return -1;
+        n = NULL;
+    }
+    if ( n == NULL ) {
+        if ( NULL == (n = new_entry(w, wd, AT_FDCWD, path, name, &sx)) )
+            return -1;
+        add_delta(w, wd, counted(n));
+    }
+    else if ( DU_IS_DIR(n) ) {
+        sub = ((du_dir*) n)->data;
+        add_delta(w, sub, usage - sub->own);
+        sub->own = usage;
+    }
+    else if ( n->linked )
+        update_linked(w, wd, n, &sx);
+    else if ( sx.stx_nlink > 1 ) {
+        /* A link has been made to it, and if the new name has already
+           been added, the file is counted there instead.              */
+        n->linked = TRUE;
+        if ( -1 == add_link(w, wd, n) )
+            return -1;
+        if ( !n->counted )
+            add_delta(w, wd, -(intmax_t) n->usage);
+        update_linked(w, wd, n, &sx);
+    }
+    else {
+        add_delta(w, wd, usage - n->usage);
+        n->usage = usage;
+    }
+    return 0;
+}
+
+/* Adds the entry name of wd to pending, if it is not already there. */
+static int add_pending( du_watch *w, wdir *wd, const char *name )
+{
+    uint64_t  key = name_key(wd, name);
+    slot     *l = NULL;
+    char     *copy;
+
+    while ( NULL != (l = map_next(&w->pending, key, l)) )
+        if ( l->owner == wd && 0 == strcmp(l->item, name) )
+            return 0;
+    if ( NULL == (copy = arena_strndup(&w->scratch, name, strlen(name))) ||
+         NULL == map_add(&w->pending, key, wd, copy) )
+        return -1;
+    return 0;
+}
+
+/* Notes that the entry name of wd has changed. wd itself is noted too,
+   since adding and removing entries can change its own size, and no
+   event says so.                                                      */
+static int note( du_watch *w, wdir *wd, const char *name )
+{
+    if ( -1 == add_pending(w, wd, name) ||
+         ( *name != '\0' && -1 == add_pending(w, wd, "") ) )
+        return -1;
+    return 0;
+}
+
+/* Notes the entries named by the len bytes of fanotify events in buf. */
+static int note_fanotify( du_watch *w, char *buf, ssize_t len )
+{
+    struct fanotify_event_metadata  *meta;
+    struct fanotify_event_info_fid  *info;
+    struct file_handle              *fh;
+    unsigned char                    key[HANDLE_KEY_MAX];
+    slot                            *l;
+    int                              count = 0;
+
+    for ( meta = (struct fanotify_event_metadata*) buf;
+          FAN_EVENT_OK(meta, len); meta = FAN_EVENT_NEXT(meta, len) ) {
+        if ( meta->mask & FAN_Q_OVERFLOW ) {
+            errno = EOVERFLOW;
+            return -1;
+        }
+        count++;
+        info = (struct fanotify_event_info_fid*) (meta + 1);
+        if ( meta->event_len < sizeof(*meta) + sizeof(*info) ||
+             info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME )
+            continue;
+        fh = (struct file_handle*) info->handle;
+        if ( fh->handle_bytes > MAX_HANDLE_SZ )
+            continue;
+        l = find_handle(w, key, make_handle_key(key, &info->fsid, fh));
+        if ( l != NULL &&
+             -1 == note(w, l->owner, (char*) fh->f_handle + fh->handle_bytes) )
+            return -1;
+    }
+    return count;
+}
+
+/* Notes the entries named by the len bytes of inotify events in buf. */
+static int note_inotify( du_watch *w, char *buf, ssize_t len )
+{
+    struct inotify_event  *ev;
+    char                  *p;
+    slot                  *l;
+    int                    count = 0;
+
+    for ( p = buf; p < buf + len; p += sizeof(*ev) + ev->len ) {
+        ev = (struct inotify_event*) p;
+        if ( ev->mask & IN_Q_OVERFLOW ) {
+            errno = EOVERFLOW;
+            return -1;
+        }
+        count++;
+        if ( ev->mask & IN_IGNORED )
+            continue;
+        l = find_wd(w, ev->wd);
+        if ( l != NULL && -1 == note(w, l->owner, ev->len ? ev->name : "") )
+            return -1;
+    }
+    return count;
+}
+
+/* Frees the nodes below d that were added by the watch. */
+static void free_added( du_dir *d )
+{
+    du_node *child, *next;
+
+    for ( child = d->children; child != NULL; child = next ) {
+        next = child->next;
+        if ( DU_IS_DIR(child) )
+            free_added((du_dir*) child);
+        free_node(child);
+    }
+}
+
+
+/*---------------------------------------------------------------------------
+                             Public functions
+---------------------------------------------------------------------------*/
+
+du_watch *du_watch_start( du_tree *tree, int flags )
+{
+    du_watch *w;
+    du_dir   *root = (du_dir*) tree->root;
+    int       err;
+
+    if ( tree->root->kind != DU_DIR ) {
+        errno = ENOTDIR;
+        return NULL;
+    }
+    if ( NULL == (w = calloc(1, sizeof(du_watch))) )
+        return NULL;
+    w->tree  = tree;
+    w->flags = flags;
+    w->fd    = -1;
+    arena_init(&w->arena, 0);
+    arena_init(&w->scratch, 0);
+    if ( -1 == map_init(&w->names, &w->arena) ||
+         -1 == map_init(&w->inodes, &w->arena) ||
+         -1 == map_init(&w->watches, &w->arena) ||
+         -1 == map_init(&w->pending, &w->scratch) ||
+         NULL == (w->buf = malloc(EVENT_BUFSIZE)) ||
+         -1 == register_dir(w, root) ) {
+        du_watch_stop(w);
+        return NULL;
+    }
+
+    if ( !(flags & DU_WATCH_INOTIFY) &&
+         -1 != (w->fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC |
+                                      FAN_NONBLOCK | FAN_REPORT_DFID_NAME,
+                                      O_RDONLY | O_LARGEFILE)) ) {
+        w->fanotify = TRUE;
+        if ( -1 == watch_tree(w, root) ) {
+            close(w->fd);
+            map_clear(&w->watches);
+            w->fanotify = FALSE;
+            w->num_fs   = 0;
+        }
+    }
+    if ( !w->fanotify &&
+         ( -1 == (w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) ||
+           -1 == watch_tree(w, root) ) ) {
+        err = errno;
+        du_watch_stop(w);
+        errno = err;
+        return NULL;
+    }
+    return w;
+}
+
+const char *du_watch_method( const du_watch *w )
+{
+    return w->fanotify ? "fanotify" : "inotify";
+}
+
+int du_watch_fd( const du_watch *w )
+{
+    return w->fd;
+}
+
+int du_watch_read( du_watch *w )
+{
+    ssize_t  len;
+    int      count, total = 0;
+    wdir    *wd;
+
+    /* Nothing refers to the retired wdirs once these lists are empty. */
+    if ( w->pending.count == 0 && w->changed == NULL ) {
+        while ( NULL != (wd = w->retired) ) {
+            w->retired = wd->retired;
+            wd->next   = w->free;
+            w->free    = wd;
+        }
+    }
+    while ( TRUE ) {
+        if ( -1 == (len = read(w->fd, w->buf, EVENT_BUFSIZE)) ) {
+            if ( errno == EAGAIN )
+                return total;
+            if ( errno == EINTR )
+                continue;
+            return -1;
+        }
+        count = w->fanotify ? note_fanotify(w, w->buf, len)
+                            : note_inotify(w, w->buf, len);
+        if ( count == -1 )
+            return -1;
+        total += count;
+    }
+}
+
+int du_watch_update( du_watch *w )
+{
+    slot    *l;
+    wdir    *wd;
+    int      count = 0, retval = 0;
+
+    for ( size_t i = 0; i < w->pending.size; i++ )
+        for ( l = w->pending.buckets[i]; l != NULL; l = l->next ) {
+            wd = l->owner;
+            if ( wd->gone )
+                continue;
+            count++;
+            if ( -1 == refresh(w, wd, l->item) )
+                retval = -1;
+        }
+    map_clear(&w->pending);
+    arena_free(&w->scratch);
+    if ( retval == -1 ) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return count;
+}
+
+du_dir *du_watch_next_changed( du_watch *w )
+{
+    wdir *wd;
+
+    while ( NULL != (wd = w->changed) ) {
+        w->changed  = wd->next;
+        wd->changed = FALSE;
+        if ( !wd->gone )
+            return wd->dir;
+    }
+    return NULL;
+}
+
+const char *du_watch_path( du_watch *w, const du_dir *d )
+{
+    const du_dir *p;
+    size_t        len = 0, pos, n;
+
+    for ( p = d; p != NULL; p = p->parent )
+        len += strlen(p->node.name) + 1;
+    if ( len > w->path_size ) {
+        free(w->path);
+        w->path_size = 2 * len;
+        if ( NULL == (w->path = malloc(w->path_size)) ) {
+            w->path_size = 0;
+            return NULL;
+        }
+    }
+    pos = len - 1;
+    w->path[pos] = '\0';
+    for ( p = d; p->parent != NULL; p = p->parent ) {
+        n = strlen(p->node.name);
+        pos -= n;
+        memcpy(w->path + pos, p->node.name, n);
+        w->path[--pos] = '/';
+    }
+    /* p is the root, whose name is the path that was walked. */
+    n = strlen(p->node.name);
+    while ( n > 0 && p->node.name[n-1] == '/' )
+        n--;
+    if ( n == 0 && d == p )
+        return "/";
+    memcpy(w->path + pos - n, p->node.name, n);
+    return w->path + pos - n;
+}
+
+void du_watch_stop( du_watch *w )
+{
+    if ( w->fd != -1 )
+        close(w->fd);
+    free_added((du_dir*) w->tree->root);
+    free(w->names.buckets);
+    free(w->inodes.buckets);
+    free(w->watches.buckets);
+    free(w->pending.buckets);
+    arena_free(&w->arena);
+    arena_free(&w->scratch);
+    free(w->fs);
+    free(w->orphans);
+    free(w->path);
+    free(w->entry);
+    free(w->buf);
+    free(w);
+}
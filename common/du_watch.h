@@ -0,0 +1,115 @@
+/*****************************************************************************
+  Title          : du_watch.h
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Keeping the totals of a du_walk() tree up to date from
+                   file system events
+
+  Notes:
+  A du_watch keeps the tree built by du_walk() current without walking it
+  again. It asks the kernel to report every change to the names and sizes
+  of the files in the tree, and for each change it examines only the one
+  entry that changed, with a single statx(), and adds the difference to
+  the totals of the directories above it. A new directory is read when it
+  appears; a removed one is dropped with everything below it.
+
+  The events come from fanotify if the process may use it: one mark on
+  each file system in the tree (FAN_MARK_FILESYSTEM), with every event
+  naming the directory by its file handle (FAN_REPORT_DFID_NAME), which is
+  looked up in a table of the handles of the directories in the tree.
+  Marking a file system needs CAP_SYS_ADMIN and a kernel of 5.9 or later;
+  otherwise, or if it is given the flag DU_WATCH_INOTIFY, it uses an
+  inotify watch on each directory, which is limited in number by
+  /proc/sys/fs/inotify/max_user_watches.
+
+  Events are only collected by du_watch_read(); du_watch_update() then
+  examines each entry that they named once, however many events named it,
+  so a file that is written to many times between updates costs one
+  statx(). If the kernel drops events because they were not read quickly
+  enough, du_watch_read() fails with EOVERFLOW and the tree must be walked
+  again.
+
+  A file with more than one link is counted at the first of its names that
+  nftw() would reach, as spl_du2 counts it. If that name is removed, the
+  file is counted at one of its other names in the tree from then on, if
+  it has any. A new link made to a file whose other names were examined
+  when it had only one link is counted twice, until the tree is walked
+  again.
+
+  Removed entries stay in their directory's list of children with the kind
+  DU_GONE until enough of them accumulate to be worth unlinking. The nodes
+  that du_watch adds to the tree are allocated singly, with the allocated
+  flag set, and are freed when they are removed or by du_watch_stop(), so
+  that the memory of a tree whose files come and go does not grow.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#ifndef DU_WATCH_H
+#define DU_WATCH_H
+
+#include "common_hdrs.h"
+#include "du_tree.h"
+
+/* Flags for du_watch_start(), besides DU_XDEV */
+#define DU_WATCH_INOTIFY  2     /* Use inotify even if fanotify is allowed */
+
+typedef struct du_watch_tag du_watch;
+
+
+/** du_watch_start(&tree, flags) starts watching tree, which du_walk() made
+    with the flags in flags other than DU_WATCH_INOTIFY, and whose root must
+    be a directory. It adds to the totals of tree's directories the files
+    with more than one link that du_walk() left out. It returns the watch,
+    or NULL with errno set if the events could not be subscribed to or
+    there is no memory.
+*/
+du_watch *du_watch_start( du_tree *tree, int flags );
+
+/** du_watch_method(w) returns "fanotify" or "inotify".
+*/
+const char *du_watch_method( const du_watch *w );
+
+/** du_watch_fd(w) returns the descriptor from which the events of w are
+    read, for use with poll(). It is non-blocking.
+*/
+int du_watch_fd( const du_watch *w );
+
+/** du_watch_read(w) reads the events that are waiting and notes the
+    entries that they name. It returns the number of events read, or -1
+    with errno set; errno is EOVERFLOW if events were lost.
+*/
+int du_watch_read( du_watch *w );
+
+/** du_watch_update(w) examines each entry noted by du_watch_read() since
+    the last update, and brings the tree and its totals up to date. It
+    returns the number of entries examined, or -1 with errno ENOMEM if a
+    new entry could not be added to the tree.
+*/
+int du_watch_update( du_watch *w );
+
+/** du_watch_next_changed(w) returns a directory whose total has changed,
+    or that has been added, since it was last returned, or NULL if there
+    are no more. Directories are returned after those below them.
+*/
+du_dir *du_watch_next_changed( du_watch *w );
+
+/** du_watch_path(w, d) returns the path of the directory d, in a buffer
+    that the next call overwrites, or NULL if there is no memory. Slashes
+    at the end of the root's path are dropped, as nftw() drops them.
+*/
+const char *du_watch_path( du_watch *w, const du_dir *d );
+
+/** du_watch_stop(w) stops watching and frees w and the nodes it added to
+    its tree. The tree can then only be freed with du_free().
+*/
+void du_watch_stop( du_watch *w );
+
+#endif /* DU_WATCH_H */
@@ -0,0 +1,128 @@
+/*****************************************************************************
+  Title          : durability.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Ways of making written data durable
+
+  Notes:
+  In DURABLE_SYNC_RANGE mode, the range written since the last sync is
+  the smallest one that contains all of the writes, so that the writes
+  need not be sequential, although they usually are.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#define _GNU_SOURCE
+#include "common_hdrs.h"
+#include <fcntl.h>
+#include "durability.h"
+
+#define MB  (1024*1024)
+
+static const char *durable_names[NUM_DURABLE_MODES] = {
+    "none", "fsync", "fdatasync", "dsync", "sync_range"
+};
+
+void durability_init( durability *d, durable_mode mode, off_t interval )
+{
+    memset(d, 0, sizeof(durability));
+    d->mode     = mode;
+    d->interval = ( interval > 0 ) ? interval : DEFAULT_SYNC_INTERVAL;
+}
+
+int parse_durability( const char *spec, durability *d )
+{
+    const char *colon = strchr(spec, ':');
+    size_t      len = ( colon != NULL ) ? (size_t) (colon - spec) :
+                                          strlen(spec);
+    long        mb = 0;
+    char        number[32];
+
+    for ( int i = 0; i < NUM_DURABLE_MODES; i++ ) {
+        if ( len != strlen(durable_names[i]) ||
+             0 != strncmp(spec, durable_names[i], len) )
+            continue;
+        if ( colon != NULL ) {
+            if ( i != DURABLE_FDATASYNC && i != DURABLE_SYNC_RANGE )
+                return -1;
+            /* get_long() wants a modifiable string. */
+            snprintf(number, sizeof(number), "%s", colon + 1);
+            if ( VALID_NUMBER != get_long(number, POS_ONLY, &mb, NULL) )
+                return -1;
+        }
+        durability_init(d, i, (off_t) mb * MB);
+        return 0;
+    }
+    return -1;
+}
+
+const char *durability_name( durable_mode mode )
+{
+    return durable_names[mode];
+}
+
+int durable_open_flags( const durability *d )
+{
+    return ( d->mode == DURABLE_DSYNC ) ? O_DSYNC : 0;
+}
+
+int durable_wrote( int fd, durability *d, off_t offset, size_t len )
+{
+    if ( d->mode != DURABLE_FDATASYNC && d->mode != DURABLE_SYNC_RANGE )
+        return 0;
+    if ( d->pending == 0 || offset < d->lo )
+        d->lo = offset;
+    if ( d->pending == 0 || offset + (off_t) len > d->hi )
+        d->hi = offset + len;
+    d->pending += len;
+    if ( d->pending < d->interval )
+        return 0;
+    d->pending = 0;
+
+    if ( d->mode == DURABLE_FDATASYNC )
+        return fdatasync(fd);
+
+    /* Start writing this range, then wait for the previous one. */
+    if ( -1 == sync_file_range(fd, d->lo, d->hi - d->lo,
+                               SYNC_FILE_RANGE_WRITE) )
+        return -1;
+    if ( d->prev_hi > d->prev_lo &&
+         -1 == sync_file_range(fd, d->prev_lo, d->prev_hi - d->prev_lo,
+                               SYNC_FILE_RANGE_WAIT_BEFORE |
+                               SYNC_FILE_RANGE_WRITE |
+                               SYNC_FILE_RANGE_WAIT_AFTER) )
+        return -1;
+    d->prev_lo = d->lo;
+    d->prev_hi = d->hi;
+    return 0;
+}
+
+int durable_finish( int fd, durability *d )
+{
+    int retval = 0;
+
+    switch ( d->mode ) {
+    case DURABLE_FSYNC:
+        retval = fsync(fd);
+        break;
+    case DURABLE_FDATASYNC:
+    case DURABLE_SYNC_RANGE:
+        /* fdatasync() waits for the writeback that is still in progress. */
+        retval = fdatasync(fd);
+        break;
+    default:
+        break;
+    }
+    d->pending = 0;
+    d->prev_lo = d->prev_hi = 0;
+    if ( retval == -1 && errno == EINVAL )  /* Not a file that can sync */
+        retval = 0;
+    return retval;
+}
@@ -0,0 +1,310 @@
+/*****************************************************************************
+  Title          : parallel_reduce.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Parallel reduction of an array by a persistent thread pool
+
+  Notes:
+  The workers sleep on a condition variable until the caller publishes a
+  new job by incrementing the pool's generation number. Each worker then
+  reduces its segment and decrements the count of pending workers; the
+  last one to finish wakes the caller. No barrier is needed because the
+  caller alone combines the per-thread results, which takes time
+  proportional to the number of threads.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#include "common_hdrs.h"
+#include <pthread.h>
+#include <math.h>
+#include "parallel_reduce.h"
+
+/* One thread's result, alone in its cache line. */
+typedef struct
+{
+    union {
+        long    l;
+        double  d;
+    } value;
+} __attribute__((aligned(CACHE_LINE_SIZE))) padded_acc;
+
+/* What a worker needs to find its pool and its segment. */
+typedef struct
+{
+    reduce_pool  *pool;
+    int           id;
+} worker_arg;
+
+struct reduce_pool_tag
+{
+    int              num_threads;  /* Workers plus the calling thread     */
+    pthread_t       *threads;      /* The num_threads-1 workers           */
+    worker_arg      *args;
+    padded_acc      *acc;          /* One accumulator per thread          */
+    pthread_mutex_t  lock;
+    pthread_cond_t   work_ready;   /* Signaled when a job is published    */
+    pthread_cond_t   work_done;    /* Signaled when pending reaches 0     */
+    unsigned long    generation;   /* Number of jobs published so far     */
+    int              pending;      /* Workers yet to finish current job   */
+    BOOL             shutdown;
+
+    /* The current job */
+    const void      *data;
+    long             n;
+    BOOL             is_double;
+    reduce_op        op;
+};
+
+
+static long identity_long( reduce_op op )
+{
+    switch ( op ) {
+    case REDUCE_PROD: return 1;
+    case REDUCE_MIN:  return LONG_MAX;
+    case REDUCE_MAX:  return LONG_MIN;
+    default:          return 0;
+    }
+}
+
+static double identity_dbl( reduce_op op )
+{
+    switch ( op ) {
+    case REDUCE_PROD: return 1.0;
+    case REDUCE_MIN:  return HUGE_VAL;
+    case REDUCE_MAX:  return -HUGE_VAL;
+    default:          return 0.0;
+    }
+}
+
+/* Reduces a[first..last-1] with op. The switch is outside the loops so
+   that each loop is simple enough for the compiler to vectorize.        */
+static long reduce_long( const long *a, long first, long last, reduce_op op )
+{
+    long r = identity_long(op);
+    long k;
+
+    switch ( op ) {
+    case REDUCE_SUM:
+        for ( k = first; k < last; k++ ) r += a[k];
+        break;
+    case REDUCE_PROD:
+        for ( k = first; k < last; k++ ) r *= a[k];
+        break;
+    case REDUCE_MIN:
+        for ( k = first; k < last; k++ ) r = a[k] < r ? a[k] : r;
+        break;
+    case REDUCE_MAX:
+        for ( k = first; k < last; k++ ) r = a[k] > r ? a[k] : r;
+        break;
+    }
+    return r;
+}
+
+/* Floating-point addition is not associative, so the compiler may not
+   reorder a single running sum into vector lanes by itself; four
+   independent sums give it (and the pipeline) the freedom to. */
+static double reduce_dbl( const double *a, long first, long last,
+                          reduce_op op )
+{
+    double r = identity_dbl(op);
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    long   k;
+
+    switch ( op ) {
+    case REDUCE_SUM:
+        for ( k = first; k + 4 <= last; k += 4 ) {
+            s0 += a[k];
+            s1 += a[k+1];
+            s2 += a[k+2];
+            s3 += a[k+3];
+        }
+        for ( ; k < last; k++ ) s0 += a[k];
+        r = (s0 + s1) + (s2 + s3);
+        break;
+    case REDUCE_PROD:
+        for ( k = first; k < last; k++ ) r *= a[k];
+        break;
+    case REDUCE_MIN:
+        for ( k = first; k < last; k++ ) r = a[k] < r ? a[k] : r;
+        break;
+    case REDUCE_MAX:
+        for ( k = first; k < last; k++ ) r = a[k] > r ? a[k] : r;
+        break;
+    }
+    return r;
+}
+
+static long combine_long( long a, long b, reduce_op op )
+{
+    switch ( op ) {
+    case REDUCE_PROD: return a * b;
+    case REDUCE_MIN:  return a < b ? a : b;
+    case REDUCE_MAX:  return a > b ? a : b;
+    default:          return a + b;
+    }
+}
+
+static double combine_dbl( double a, double b, reduce_op op )
+{
+    switch ( op ) {
+    case REDUCE_PROD: return a * b;
+    case REDUCE_MIN:  return a < b ? a : b;
+    case REDUCE_MAX:  return a > b ? a : b;
+    default:          return a + b;
+    }
+}
+
+/* Reduces thread id's segment of the current job into its accumulator. */
+static void reduce_segment( reduce_pool *pool, int id )
+{
+    long first = (id * pool->n) / pool->num_threads;
+    long last  = ((id + 1) * pool->n) / pool->num_threads;
+
+    if ( pool->is_double )
+        pool->acc[id].value.d = reduce_dbl(pool->data, first, last, pool->op);
+    else
+        pool->acc[id].value.l = reduce_long(pool->data, first, last, pool->op);
+}
+
+/* The worker thread start function. */
+static void* worker( void *arg )
+{
+    reduce_pool   *pool = ((worker_arg*) arg)->pool;
+    int            id   = ((worker_arg*) arg)->id;
+    unsigned long  seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while ( TRUE ) {
+        while ( pool->generation == seen && ! pool->shutdown )
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        if ( pool->shutdown )
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        reduce_segment(pool, id);
+
+        pthread_mutex_lock(&pool->lock);
+        if ( --pool->pending == 0 )
+            pthread_cond_signal(&pool->work_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+reduce_pool* reduce_pool_create( int num_threads )
+{
+    reduce_pool *pool;
+    int          t, retval;
+
+    if ( num_threads < 1 ) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ( NULL == (pool = calloc(1, sizeof(reduce_pool))) )
+        return NULL;
+    pool->num_threads = num_threads;
+    pool->threads = calloc(num_threads, sizeof(pthread_t));
+    pool->args    = calloc(num_threads, sizeof(worker_arg));
+    if ( 0 != posix_memalign((void**) &pool->acc, CACHE_LINE_SIZE,
+                             num_threads * sizeof(padded_acc)) )
+        pool->acc = NULL;
+    if ( pool->threads == NULL || pool->args == NULL || pool->acc == NULL ) {
+        free(pool->threads);
+        free(pool->args);
+        free(pool->acc);
+        free(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    /* Thread 0 is the caller; create the others. */
+    for ( t = 1; t < num_threads; t++ ) {
+        pool->args[t].pool = pool;
+        pool->args[t].id   = t;
+        if ( 0 != (retval = pthread_create(&pool->threads[t], NULL, worker,
+                                           &pool->args[t])) ) {
+            pool->num_threads = t;    /* Destroy only those created. */
+            reduce_pool_destroy(pool);
+            errno = retval;
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void reduce_pool_destroy( reduce_pool *pool )
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = TRUE;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+    for ( int t = 1; t < pool->num_threads; t++ )
+        pthread_join(pool->threads[t], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+    free(pool->threads);
+    free(pool->args);
+    free(pool->acc);
+    free(pool);
+}
+
+/* Publishes a job to the workers, does the caller's share, and waits for
+   the workers to finish theirs. */
+static void run_job( reduce_pool *pool, const void *data, long n,
+                     BOOL is_double, reduce_op op )
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->data      = data;
+    pool->n         = n;
+    pool->is_double = is_double;
+    pool->op        = op;
+    pool->pending   = pool->num_threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    reduce_segment(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while ( pool->pending > 0 )
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+long parallel_reduce( reduce_pool *pool, const long *data, long n,
+                      reduce_op op )
+{
+    long result;
+
+    run_job(pool, data, n, FALSE, op);
+    result = pool->acc[0].value.l;
+    for ( int t = 1; t < pool->num_threads; t++ )
+        result = combine_long(result, pool->acc[t].value.l, op);
+    return result;
+}
+
+double parallel_reduce_dbl( reduce_pool *pool, const double *data, long n,
+                            reduce_op op )
+{
+    double result;
+
+    run_job(pool, data, n, TRUE, op);
+    result = pool->acc[0].value.d;
+    for ( int t = 1; t < pool->num_threads; t++ )
+        result = combine_dbl(result, pool->acc[t].value.d, op);
+    return result;
+}
@@ -0,0 +1,166 @@
+/*****************************************************************************
+  Title          : proc_tree.c
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : An index of the parent/child relation of all processes
+
+  Notes:
+  The nodes are kept in an array sorted by PID, so a PID is found by binary
+  search, and the tree links are array indices. readdir() returns the
+  entries of /proc in increasing PID order, so the sort is nearly free.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#include "common_hdrs.h"
+#include <dirent.h>
+#include "ps_utils.h"
+#include "proc_tree.h"
+
+#define INITIAL_NODES  512
+
+/* Compares two nodes by PID, for qsort() and bsearch(). */
+static int nodecmp( const void *a, const void *b )
+{
+    return ((proc_node*) a)->pid - ((proc_node*) b)->pid;
+}
+
+/* Reads the parent PID of pid from its stat file into *ppid. The command
+   name may contain blanks and parentheses, so the fields after it are
+   found from the last ')' in the line. Returns 1 on success, else 0.     */
+static int read_ppid( pid_t pid, pid_t *ppid )
+{
+    char  buf[MAX_LINE];
+    char *close_paren;
+    char  state;
+
+    if ( -1 == read_proc_file(pid, "stat", buf, sizeof(buf)) )
+        return 0;
+    if ( NULL == (close_paren = strrchr(buf, ')')) )
+        return 0;
+    return 2 == sscanf(close_paren + 1, " %c %d", &state, ppid);
+}
+
+int find_proc( const proc_tree *tree, pid_t pid )
+{
+    proc_node  key;
+    proc_node *found;
+
+    key.pid = pid;
+    found = bsearch(&key, tree->nodes, tree->numprocs, sizeof(proc_node),
+                    nodecmp);
+    return ( found == NULL ) ? NO_PROC : found - tree->nodes;
+}
+
+int build_proc_tree( proc_tree *tree )
+{
+    DIR           *dirp;
+    struct dirent *direntp;
+    char*   accepts = "0123456789";
+    int     capacity = INITIAL_NODES;
+    int     n = 0;
+    int     i, p;
+    pid_t   pid, ppid;
+
+    tree->nodes    = NULL;
+    tree->numprocs = 0;
+    if ( NULL == (dirp = opendir("/proc")) )
+        return -1;
+    if ( NULL == (tree->nodes = malloc(capacity * sizeof(proc_node))) )
+        fatal_error(errno, "malloc");
+
+    while ( NULL != (direntp = readdir(dirp)) ) {
+        if ( strspn(direntp->d_name, accepts) != strlen(direntp->d_name) )
+            continue;
+        pid = atoi(direntp->d_name);
+        if ( ! read_ppid(pid, &ppid) )
+            continue;                  /* The process has terminated. */
+        if ( n == capacity ) {
+            capacity *= 2;
+            tree->nodes = realloc(tree->nodes, capacity * sizeof(proc_node));
+            if ( NULL == tree->nodes )
+                fatal_error(errno, "realloc");
+        }
+        tree->nodes[n].pid  = pid;
+        tree->nodes[n].ppid = ppid;
+        n++;
+    }
+    closedir(dirp);
+    qsort(tree->nodes, n, sizeof(proc_node), nodecmp);
+    tree->numprocs = n;
+
+    for ( i = 0; i < n; i++ ) {
+        tree->nodes[i].first_child  = NO_PROC;
+        tree->nodes[i].next_sibling = NO_PROC;
+        tree->nodes[i].depth        = 0;
+        tree->nodes[i].parent       = find_proc(tree, tree->nodes[i].ppid);
+        if ( tree->nodes[i].parent == i )
+            tree->nodes[i].parent = NO_PROC;
+    }
+    /* Link the children in reverse so each list is in increasing order. */
+    for ( i = n - 1; i >= 0; i-- ) {
+        if ( NO_PROC != (p = tree->nodes[i].parent) ) {
+            tree->nodes[i].next_sibling = tree->nodes[p].first_child;
+            tree->nodes[p].first_child  = i;
+        }
+    }
+    /* Depths, assigned in preorder so that each parent comes first. */
+    for ( i = next_preorder(tree, NO_PROC); i != NO_PROC;
+          i = next_preorder(tree, i) ) {
+        p = tree->nodes[i].parent;
+        tree->nodes[i].depth = ( p == NO_PROC ) ? 0 : tree->nodes[p].depth + 1;
+    }
+    return n;
+}
+
+void free_proc_tree( proc_tree *tree )
+{
+    free(tree->nodes);
+    tree->nodes    = NULL;
+    tree->numprocs = 0;
+}
+
+int get_ancestors( const proc_tree *tree, pid_t pid, pid_t *list, int max )
+{
+    int i, count = 0;
+
+    if ( NO_PROC == (i = find_proc(tree, pid)) )
+        return -1;
+    /* Follow the parent links. The parent of a process that is not in
+       the tree (such as 0, the parent of init and kthreadd) is not
+       listed, just as it has no /proc directory. */
+    while ( NO_PROC != (i = tree->nodes[i].parent) && count < max )
+        list[count++] = tree->nodes[i].pid;
+    return count;
+}
+
+/* A root is a node whose parent is not in the tree. */
+static int next_root( const proc_tree *tree, int i )
+{
+    for ( i = i + 1; i < tree->numprocs; i++ )
+        if ( tree->nodes[i].parent == NO_PROC )
+            return i;
+    return NO_PROC;
+}
+
+int next_preorder( const proc_tree *tree, int i )
+{
+    if ( i == NO_PROC )
+        return next_root(tree, -1);
+    if ( tree->nodes[i].first_child != NO_PROC )
+        return tree->nodes[i].first_child;
+    /* Climb until a node with a next sibling is found. */
+    while ( tree->nodes[i].next_sibling == NO_PROC ) {
+        if ( tree->nodes[i].parent == NO_PROC )
+            return next_root(tree, i);
+        i = tree->nodes[i].parent;
+    }
+    return tree->nodes[i].next_sibling;
+}
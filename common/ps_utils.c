@@ -101,6 +101,31 @@ void get_boot_time(unsigned long long *btime)
     fclose(fp);
 }
 
+/** read_proc_file(pid, name, buf, size) reads at most size-1 bytes of the
+    file /proc/[pid]/name into buf with a single open()/read() pair and
+    terminates it with a null byte. It returns the number of bytes read,
+    or -1 if the file could not be opened or read.
+    The files in /proc/[pid] are generated in full on each read, so one
+    read() with a large enough buffer retrieves the whole file without
+    the overhead of a stdio stream.
+*/
+ssize_t read_proc_file(pid_t pid, const char *name, char *buf, size_t size)
+{
+    char    pathname[64];   /* Pathname of file to read                  */
+    int     fd;
+    ssize_t nbytes;
+
+    snprintf(pathname, sizeof(pathname), "/proc/%d/%s", pid, name);
+    if ( -1 == (fd = open(pathname, O_RDONLY)) )
+        return -1;
+    nbytes = read(fd, buf, size - 1);
+    close(fd);
+    if ( nbytes < 0 )
+        return -1;
+    buf[nbytes] = '\0';
+    return nbytes;
+}
+
 /** get_cpu_time_str(ps, str) computes the sum of stime and utime in the
     procstat structure ps, converts it to centiseconds as a long int, and
     formats the total time in a string M:SS.CC unless it is greater than
@@ -161,13 +186,15 @@ void make_start_time_str(procstat ps, char* start_time )
     struct tm          *current_time;
     struct tm           saved_start_time;
     const char* fmt =   START_FORMAT;
-    unsigned long  long boot_time;
+    static unsigned long long boot_time = 0; /* Read once per program run */
     static unsigned long long seconds_since_epoch;
 
     seconds_since_epoch = time(NULL);
-    get_boot_time(&boot_time);
-    if ( 0 == boot_time)
-        fatal_error(-1, "Could not get boot time");
+    if ( 0 == boot_time ) {
+        get_boot_time(&boot_time);
+        if ( 0 == boot_time)
+            fatal_error(-1, "Could not get boot time");
+    }
     start = boot_time + ps.start_time/hz;
     bdtime = localtime((time_t*) (&start));
     saved_start_time = *bdtime;
@@ -224,11 +251,28 @@ int tty_name(char *buf, unsigned maj, unsigned min)
 
 /** parse_buf(buf, ps) fills the procstat stucture ps with the fields
    from the stat file.
+   The command name is enclosed in parentheses and may itself contain
+   blanks and parentheses, so it is delimited by the first '(' and the last
+   ')' in the buffer rather than by white space. The name, including its
+   parentheses, is copied into newly allocated memory in ps->comm.
+   It returns the number of fields assigned, which is 13 on success.
 */
 int parse_buf(char* buf, procstat *ps)
 {
     int retval = 0;
-    retval = sscanf(buf, " %d %ms %c %d  %d " /* pid, comm, state, ppid, pgrp        */
+    char *open_paren, *close_paren;
+
+    ps->comm = NULL;
+    if ( 1 != sscanf(buf, " %d", &ps->pid) )
+        return 0;
+    if ( NULL == (open_paren = strchr(buf, '(')) ||
+         NULL == (close_paren = strrchr(buf, ')')) ||
+         close_paren < open_paren )
+        return 1;
+    if ( NULL == (ps->comm = strndup(open_paren, close_paren - open_paren + 1)))
+        fatal_error(errno, "strndup");
+    retval = 2 +
+      sscanf(close_paren + 1, " %c %d  %d " /* state, ppid, pgrp           */
                 " %d %d "            /* session, tty_nr                     */
                 " %*d %*u %*u "      /* skipping tty_pgrp, flags, min_flt   */
                 " %*u  %*u %*u "     /* skipping cmin_flt, maj_flt, cmaj_flt*/
@@ -238,8 +282,6 @@ int parse_buf(char* buf, procstat *ps)
                 " %*d %*d "          /* skipping num_threads, alarm         */
                 " %llu %lu",         /* start_time, vsize                   */
                                       /* skipping everything after vsize    */
-            &ps->pid,
-            &ps->comm,
             &ps->state,
             &ps->ppid,
             &ps->pgrp,
@@ -76,6 +76,14 @@ char* uid2name ( uid_t uid );
  */
 void get_boot_time(unsigned long long *btime);
 
+/** read_proc_file(pid, name, buf, size) reads at most size-1 bytes of the
+    file /proc/[pid]/name into buf with a single open()/read() pair and
+    terminates it with a null byte. It returns the number of bytes read,
+    or -1 if the file could not be opened or read, which usually means
+    that the process has terminated.
+*/
+ssize_t read_proc_file(pid_t pid, const char *name, char *buf, size_t size);
+
 void get_cpu_time_str( procstat ps, char* cputimestr );
 
 /** make_cpu_time_str(ps, str) computes the sum of stime and utime in the
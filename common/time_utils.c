@@ -7,6 +7,8 @@
   Modifications:
     Nov. 2, 2025 by SNW
     Added a new version of timespec_diff() named timespec_diff2()
+    Oct. 2026 by SNW
+    Added elapsed(), which several benchmarks had each defined
 
 ******************************************************************************
 * Copyright (C) 2025 - Stewart Weiss                                         *
@@ -77,6 +79,17 @@ void timespec_diff ( struct timespec ts1, struct timespec ts2,
        diff->tv_nsec = temp;
 }
 
+double elapsed( struct timespec start )
+{
+    struct timespec now, diff;
+    double secs;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timespec_diff(now, start, &diff);
+    timespec_to_dbl(diff, &secs);
+    return secs;
+}
+
 /* Added by SNW 11/2/2025.
    This function computes the difference between two timespec values
    regardless of whether the first is smaller than the second. However,
@@ -66,6 +66,14 @@ void timespec_to_dbl( struct timespec ts, double  *t);
 void timespec_diff ( struct timespec ts1, struct timespec ts2,
                    struct timespec *diff );
 
+/** elapsed(start)
+    Returns the number of seconds from start, a time read from the
+    CLOCK_MONOTONIC clock, until now, as a double.
+ *  @param  struct timespec  start  [IN]
+ *  @return the seconds elapsed since start
+ */
+double elapsed( struct timespec start );
+
 /* Added by SNW 11/2/2025.
    This function computes the difference between two timespec values
    regardless of whether the first is smaller than the second. However,
@@ -0,0 +1,65 @@
+/*****************************************************************************
+  Title          : arena.h
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Allocation of many small objects that are freed together
+
+  Notes:
+  An arena hands out memory from large chunks by advancing a pointer, so
+  an allocation costs a few instructions and no header, and everything it
+  handed out is released by one call to arena_free(). It suits programs
+  that build a large structure, such as a tree of millions of file names,
+  and then discard it as a whole. Objects cannot be freed one at a time.
+
+  An arena is not safe to use from several threads at once; a program
+  whose threads allocate concurrently gives each thread its own arena.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "common_hdrs.h"
+
+#define ARENA_CHUNK_SIZE  (1024*1024)   /* Default bytes per chunk */
+
+typedef struct arena_chunk_tag arena_chunk;
+
+typedef struct
+{
+    arena_chunk  *chunks;      /* Most recently allocated chunk first */
+    size_t        chunk_size;  /* Size of each new chunk              */
+    size_t        total;       /* Bytes handed out so far             */
+} arena;
+
+
+/** arena_init(&a, chunk_size) makes a an empty arena that obtains memory
+    in chunks of chunk_size bytes, or ARENA_CHUNK_SIZE if it is 0.
+*/
+void arena_init( arena *a, size_t chunk_size );
+
+/** arena_alloc(&a, size) returns size bytes from a, aligned for any type,
+    or NULL if no memory could be obtained. A request larger than the
+    chunk size gets a chunk of its own.
+*/
+void *arena_alloc( arena *a, size_t size );
+
+/** arena_strndup(&a, s, len) returns a copy in a of the len bytes at s,
+    followed by a null byte, or NULL if no memory could be obtained.
+*/
+char *arena_strndup( arena *a, const char *s, size_t len );
+
+/** arena_free(&a) releases all of the memory of a, which is then empty
+    and can be used again.
+*/
+void arena_free( arena *a );
+
+#endif /* ARENA_H */
@@ -0,0 +1,54 @@
+/*****************************************************************************
+  Title          : bulk_parse.h
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Fast parsing of large amounts of whitespace-separated
+                   numbers
+
+  Notes:
+  These functions replace loops that call fscanf() once per number. The
+  whole input is mapped into memory if it is a regular file, or read in
+  large blocks otherwise. It is then divided into segments at whitespace
+  boundaries, and each segment is parsed by its own thread in two passes:
+  the first counts the numbers so that each thread knows where its values
+  go in the result, and the second converts them. Digits are converted
+  eight at a time with SWAR arithmetic (SIMD within a register) where
+  possible, and the rare numbers that the fast path cannot convert exactly
+  are passed to strtol() or strtod().
+
+  As with repeated calls to fscanf(), parsing stops at the first token
+  that is not a number; the values before it are returned.
+
+  Programs that use these functions must be linked with -pthread.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#ifndef BULK_PARSE_H
+#define BULK_PARSE_H
+
+#include "common_hdrs.h"
+
+/** bulk_parse_long(fd, &values, num_threads) reads everything from the
+    file descriptor fd and parses it as whitespace-separated decimal
+    integers, using num_threads threads. It stores the integers in a newly
+    allocated array in values, which the caller must free(), and returns
+    their number. It returns -1 and sets errno if fd cannot be read or
+    memory cannot be allocated.
+*/
+long bulk_parse_long( int fd, long **values, int num_threads );
+
+/** bulk_parse_dbl(fd, &values, num_threads) is bulk_parse_long() for
+    floating-point numbers, which may have a fractional part and an
+    exponent, as accepted by strtod().
+*/
+long bulk_parse_dbl( int fd, double **values, int num_threads );
+
+#endif /* BULK_PARSE_H */
@@ -0,0 +1,169 @@
+/*****************************************************************************
+  Title          : copy_utils.h
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Functions that copy data between file descriptors
+
+  Notes:
+  copy_fd() can copy with any of several methods, called engines here.
+  The first three move the data inside the kernel without passing it
+  through a user-space buffer:
+
+  COPY_RANGE     copy_file_range(), which copies between regular files
+                 and lets the file system share (reflink) the blocks
+                 or copy them on the server instead of moving the data
+  COPY_SENDFILE  sendfile(), which reads from a file that can be mapped
+                 and writes to any file
+  COPY_SPLICE    splice(), which moves pages from the source into a pipe
+                 and from the pipe to the target
+  COPY_BUFFERED  read() into a buffer and write() from it
+
+  With COPY_AUTO, copy_fd() tries them in that order, moving on to the
+  next whenever the kernel reports that one cannot be used for the given
+  pair of files.
+
+  Two more engines map the source into memory, in windows of 64 MB, and
+  must be asked for by name:
+
+  COPY_MMAP      write() each window of the source from the mapping
+  COPY_MMAP_BOTH also map the target, which must be open for reading and
+                 writing, extending it with ftruncate(), and memcpy() each
+                 window of the source into it
+
+  They replace the read() of COPY_BUFFERED with page faults, which cost
+  less than copying for large files and more for small ones. Mappings are
+  advised with MADV_SEQUENTIAL and MADV_HUGEPAGE, and set_mmap_populate()
+  makes them MAP_POPULATE, so that the pages are read in when the window
+  is mapped instead of one fault at a time. A source file that is
+  truncated while it is mapped causes a SIGBUS.
+
+  copy_sparse() copies only the data of a file with holes, finding it with
+  lseek(SEEK_DATA) and lseek(SEEK_HOLE), and leaves holes in the target
+  where the source has them. It can also make holes in the target where
+  the source has blocks that contain only zeros. copy_sparse_range() does
+  the same for one range of a file, so that the pieces of a large file can
+  be copied by several threads.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#ifndef COPY_UTILS_H
+#define COPY_UTILS_H
+
+#include "common_hdrs.h"
+
+#define COPY_TO_EOF         -1          /* Count meaning "until end of file" */
+#define DEFAULT_COPY_BUFSIZE  (128*1024)  /* Buffer and pipe size            */
+
+/* How copy_sparse() treats holes and blocks of zeros in the source */
+typedef enum
+{
+    SPARSE_NEVER,    /* Copy every byte, so the target has no holes      */
+    SPARSE_AUTO,     /* Make a hole in the target for each hole in source */
+    SPARSE_ALWAYS,   /* Also make holes for blocks that are all zeros     */
+    NUM_SPARSE_MODES
+} sparse_mode;
+
+typedef enum
+{
+    COPY_AUTO,
+    COPY_RANGE,
+    COPY_SENDFILE,
+    COPY_SPLICE,
+    COPY_BUFFERED,
+    COPY_MMAP,
+    COPY_MMAP_BOTH,
+    NUM_COPY_ENGINES
+} copy_engine;
+
+
+/** copy_engine_name(engine) returns the name of engine, as accepted by
+    parse_copy_engine().
+*/
+const char *copy_engine_name( copy_engine engine );
+
+/** parse_copy_engine(name) returns the engine called name, which is one of
+    "auto", "copy_file_range", "sendfile", "splice", "rw", "mmap", or
+    "mmap_both", or -1 if there is no such engine.
+*/
+int parse_copy_engine( const char *name );
+
+/** set_mmap_populate(populate) makes the mappings of COPY_MMAP and
+    COPY_MMAP_BOTH use MAP_POPULATE if populate is TRUE. It affects all
+    later copies in the process.
+*/
+void set_mmap_populate( BOOL populate );
+
+/** write_all(fd, buf, count) writes count bytes from buf to fd, repeating
+    the write() after a partial write or an interrupt. It returns count,
+    or -1 on error.
+*/
+ssize_t write_all( int fd, const void *buf, size_t count );
+
+/** copy_fd(in_fd, out_fd, count, engine, bufsize, used)
+    Copies count bytes, or everything up to end of file if count is
+    COPY_TO_EOF, from the current offset of in_fd to the current offset of
+    out_fd with the given engine, and advances both offsets.
+ *  @param  int          in_fd   [IN]  descriptor to copy from
+ *  @param  int          out_fd  [IN]  descriptor to copy to
+ *  @param  off_t        count   [IN]  bytes to copy, or COPY_TO_EOF
+ *  @param  copy_engine  engine  [IN]  engine to use, or COPY_AUTO
+ *  @param  size_t       bufsize [IN]  buffer size for COPY_BUFFERED and
+ *                                     pipe size for COPY_SPLICE, or 0 for
+ *                                     DEFAULT_COPY_BUFSIZE
+ *  @param  copy_engine *used    [OUT] if not NULL, the engine that copied
+ *                                     the data (the last one, if COPY_AUTO
+ *                                     had to fall back part way through)
+ *  @return the number of bytes copied, or -1 on error, with errno set.
+            If an engine other than COPY_AUTO cannot be used for these
+            files, errno is EINVAL, EXDEV, ENOSYS or EOPNOTSUPP.
+ */
+off_t copy_fd( int in_fd, int out_fd, off_t count, copy_engine engine,
+               size_t bufsize, copy_engine *used );
+
+/** parse_sparse_mode(name) returns the mode called name, which is one of
+    "never", "auto", or "always", or -1 if there is no such mode.
+*/
+int parse_sparse_mode( const char *name );
+
+/** copy_sparse(in_fd, out_fd, mode, engine, bufsize, used)
+    Copies the whole of in_fd to out_fd, starting at offset 0 of each,
+    and makes out_fd the same size as in_fd. If mode is not SPARSE_NEVER
+    and in_fd is a regular file, only the data regions of in_fd are
+    copied, with copy_fd() and the given engine, and the holes between
+    them are left as holes in out_fd. With SPARSE_ALWAYS, the data is
+    copied through a buffer of bufsize bytes, and each buffer that holds
+    only zeros becomes a hole as well. If out_fd already held data where
+    a hole belongs, the data is removed with fallocate(), or overwritten
+    with zeros if the file system cannot punch holes. If in_fd is not a
+    regular file, such as a pipe or terminal, it is read from its current
+    offset to its end. If out_fd is not a regular file, such as a pipe or
+    /dev/null, in_fd is simply copied to it with copy_fd(), from the
+    current offset of each.
+ *  @return the number of bytes of data written to out_fd, or -1 on error.
+            It is less than the size of the file when holes were made.
+ */
+off_t copy_sparse( int in_fd, int out_fd, sparse_mode mode, copy_engine engine,
+                   size_t bufsize, copy_engine *used );
+
+/** copy_sparse_range(in_fd, out_fd, offset, count, mode, engine, bufsize,
+                      used)
+    Copies count bytes, or up to the end of the file if count is
+    COPY_TO_EOF, from offset of the regular file in_fd to the same offset
+    of the regular file out_fd, treating holes as copy_sparse() does. The
+    size of out_fd is not changed, except where data is written beyond
+    its end, so the caller must set it, as copy_sparse() does.
+ *  @return the number of bytes of data written to out_fd, or -1 on error.
+ */
+off_t copy_sparse_range( int in_fd, int out_fd, off_t offset, off_t count,
+                         sparse_mode mode, copy_engine engine, size_t bufsize,
+                         copy_engine *used );
+
+#endif /* COPY_UTILS_H */
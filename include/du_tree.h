@@ -0,0 +1,145 @@
+/*****************************************************************************
+  Title          : du_tree.h
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : A parallel walk of a file hierarchy that sums disk usage
+
+  Notes:
+  du_walk() builds a tree with a node for every file under a path, in the
+  order in which each directory lists its entries, and sums the disk
+  usage of every directory's subtree. It is meant for trees too large for
+  nftw(), which reads one directory at a time and passes every file to
+  lstat() by its full path, so that the kernel resolves every component of
+  the path again for every file.
+
+  The directories are read by a set of threads. Each thread has a
+  double-ended queue of directories waiting to be read. It adds the
+  subdirectories it finds to the back of its own queue and takes the next
+  directory from the back too, so that it works depth first on a part of
+  the tree that is still in the caches; a thread whose queue is empty
+  steals from the front of another thread's queue, which holds the
+  directories nearest the top of the tree, and so the largest pieces of
+  work. Directories are read with getdents64() into a large buffer, and
+  every entry is examined with statx() relative to a descriptor of its
+  directory, so no path is ever resolved but the first. statx() is asked
+  only for the fields that are needed, which spares file systems that
+  compute the others on demand, and with AT_STATX_DONT_SYNC, so that a
+  network file system may answer from its cache. An entry that getdents64()
+  says is a directory is not examined at all until it is opened, and then
+  through its new descriptor, with no lookup of its name.
+
+  Each directory node counts the subdirectories that it is still waiting
+  for. The thread that finishes a directory adds its total to its
+  parent's with an atomic addition, and the last of the parent's
+  subdirectories to finish does the same for the parent, so the totals
+  are complete, bottom up, when the walk ends.
+
+  Usage is counted in kilobytes, as st_blocks/2. A file with more than
+  one link is left out of the totals of the directories above it, since
+  which of its names is the first one reached depends on the order in
+  which the threads happen to run; the caller decides where to count it.
+  The walk does not follow symbolic links. It crosses mount points unless
+  it is given the flag DU_XDEV, in which case anything on a file system
+  other than that of the root is recorded as a DU_MOUNT node and not
+  examined further.
+
+  Programs that use these functions must be linked with -pthread.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#ifndef DU_TREE_H
+#define DU_TREE_H
+
+#include "common_hdrs.h"
+#include <stdint.h>
+#include "arena.h"
+
+/* The kinds of node */
+typedef enum
+{
+    DU_FILE,        /* Anything but a directory or a symbolic link  */
+    DU_SYMLINK,
+    DU_DIR,
+    DU_DNR,         /* A directory that could not be read           */
+    DU_NS,          /* A file that could not be examined with stat  */
+    DU_MOUNT,       /* A file on another file system, with DU_XDEV  */
+    DU_GONE         /* Removed since the walk (see du_watch.h)      */
+} du_kind;
+
+/* Flags for du_walk() */
+#define DU_XDEV  1     /* Stay on the file system of the root */
+
+typedef struct du_index_tag du_index;     /* See du_index.h */
+
+#define DU_IS_DIR(n)  ((n)->kind == DU_DIR || (n)->kind == DU_DNR)
+
+/* A file in the tree. */
+typedef struct du_node_tag
+{
+    struct du_node_tag  *next;     /* Next entry of the same directory     */
+    char                *name;     /* Last component of the path           */
+    uintmax_t            usage;    /* KB used, by the subtree if a dir     */
+    ino_t                ino;
+    unsigned char        kind;     /* A du_kind                            */
+    unsigned char        linked;   /* Not a directory, and st_nlink > 1    */
+    unsigned char        allocated;/* By malloc(), not in an arena of the   */
+                                   /* tree (see du_watch.h)                */
+    unsigned char        counted;  /* The name at which du_watch counts a  */
+                                   /* linked file                          */
+} du_node;
+
+/* A directory in the tree, whose node is also its first member, so that
+   a du_node whose kind satisfies DU_IS_DIR can be cast to a du_dir.     */
+typedef struct du_dir_tag
+{
+    du_node              node;
+    struct du_dir_tag   *parent;
+    du_node             *children; /* In the order the directory lists them */
+    dev_t                dev;      /* Device of the directory and its files */
+    int                  err;      /* errno if it could not be read         */
+    BOOL                 have_status;  /* Whether node has been filled in   */
+    BOOL                 from_index;   /* Whether its entries were found in */
+                                       /* an index instead of being read    */
+    struct timespec      mtime;
+    struct timespec      ctime;
+    int                  fd;       /* Used during the walk only             */
+    int                  refs;
+    int                  pending;
+    void                *data;     /* Free for the caller's use             */
+} du_dir;
+
+typedef struct
+{
+    du_node    *root;          /* The node of the path that was walked    */
+    dev_t       dev;           /* Its device                              */
+    int         num_arenas;    /* One arena for each thread               */
+    arena      *arenas;
+} du_tree;
+
+
+/** du_walk(path, num_threads, flags, index, &tree) walks the hierarchy at
+    path with num_threads threads, of which the calling thread is one, and
+    stores its tree in tree. flags is 0 or DU_XDEV. If index is not NULL,
+    directories that have not changed since they were recorded in it are
+    not read (see du_index.h). The root's name is path itself. It returns
+    0, or -1 with errno set if path could not be examined or memory or
+    threads could not be obtained. Directories that could not be read and
+    files that could not be examined are recorded in the tree as DU_DNR
+    and DU_NS nodes.
+*/
+int du_walk( const char *path, int num_threads, int flags, du_index *index,
+             du_tree *tree );
+
+/** du_free(&tree) releases the memory of tree.
+*/
+void du_free( du_tree *tree );
+
+#endif /* DU_TREE_H */
@@ -0,0 +1,110 @@
+/*****************************************************************************
+  Title          : durability.h
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Ways of making written data durable
+
+  Notes:
+  write() returns as soon as the data is in the page cache; it reaches
+  the device only when the kernel writes it back, up to half a minute
+  later, and is lost if the system crashes before then. A program that
+  must not lose its data has to ask for it to be written, which costs
+  time, and these functions offer several ways of doing so:
+
+  DURABLE_NONE        Leave it to the kernel.
+  DURABLE_FSYNC       Call fsync() once, when the file is complete.
+  DURABLE_FDATASYNC   Call fdatasync() after every interval bytes, and at
+                      the end, so that at most interval bytes are lost.
+  DURABLE_DSYNC       Open the file with O_DSYNC, so that every write()
+                      returns only when its data is on the device.
+  DURABLE_SYNC_RANGE  Every interval bytes, start the writeback of the
+                      range just written with sync_file_range() and wait
+                      for the writeback of the range before it, so that
+                      writing to the device overlaps with filling the
+                      cache. sync_file_range() neither writes the file's
+                      metadata nor flushes the device's write cache, so
+                      fdatasync() is called at the end.
+
+  A mode is given as its name, "none", "fsync", "fdatasync", "dsync", or
+  "sync_range", which may be followed by ":" and the interval in MB
+  (2^20 bytes) for the two modes that have one.
+
+  fdatasync() and fsync() differ only in that fdatasync() does not write
+  metadata that is not needed to read the data, such as the times of the
+  file, which saves a write for a file whose size does not change.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#ifndef DURABILITY_H
+#define DURABILITY_H
+
+#include "common_hdrs.h"
+
+#define DEFAULT_SYNC_INTERVAL  (8*1024*1024)  /* Bytes between syncs */
+
+typedef enum
+{
+    DURABLE_NONE,
+    DURABLE_FSYNC,
+    DURABLE_FDATASYNC,
+    DURABLE_DSYNC,
+    DURABLE_SYNC_RANGE,
+    NUM_DURABLE_MODES
+} durable_mode;
+
+/* A durability mode and what has been written since data was last synced */
+typedef struct
+{
+    durable_mode  mode;
+    off_t         interval;     /* Bytes between syncs                  */
+    off_t         pending;      /* Bytes written since the last sync    */
+    off_t         lo, hi;       /* Range they were written to           */
+    off_t         prev_lo;      /* Range whose writeback was started    */
+    off_t         prev_hi;      /* by the last sync                     */
+} durability;
+
+
+/** durability_init(&d, mode, interval) sets d to the given mode, with
+    interval bytes between syncs, or DEFAULT_SYNC_INTERVAL if interval
+    is 0.
+*/
+void durability_init( durability *d, durable_mode mode, off_t interval );
+
+/** parse_durability(spec, &d) initializes d from spec, which is a mode
+    name optionally followed by ":MB". It returns 0, or -1 if spec is not
+    valid.
+*/
+int parse_durability( const char *spec, durability *d );
+
+/** durability_name(mode) returns the name of mode. */
+const char *durability_name( durable_mode mode );
+
+/** durable_open_flags(&d) returns the flags to add to those of open() for
+    the file that is to be written with d, which is O_DSYNC for
+    DURABLE_DSYNC and 0 otherwise.
+*/
+int durable_open_flags( const durability *d );
+
+/** durable_wrote(fd, &d, offset, len) must be called after each write()
+    of len bytes at offset to fd, and syncs the file when d says that it
+    is time to. Calls for the same file must not be made concurrently.
+    It returns 0, or -1 with errno set if a sync failed.
+*/
+int durable_wrote( int fd, durability *d, off_t offset, size_t len );
+
+/** durable_finish(fd, &d) must be called when everything has been
+    written to fd, and returns when it is durable. It returns 0, or -1
+    with errno set if a sync failed. A descriptor that cannot be synced,
+    such as a terminal, is not an error.
+*/
+int durable_finish( int fd, durability *d );
+
+#endif /* DURABILITY_H */
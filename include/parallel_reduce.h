@@ -0,0 +1,66 @@
+/*****************************************************************************
+  Title          : parallel_reduce.h
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : Parallel reduction of an array by a persistent thread pool
+
+  Notes:
+  A reduce_pool is a set of worker threads that are created once and then
+  reused by every call to parallel_reduce() or parallel_reduce_dbl(). Each
+  call divides the array into one contiguous segment per thread, the
+  calling thread taking the first. Every thread reduces its segment into a
+  local variable and stores the result once, into an accumulator that has
+  a cache line to itself, so that no two threads ever write to the same
+  cache line. The caller then combines the accumulators.
+
+  Programs that use these functions must be linked with -pthread.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#ifndef PARALLEL_REDUCE_H
+#define PARALLEL_REDUCE_H
+
+#include "common_hdrs.h"
+
+#define CACHE_LINE_SIZE  64
+
+/* The operators with which the elements can be combined. */
+typedef enum { REDUCE_SUM, REDUCE_PROD, REDUCE_MIN, REDUCE_MAX } reduce_op;
+
+typedef struct reduce_pool_tag reduce_pool;
+
+
+/** reduce_pool_create(n) creates a pool that reduces arrays with n threads,
+    namely the calling thread and n-1 workers. It returns NULL and sets
+    errno if the threads or memory could not be obtained.
+*/
+reduce_pool* reduce_pool_create( int num_threads );
+
+/** reduce_pool_destroy(pool) terminates the workers of pool and frees it.
+*/
+void reduce_pool_destroy( reduce_pool *pool );
+
+/** parallel_reduce(pool, data, n, op) returns the result of combining
+    data[0], ..., data[n-1] with op, using the threads of pool. The result
+    for an empty array is the identity of op: 0 for REDUCE_SUM, 1 for
+    REDUCE_PROD, LONG_MAX for REDUCE_MIN, and LONG_MIN for REDUCE_MAX.
+*/
+long parallel_reduce( reduce_pool *pool, const long *data, long n,
+                      reduce_op op );
+
+/** parallel_reduce_dbl(pool, data, n, op) is parallel_reduce() for an
+    array of doubles. The identities of REDUCE_MIN and REDUCE_MAX are
+    HUGE_VAL and -HUGE_VAL.
+*/
+double parallel_reduce_dbl( reduce_pool *pool, const double *data, long n,
+                            reduce_op op );
+
+#endif /* PARALLEL_REDUCE_H */
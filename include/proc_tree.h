@@ -0,0 +1,78 @@
+/*****************************************************************************
+  Title          : proc_tree.h
+  Author         : Stewart Weiss
+  Created on     : October 2026
+  Description    : An index of the parent/child relation of all processes
+
+  Notes:
+  A proc_tree is built from a single pass over /proc, reading only the
+  parent PID from each process's stat file. After that, the parent, the
+  children, and the ancestors of any process can be found without opening
+  another file, so programs that ask many such questions pay for one scan
+  of /proc instead of one file per process per question.
+
+******************************************************************************
+* Copyright (C) 2026 - Stewart Weiss                                         *
+*                                                                            *
+* This code is free software; you can use, modify, and redistribute it       *
+* under the terms of the GNU General Public License as published by the      *
+* Free Software Foundation; either version 3 of the License, or (at your     *
+* option) any later version. This code is distributed WITHOUT ANY WARRANTY;  *
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A      *
+* PARTICULAR PURPOSE. See the file COPYING.lgplv3 for details.               *
+*****************************************************************************/
+#ifndef PROC_TREE_H
+#define PROC_TREE_H
+
+#include "common_hdrs.h"
+
+#define NO_PROC  -1    /* Index meaning "no such process" */
+
+/* One process in the tree. Links are indices into the nodes array. */
+typedef struct
+{
+    pid_t  pid;
+    pid_t  ppid;
+    int    parent;        /* Index of parent, or NO_PROC if not in tree   */
+    int    first_child;   /* Index of child with smallest PID, or NO_PROC */
+    int    next_sibling;  /* Index of next child of parent, or NO_PROC    */
+    int    depth;         /* Number of ancestors in the tree              */
+} proc_node;
+
+typedef struct
+{
+    proc_node  *nodes;    /* Nodes sorted by increasing PID               */
+    int         numprocs; /* Number of nodes                              */
+} proc_tree;
+
+
+/** build_proc_tree(tree) scans /proc once and fills tree with a node for
+    every process, linked to its parent and children. Processes that end
+    during the scan are left out. It returns the number of processes, or
+    -1 if /proc could not be read.
+*/
+int  build_proc_tree( proc_tree *tree );
+
+/** free_proc_tree(tree) releases the memory used by tree.
+*/
+void free_proc_tree( proc_tree *tree );
+
+/** find_proc(tree, pid) returns the index of the node for pid in tree,
+    or NO_PROC if there is none.
+*/
+int  find_proc( const proc_tree *tree, pid_t pid );
+
+/** get_ancestors(tree, pid, list, max) stores the PIDs of the ancestors of
+    pid in list, parent first, up to max of them. It returns the number of
+    ancestors, or -1 if pid is not in tree.
+*/
+int  get_ancestors( const proc_tree *tree, pid_t pid, pid_t *list, int max );
+
+/** next_preorder(tree, i) returns the index of the node that follows node i
+    in a preorder traversal of the forest, visiting children in increasing
+    PID order, or NO_PROC after the last node. next_preorder(tree, NO_PROC)
+    returns the first node.
+*/
+int  next_preorder( const proc_tree *tree, int i );
+
+#endif /* PROC_TREE_H */